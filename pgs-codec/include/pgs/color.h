@@ -0,0 +1,66 @@
+/*
+ * PGS palette color conversion
+ *
+ * Converts RGB palette entries to the YCrCb values of a PDS and back with
+ * precomputed fixed-point lookup tables.
+ */
+
+#ifndef PGS_CODEC_COLOR_H
+#define PGS_CODEC_COLOR_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    PGS_COLOR_BT601,
+    PGS_COLOR_BT709,
+} pgs_color_matrix;
+
+typedef enum
+{
+    // Y, Cb and Cr use 0-255
+    PGS_COLOR_FULL_RANGE,
+    // Y uses 16-235, Cb and Cr use 16-240
+    PGS_COLOR_LIMITED_RANGE,
+} pgs_color_range;
+
+typedef struct
+{
+    // contribution of every value of R, G and B in fixed point with 20 fraction bits,
+    // the tables of R also hold the offset and the rounding of the component
+    int32_t y[3][256];
+    int32_t cb[3][256];
+    int32_t cr[3][256];
+
+    // inverse conversion: contribution of Y to R, G and B and of Cb and Cr to the components they change
+    int32_t rgby[256];
+    int32_t rcr[256];
+    int32_t gcb[256];
+    int32_t gcr[256];
+    int32_t bcb[256];
+} pgs_color_table;
+
+// parses a matrix name: bt601, bt709, bt601-limited or bt709-limited
+// returns 1 on success, 0 for unknown names
+int pgs_color_parse(const char *name, pgs_color_matrix *matrix, pgs_color_range *range);
+
+// fills the lookup tables, the table is read-only afterwards and can be shared between threads
+void pgs_color_table_init(pgs_color_table *table, pgs_color_matrix matrix, pgs_color_range range);
+
+// converts a color, the results are rounded to the nearest value and clamped
+void pgs_color_convert(const pgs_color_table *table, unsigned char r, unsigned char g, unsigned char b,
+                       unsigned char *y, unsigned char *cb, unsigned char *cr);
+
+// converts a PDS color back to RGB, rounded and clamped
+void pgs_color_convert_rgb(const pgs_color_table *table, unsigned char y, unsigned char cb, unsigned char cr,
+                           unsigned char *r, unsigned char *g, unsigned char *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PGS_CODEC_COLOR_H
@@ -0,0 +1,147 @@
+/*
+ * PGS stream decoder
+ *
+ * Splits a PGS stream into segments and applies them to the state of a
+ * decoder: the composition, windows, palettes and objects of the current
+ * epoch. The state is complete at the END segment of every display set.
+ */
+
+#ifndef PGS_CODEC_DECODER_H
+#define PGS_CODEC_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// segment types
+#define PGS_SEGMENT_PDS 0x14
+#define PGS_SEGMENT_ODS 0x15
+#define PGS_SEGMENT_PCS 0x16
+#define PGS_SEGMENT_WDS 0x17
+#define PGS_SEGMENT_END 0x80
+
+// magic number, timestamps, type and size
+#define PGS_SEGMENT_HEADER_SIZE 13
+
+// composition states of a PCS
+#define PGS_STATE_NORMAL 0x00
+#define PGS_STATE_ACQUISITION_POINT 0x40
+#define PGS_STATE_EPOCH_START 0x80
+
+// limits of the decoder model
+#define PGS_MAX_WINDOWS 2
+#define PGS_MAX_COMPOSITION_OBJECTS 2
+#define PGS_MAX_PALETTES 8
+#define PGS_MAX_OBJECTS 64
+
+typedef struct
+{
+    int type;
+    uint32_t pts;
+    uint32_t dts;
+
+    // segment data after the header, points into the parsed buffer
+    const unsigned char *payload;
+    size_t size;
+} pgs_segment;
+
+typedef struct
+{
+    unsigned object_id;
+    unsigned window_id;
+    int forced;
+    int cropped;
+    unsigned x;
+    unsigned y;
+    unsigned crop_x;
+    unsigned crop_y;
+    unsigned crop_width;
+    unsigned crop_height;
+} pgs_composition_object;
+
+typedef struct
+{
+    unsigned width;
+    unsigned height;
+    unsigned number;
+    int state;
+    int palette_update;
+    unsigned palette_id;
+    int count;
+    pgs_composition_object objects[PGS_MAX_COMPOSITION_OBJECTS];
+} pgs_composition;
+
+typedef struct
+{
+    unsigned id;
+    unsigned x;
+    unsigned y;
+    unsigned width;
+    unsigned height;
+} pgs_window;
+
+typedef struct
+{
+    int defined;
+    unsigned version;
+
+    // Y, Cr, Cb, A as stored in the PDS, undefined entries are transparent
+    unsigned char entries[256][4];
+} pgs_palette;
+
+typedef struct
+{
+    int defined;
+    unsigned version;
+    unsigned width;
+    unsigned height;
+
+    // run-length encoded data of all fragments, complete when size == length
+    unsigned char *data;
+    size_t size;
+    size_t length;
+    size_t capacity;
+} pgs_object;
+
+typedef struct
+{
+    // timestamps of the current display set (PCS)
+    uint32_t pts;
+    uint32_t dts;
+
+    pgs_composition composition;
+    pgs_window windows[PGS_MAX_WINDOWS];
+    int windowcount;
+    pgs_palette palettes[PGS_MAX_PALETTES];
+    pgs_object objects[PGS_MAX_OBJECTS];
+
+    // a PCS was read and the display set wasn't ended yet
+    int open;
+
+    // error message of the last failed segment
+    char error[256];
+} pgs_decoder;
+
+// parses the segment at the start of data
+// returns the size of the segment including the header, 0 when data doesn't start with a complete segment
+size_t pgs_segment_parse(const unsigned char *data, size_t size, pgs_segment *segment);
+
+void pgs_decoder_init(pgs_decoder *decoder);
+void pgs_decoder_free(pgs_decoder *decoder);
+
+// applies a segment to the state of the decoder
+// returns 1 when the segment ended a display set, 0 when more segments follow, -1 on error (see error)
+int pgs_decoder_push(pgs_decoder *decoder, const pgs_segment *segment);
+
+// decodes an object of the current epoch into width * height palette indices
+// returns 1 on success, 0 when the object is not complete or its data is not valid
+int pgs_decoder_object(const pgs_decoder *decoder, unsigned id, unsigned char *indices);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PGS_CODEC_DECODER_H
@@ -0,0 +1,73 @@
+/*
+ * PGS seek index
+ *
+ * Presentation time and byte offset of every display set a decoder can
+ * start at, an epoch start or acquisition point. The index is stored in
+ * a sidecar file next to the .sup file, all numbers are big-endian:
+ *
+ *   "PGSI", version (4 bytes), size of the .sup file (8 bytes), count (4 bytes)
+ *   count entries of PTS (4 bytes) and byte offset of the PCS (8 bytes)
+ */
+
+#ifndef PGS_CODEC_INDEX_H
+#define PGS_CODEC_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PGS_INDEX_VERSION 1
+#define PGS_INDEX_HEADER_SIZE 20
+#define PGS_INDEX_ENTRY_SIZE 12
+
+typedef struct
+{
+    uint32_t pts;
+    uint64_t offset;
+} pgs_index_entry;
+
+typedef struct
+{
+    // ordered by time and offset
+    pgs_index_entry *entries;
+    size_t count;
+    size_t capacity;
+
+    // size of the indexed .sup file
+    uint64_t supsize;
+} pgs_index;
+
+void pgs_index_init(pgs_index *index);
+void pgs_index_free(pgs_index *index);
+
+// appends an entry, the entries are added in stream order
+// returns 0 when the time or offset is before the last entry or out of memory
+int pgs_index_add(pgs_index *index, uint32_t pts, uint64_t offset);
+
+// indexes a complete PGS stream
+// returns 0 when the stream is not valid or out of memory
+int pgs_index_build(pgs_index *index, const unsigned char *data, size_t size);
+
+// returns the size of the serialized index
+size_t pgs_index_bound(const pgs_index *index);
+
+// writes the index to data (pgs_index_bound() bytes)
+// returns the number of bytes written
+size_t pgs_index_serialize(const pgs_index *index, unsigned char *data);
+
+// reads a serialized index
+// returns 0 when the data is not a valid index or out of memory
+int pgs_index_parse(pgs_index *index, const unsigned char *data, size_t size);
+
+// finds the entry to start decoding at for the screen at pts: the last entry at or before it
+// returns NULL when pts is before the first entry
+const pgs_index_entry *pgs_index_find(const pgs_index *index, uint32_t pts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PGS_CODEC_INDEX_H
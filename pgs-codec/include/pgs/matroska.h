@@ -0,0 +1,46 @@
+/*
+ * Matroska muxer
+ *
+ * Writes PGS streams as S_HDMV/PGS tracks of a Matroska file without
+ * video, which players and muxers load next to the video. Every display
+ * set is a SimpleBlock of its segments without the "PG" magic number and
+ * timestamps, at the PTS of its PCS. Epoch starts and acquisition points
+ * are key frames and listed in the cues.
+ */
+
+#ifndef PGS_CODEC_MATROSKA_H
+#define PGS_CODEC_MATROSKA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// block timestamps count in milliseconds
+#define PGS_MATROSKA_TIMESTAMP_SCALE 1000000
+
+typedef struct
+{
+    // complete PGS stream
+    const unsigned char *data;
+    size_t size;
+
+    // ISO 639-2 language code, name of the track or NULL
+    const char *language;
+    const char *name;
+
+    int isdefault;
+    int forced;
+} pgs_matroska_track;
+
+// writes a Matroska file with a track for each stream, numbered from 1
+// the blocks of all tracks are ordered by time, the file is allocated with malloc()
+// returns 0 when a stream is not valid or out of memory
+int pgs_matroska_mux(const pgs_matroska_track *tracks, int count, unsigned char **data, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PGS_CODEC_MATROSKA_H
@@ -0,0 +1,37 @@
+/*
+ * PGS run-length encoding
+ *
+ * Encodes a bitmap of palette indices into PGS object data and decodes it.
+ */
+
+#ifndef PGS_CODEC_RLE_H
+#define PGS_CODEC_RLE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// maximum number of bytes pgs_rle_encode() writes for a bitmap of the given size
+size_t pgs_rle_bound(unsigned width, unsigned height);
+
+// encodes all lines of the bitmap, every line is terminated by an end of line code (00 00)
+// stride is the distance between two lines in bytes
+// out must have room for pgs_rle_bound(width, height) bytes
+// returns the number of bytes written
+size_t pgs_rle_encode(const unsigned char *indices, unsigned width, unsigned height, size_t stride, unsigned char *out);
+
+// scalar reference implementation of the above, the output is identical
+size_t pgs_rle_encode_scalar(const unsigned char *indices, unsigned width, unsigned height, size_t stride, unsigned char *out);
+
+// decodes object data into width * height palette indices
+// every line must be exactly width pixels long and terminated by an end of line code
+// returns 1 on success, 0 when the data is not valid
+int pgs_rle_decode(const unsigned char *data, size_t size, unsigned width, unsigned height, unsigned char *indices);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PGS_CODEC_RLE_H
@@ -0,0 +1,62 @@
+/*
+ * PGS timestamps
+ *
+ * Frame rates of the composition segment and the mapping of timestamps
+ * for retiming a stream: a scale, a constant offset and a list of edits
+ * which change the offset from a point of the source timeline on.
+ */
+
+#ifndef PGS_CODEC_TIMING_H
+#define PGS_CODEC_TIMING_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// timestamps count in 90 kHz
+#define PGS_TICKS_PER_SECOND 90000
+
+typedef struct
+{
+    // source time (ticks) from which the offset applies
+    int64_t time;
+    int64_t offset;
+} pgs_edit;
+
+typedef struct
+{
+    // applied first, the offsets are added to the scaled time
+    double scale;
+    int64_t offset;
+
+    // ordered by time
+    pgs_edit *edits;
+    int count;
+    int capacity;
+} pgs_timemap;
+
+// parses a frame rate allowed on Blu-ray: 23.976, 24, 25, 29.97, 50 or 59.94
+// sets the frame rate code of the PCS and the duration of a frame in ticks, returns 0 for other frame rates
+int pgs_framerate_parse(const char *name, int *code, double *frameticks);
+
+// returns the duration of a frame in ticks for a frame rate code of the PCS, 0 for unknown codes
+double pgs_framerate_ticks(int code);
+
+// initializes an identity mapping
+void pgs_timemap_init(pgs_timemap *map);
+void pgs_timemap_free(pgs_timemap *map);
+
+// adds an edit, the offset replaces the one of the previous edit from time on
+// returns 0 when the time is not after the last edit or out of memory
+int pgs_timemap_add(pgs_timemap *map, int64_t time, int64_t offset);
+
+// maps a source time to the new timeline
+int64_t pgs_timemap_apply(const pgs_timemap *map, int64_t time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PGS_CODEC_TIMING_H
@@ -0,0 +1,132 @@
+#include "color.h"
+
+#include <string.h>
+
+// fraction bits of the fixed-point tables, sums of all 3 tables stay below 2^31
+#define PGS_COLOR_SHIFT 20
+
+static int32_t fixedpoint(double value)
+{
+    value *= (double) (1 << PGS_COLOR_SHIFT);
+    return (int32_t) (value >= 0.0 ? value + 0.5 : value - 0.5);
+}
+
+static void filltables(int32_t tables[3][256], const double coefficients[3], int offset)
+{
+    int c, v;
+
+    for (c = 0; c < 3; c++)
+    {
+        for (v = 0; v < 256; v++)
+        {
+            tables[c][v] = fixedpoint(coefficients[c] * v);
+        }
+    }
+
+    // the offset and half a step for rounding are added once with the red value
+    for (v = 0; v < 256; v++)
+    {
+        tables[0][v] += (offset << PGS_COLOR_SHIFT) + (1 << (PGS_COLOR_SHIFT - 1));
+    }
+}
+
+static unsigned char clamp(int32_t sum)
+{
+    if (sum < 0)
+    {
+        return 0;
+    }
+    sum >>= PGS_COLOR_SHIFT;
+    return (unsigned char) (sum > 255 ? 255 : sum);
+}
+
+static unsigned char lookup(const int32_t tables[3][256], unsigned char r, unsigned char g, unsigned char b)
+{
+    return clamp(tables[0][r] + tables[1][g] + tables[2][b]);
+}
+
+int pgs_color_parse(const char *name, pgs_color_matrix *matrix, pgs_color_range *range)
+{
+    static const struct
+    {
+        const char *name;
+        pgs_color_matrix matrix;
+        pgs_color_range range;
+    } names[4] = {
+        {"bt601", PGS_COLOR_BT601, PGS_COLOR_FULL_RANGE},
+        {"bt709", PGS_COLOR_BT709, PGS_COLOR_FULL_RANGE},
+        {"bt601-limited", PGS_COLOR_BT601, PGS_COLOR_LIMITED_RANGE},
+        {"bt709-limited", PGS_COLOR_BT709, PGS_COLOR_LIMITED_RANGE},
+    };
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        if (strcmp(name, names[i].name) == 0)
+        {
+            *matrix = names[i].matrix;
+            *range = names[i].range;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void pgs_color_table_init(pgs_color_table *table, pgs_color_matrix matrix, pgs_color_range range)
+{
+    double kr, kg, kb;
+    double yscale, cscale;
+    int yoffset;
+    double coefficients[3];
+    int v;
+
+    kr = matrix == PGS_COLOR_BT709 ? 0.2126 : 0.299;
+    kb = matrix == PGS_COLOR_BT709 ? 0.0722 : 0.114;
+    kg = 1.0 - kr - kb;
+
+    // limited range scales the 0-255 range to 219 steps of luma and 224 steps of chroma
+    yscale = range == PGS_COLOR_LIMITED_RANGE ? 219.0 / 255.0 : 1.0;
+    cscale = range == PGS_COLOR_LIMITED_RANGE ? 224.0 / 255.0 : 1.0;
+    yoffset = range == PGS_COLOR_LIMITED_RANGE ? 16 : 0;
+
+    coefficients[0] = kr * yscale;
+    coefficients[1] = kg * yscale;
+    coefficients[2] = kb * yscale;
+    filltables(table->y, coefficients, yoffset);
+
+    coefficients[0] = -kr / (2.0 * (1.0 - kb)) * cscale;
+    coefficients[1] = -kg / (2.0 * (1.0 - kb)) * cscale;
+    coefficients[2] = 0.5 * cscale;
+    filltables(table->cb, coefficients, 128);
+
+    coefficients[0] = 0.5 * cscale;
+    coefficients[1] = -kg / (2.0 * (1.0 - kr)) * cscale;
+    coefficients[2] = -kb / (2.0 * (1.0 - kr)) * cscale;
+    filltables(table->cr, coefficients, 128);
+
+    // inverse: R = Y + 2 (1 - Kr) Cr, B = Y + 2 (1 - Kb) Cb, G from Y, R and B
+    for (v = 0; v < 256; v++)
+    {
+        table->rgby[v] = fixedpoint((v - yoffset) / yscale + 0.5);
+        table->rcr[v] = fixedpoint((v - 128) / cscale * 2.0 * (1.0 - kr));
+        table->gcb[v] = fixedpoint(-(v - 128) / cscale * 2.0 * kb * (1.0 - kb) / kg);
+        table->gcr[v] = fixedpoint(-(v - 128) / cscale * 2.0 * kr * (1.0 - kr) / kg);
+        table->bcb[v] = fixedpoint((v - 128) / cscale * 2.0 * (1.0 - kb));
+    }
+}
+
+void pgs_color_convert(const pgs_color_table *table, unsigned char r, unsigned char g, unsigned char b,
+                       unsigned char *y, unsigned char *cb, unsigned char *cr)
+{
+    *y = lookup(table->y, r, g, b);
+    *cb = lookup(table->cb, r, g, b);
+    *cr = lookup(table->cr, r, g, b);
+}
+
+void pgs_color_convert_rgb(const pgs_color_table *table, unsigned char y, unsigned char cb, unsigned char cr,
+                           unsigned char *r, unsigned char *g, unsigned char *b)
+{
+    *r = clamp(table->rgby[y] + table->rcr[cr]);
+    *g = clamp(table->rgby[y] + table->gcb[cb] + table->gcr[cr]);
+    *b = clamp(table->rgby[y] + table->bcb[cb]);
+}
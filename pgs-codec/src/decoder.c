@@ -0,0 +1,370 @@
+#include "decoder.h"
+#include "rle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned read16(const unsigned char *p)
+{
+    return ((unsigned) p[0] << 8) | p[1];
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static int seterror(pgs_decoder *decoder, const char *message)
+{
+    snprintf(decoder->error, sizeof(decoder->error), "%s", message);
+    return -1;
+}
+
+size_t pgs_segment_parse(const unsigned char *data, size_t size, pgs_segment *segment)
+{
+    size_t length;
+
+    if (size < PGS_SEGMENT_HEADER_SIZE || data[0] != 0x50 || data[1] != 0x47)
+    {
+        return 0;
+    }
+
+    length = read16(data + 11);
+    if (size - PGS_SEGMENT_HEADER_SIZE < length)
+    {
+        return 0;
+    }
+
+    segment->pts = read32(data + 2);
+    segment->dts = read32(data + 6);
+    segment->type = data[10];
+    segment->payload = data + PGS_SEGMENT_HEADER_SIZE;
+    segment->size = length;
+    return PGS_SEGMENT_HEADER_SIZE + length;
+}
+
+void pgs_decoder_init(pgs_decoder *decoder)
+{
+    memset(decoder, 0, sizeof(pgs_decoder));
+}
+
+void pgs_decoder_free(pgs_decoder *decoder)
+{
+    int i;
+
+    for (i = 0; i < PGS_MAX_OBJECTS; i++)
+    {
+        free(decoder->objects[i].data);
+    }
+    memset(decoder, 0, sizeof(pgs_decoder));
+}
+
+// an epoch start clears the memory of the decoder, the object buffers are kept for reuse
+static void startepoch(pgs_decoder *decoder)
+{
+    int i;
+
+    decoder->windowcount = 0;
+    memset(decoder->palettes, 0, sizeof(decoder->palettes));
+    for (i = 0; i < PGS_MAX_OBJECTS; i++)
+    {
+        decoder->objects[i].defined = 0;
+        decoder->objects[i].size = 0;
+        decoder->objects[i].length = 0;
+    }
+}
+
+static int readpcs(pgs_decoder *decoder, const pgs_segment *segment)
+{
+    const unsigned char *p;
+    pgs_composition *composition;
+    pgs_composition_object *object;
+    size_t t;
+    int i, count;
+
+    if (decoder->open)
+    {
+        return seterror(decoder, "composition segment inside of a display set");
+    }
+    p = segment->payload;
+    if (segment->size < 11)
+    {
+        return seterror(decoder, "composition segment is too short");
+    }
+    count = p[10];
+    if (count > PGS_MAX_COMPOSITION_OBJECTS)
+    {
+        return seterror(decoder, "composition with more than 2 objects");
+    }
+
+    composition = &decoder->composition;
+    composition->width = read16(p);
+    composition->height = read16(p + 2);
+    composition->number = read16(p + 5);
+    composition->state = p[7] & 0xc0;
+    composition->palette_update = (p[8] & 0x80) != 0;
+    composition->palette_id = p[9];
+    composition->count = count;
+
+    t = 11;
+    for (i = 0; i < count; i++)
+    {
+        if (segment->size < t + 8)
+        {
+            return seterror(decoder, "composition segment is too short");
+        }
+        object = &composition->objects[i];
+        memset(object, 0, sizeof(pgs_composition_object));
+        object->object_id = read16(p + t);
+        object->window_id = p[t + 2];
+        object->cropped = (p[t + 3] & 0x80) != 0;
+        object->forced = (p[t + 3] & 0x40) != 0;
+        object->x = read16(p + t + 4);
+        object->y = read16(p + t + 6);
+        t += 8;
+        if (object->cropped)
+        {
+            if (segment->size < t + 8)
+            {
+                return seterror(decoder, "composition segment is too short");
+            }
+            object->crop_x = read16(p + t);
+            object->crop_y = read16(p + t + 2);
+            object->crop_width = read16(p + t + 4);
+            object->crop_height = read16(p + t + 6);
+            t += 8;
+        }
+    }
+
+    if (composition->state == PGS_STATE_EPOCH_START)
+    {
+        startepoch(decoder);
+    }
+
+    decoder->pts = segment->pts;
+    decoder->dts = segment->dts;
+    decoder->open = 1;
+    return 0;
+}
+
+static int readwds(pgs_decoder *decoder, const pgs_segment *segment)
+{
+    const unsigned char *p;
+    pgs_window *window;
+    int i, count;
+
+    p = segment->payload;
+    count = segment->size > 0 ? p[0] : 0;
+    if (segment->size < 1 || segment->size < 1 + (size_t) count * 9)
+    {
+        return seterror(decoder, "window segment is too short");
+    }
+    if (count > PGS_MAX_WINDOWS)
+    {
+        return seterror(decoder, "more than 2 windows");
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        window = &decoder->windows[i];
+        window->id = p[1 + i * 9];
+        window->x = read16(p + 2 + i * 9);
+        window->y = read16(p + 4 + i * 9);
+        window->width = read16(p + 6 + i * 9);
+        window->height = read16(p + 8 + i * 9);
+    }
+    decoder->windowcount = count;
+    return 0;
+}
+
+static int readpds(pgs_decoder *decoder, const pgs_segment *segment)
+{
+    const unsigned char *p;
+    pgs_palette *palette;
+    size_t t;
+
+    p = segment->payload;
+    if (segment->size < 2 || (segment->size - 2) % 5 != 0)
+    {
+        return seterror(decoder, "palette segment has an invalid size");
+    }
+    if (p[0] >= PGS_MAX_PALETTES)
+    {
+        return seterror(decoder, "palette id is out of range");
+    }
+
+    // entries which aren't part of the segment keep their values
+    palette = &decoder->palettes[p[0]];
+    palette->defined = 1;
+    palette->version = p[1];
+    for (t = 2; t < segment->size; t += 5)
+    {
+        memcpy(palette->entries[p[t]], p + t + 1, 4);
+    }
+    return 0;
+}
+
+static int readods(pgs_decoder *decoder, const pgs_segment *segment)
+{
+    const unsigned char *p;
+    pgs_object *object;
+    unsigned char *data;
+    size_t t, length, capacity;
+    unsigned id;
+    int first, last;
+
+    p = segment->payload;
+    if (segment->size < 4)
+    {
+        return seterror(decoder, "object segment is too short");
+    }
+    id = read16(p);
+    if (id >= PGS_MAX_OBJECTS)
+    {
+        return seterror(decoder, "object id is out of range");
+    }
+    first = (p[3] & 0x80) != 0;
+    last = (p[3] & 0x40) != 0;
+
+    object = &decoder->objects[id];
+    t = 4;
+    if (first)
+    {
+        if (segment->size < 11)
+        {
+            return seterror(decoder, "object segment is too short");
+        }
+
+        // the data length includes the 4 bytes of the object size
+        length = ((size_t) p[4] << 16) | ((size_t) p[5] << 8) | p[6];
+        if (length < 4)
+        {
+            return seterror(decoder, "object data length is invalid");
+        }
+        object->defined = 1;
+        object->version = p[2];
+        object->width = read16(p + 7);
+        object->height = read16(p + 9);
+        object->size = 0;
+        object->length = length - 4;
+        t = 11;
+    }
+    else if (!object->defined || object->size == object->length)
+    {
+        return seterror(decoder, "object fragment without a first fragment");
+    }
+
+    length = segment->size - t;
+    if (object->size + length > object->length)
+    {
+        return seterror(decoder, "object data is longer than its data length");
+    }
+    if (object->size + length > object->capacity)
+    {
+        capacity = object->length;
+        data = (unsigned char*) realloc(object->data, capacity);
+        if (data == NULL)
+        {
+            return seterror(decoder, "out of memory");
+        }
+        object->data = data;
+        object->capacity = capacity;
+    }
+    if (length > 0)
+    {
+        memcpy(object->data + object->size, p + t, length);
+    }
+    object->size += length;
+
+    if (last && object->size != object->length)
+    {
+        return seterror(decoder, "object data is shorter than its data length");
+    }
+    return 0;
+}
+
+// checks that everything the composition refers to is defined
+static int readend(pgs_decoder *decoder)
+{
+    const pgs_composition *composition;
+    const pgs_composition_object *object;
+    const pgs_object *data;
+    int i, j, found;
+
+    composition = &decoder->composition;
+    decoder->open = 0;
+    if (composition->count == 0)
+    {
+        return 1;
+    }
+
+    if (composition->palette_id >= PGS_MAX_PALETTES || !decoder->palettes[composition->palette_id].defined)
+    {
+        return seterror(decoder, "composition refers to an undefined palette");
+    }
+    for (i = 0; i < composition->count; i++)
+    {
+        object = &composition->objects[i];
+        if (object->object_id >= PGS_MAX_OBJECTS)
+        {
+            return seterror(decoder, "composition refers to an undefined object");
+        }
+        data = &decoder->objects[object->object_id];
+        if (!data->defined || data->size != data->length)
+        {
+            return seterror(decoder, "composition refers to an undefined or incomplete object");
+        }
+
+        found = 0;
+        for (j = 0; j < decoder->windowcount; j++)
+        {
+            found |= decoder->windows[j].id == object->window_id;
+        }
+        if (!found)
+        {
+            return seterror(decoder, "composition refers to an undefined window");
+        }
+    }
+    return 1;
+}
+
+int pgs_decoder_push(pgs_decoder *decoder, const pgs_segment *segment)
+{
+    if (segment->type != PGS_SEGMENT_PCS && !decoder->open)
+    {
+        return seterror(decoder, "segment outside of a display set");
+    }
+
+    switch (segment->type)
+    {
+        case PGS_SEGMENT_PCS:
+            return readpcs(decoder, segment);
+        case PGS_SEGMENT_WDS:
+            return readwds(decoder, segment);
+        case PGS_SEGMENT_PDS:
+            return readpds(decoder, segment);
+        case PGS_SEGMENT_ODS:
+            return readods(decoder, segment);
+        case PGS_SEGMENT_END:
+            return readend(decoder);
+        default:
+            return seterror(decoder, "unknown segment type");
+    }
+}
+
+int pgs_decoder_object(const pgs_decoder *decoder, unsigned id, unsigned char *indices)
+{
+    const pgs_object *object;
+
+    if (id >= PGS_MAX_OBJECTS)
+    {
+        return 0;
+    }
+    object = &decoder->objects[id];
+    if (!object->defined || object->size != object->length)
+    {
+        return 0;
+    }
+    return pgs_rle_decode(object->data, object->size, object->width, object->height, indices);
+}
@@ -0,0 +1,153 @@
+#include "index.h"
+#include "decoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void write32(unsigned char *p, uint32_t value)
+{
+    p[0] = (unsigned char) (value >> 24);
+    p[1] = (unsigned char) (value >> 16);
+    p[2] = (unsigned char) (value >> 8);
+    p[3] = (unsigned char) value;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+void pgs_index_init(pgs_index *index)
+{
+    memset(index, 0, sizeof(pgs_index));
+}
+
+void pgs_index_free(pgs_index *index)
+{
+    free(index->entries);
+    memset(index, 0, sizeof(pgs_index));
+}
+
+int pgs_index_add(pgs_index *index, uint32_t pts, uint64_t offset)
+{
+    pgs_index_entry *entries;
+    size_t capacity;
+
+    if (index->count > 0 && (pts < index->entries[index->count - 1].pts || offset <= index->entries[index->count - 1].offset))
+    {
+        return 0;
+    }
+    if (index->count == index->capacity)
+    {
+        capacity = index->capacity ? index->capacity * 2 : 256;
+        entries = (pgs_index_entry*) realloc(index->entries, capacity * sizeof(pgs_index_entry));
+        if (entries == NULL)
+        {
+            return 0;
+        }
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+    index->entries[index->count].pts = pts;
+    index->entries[index->count].offset = offset;
+    index->count++;
+    return 1;
+}
+
+int pgs_index_build(pgs_index *index, const unsigned char *data, size_t size)
+{
+    pgs_segment segment;
+    size_t pos, length;
+
+    for (pos = 0; pos < size; pos += length)
+    {
+        length = pgs_segment_parse(data + pos, size - pos, &segment);
+        if (length == 0)
+        {
+            return 0;
+        }
+        if (segment.type == PGS_SEGMENT_PCS && segment.size >= 8 && (segment.payload[7] & 0xc0) != PGS_STATE_NORMAL &&
+            !pgs_index_add(index, segment.pts, pos))
+        {
+            return 0;
+        }
+    }
+    index->supsize = size;
+    return 1;
+}
+
+size_t pgs_index_bound(const pgs_index *index)
+{
+    return PGS_INDEX_HEADER_SIZE + index->count * PGS_INDEX_ENTRY_SIZE;
+}
+
+size_t pgs_index_serialize(const pgs_index *index, unsigned char *data)
+{
+    unsigned char *p;
+    size_t i;
+
+    memcpy(data, "PGSI", 4);
+    write32(data + 4, PGS_INDEX_VERSION);
+    write32(data + 8, (uint32_t) (index->supsize >> 32));
+    write32(data + 12, (uint32_t) index->supsize);
+    write32(data + 16, (uint32_t) index->count);
+
+    p = data + PGS_INDEX_HEADER_SIZE;
+    for (i = 0; i < index->count; i++, p += PGS_INDEX_ENTRY_SIZE)
+    {
+        write32(p, index->entries[i].pts);
+        write32(p + 4, (uint32_t) (index->entries[i].offset >> 32));
+        write32(p + 8, (uint32_t) index->entries[i].offset);
+    }
+    return PGS_INDEX_HEADER_SIZE + index->count * PGS_INDEX_ENTRY_SIZE;
+}
+
+int pgs_index_parse(pgs_index *index, const unsigned char *data, size_t size)
+{
+    const unsigned char *p;
+    uint32_t count, i;
+
+    if (size < PGS_INDEX_HEADER_SIZE || memcmp(data, "PGSI", 4) != 0 || read32(data + 4) != PGS_INDEX_VERSION)
+    {
+        return 0;
+    }
+    count = read32(data + 16);
+    if ((size - PGS_INDEX_HEADER_SIZE) / PGS_INDEX_ENTRY_SIZE != count || (size - PGS_INDEX_HEADER_SIZE) % PGS_INDEX_ENTRY_SIZE != 0)
+    {
+        return 0;
+    }
+
+    index->count = 0;
+    index->supsize = ((uint64_t) read32(data + 8) << 32) | read32(data + 12);
+    p = data + PGS_INDEX_HEADER_SIZE;
+    for (i = 0; i < count; i++, p += PGS_INDEX_ENTRY_SIZE)
+    {
+        if (!pgs_index_add(index, read32(p), ((uint64_t) read32(p + 4) << 32) | read32(p + 8)))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const pgs_index_entry *pgs_index_find(const pgs_index *index, uint32_t pts)
+{
+    size_t low, high, middle;
+
+    // first entry after pts
+    low = 0;
+    high = index->count;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (index->entries[middle].pts <= pts)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low > 0 ? &index->entries[low - 1] : NULL;
+}
@@ -0,0 +1,491 @@
+#include "matroska.h"
+#include "decoder.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// element IDs, with their length marker
+#define EBML_HEADER 0x1a45dfa3
+#define EBML_VERSION 0x4286
+#define EBML_READ_VERSION 0x42f7
+#define EBML_MAX_ID_LENGTH 0x42f2
+#define EBML_MAX_SIZE_LENGTH 0x42f3
+#define EBML_DOC_TYPE 0x4282
+#define EBML_DOC_TYPE_VERSION 0x4287
+#define EBML_DOC_TYPE_READ_VERSION 0x4285
+
+#define MKV_SEGMENT 0x18538067
+#define MKV_SEEK_HEAD 0x114d9b74
+#define MKV_SEEK 0x4dbb
+#define MKV_SEEK_ID 0x53ab
+#define MKV_SEEK_POSITION 0x53ac
+#define MKV_INFO 0x1549a966
+#define MKV_TIMESTAMP_SCALE 0x2ad7b1
+#define MKV_DURATION 0x4489
+#define MKV_MUXING_APP 0x4d80
+#define MKV_WRITING_APP 0x5741
+#define MKV_TRACKS 0x1654ae6b
+#define MKV_TRACK_ENTRY 0xae
+#define MKV_TRACK_NUMBER 0xd7
+#define MKV_TRACK_UID 0x73c5
+#define MKV_TRACK_TYPE 0x83
+#define MKV_FLAG_DEFAULT 0x88
+#define MKV_FLAG_FORCED 0x55aa
+#define MKV_FLAG_LACING 0x9c
+#define MKV_NAME 0x536e
+#define MKV_LANGUAGE 0x22b59c
+#define MKV_CODEC_ID 0x86
+#define MKV_CLUSTER 0x1f43b675
+#define MKV_TIMESTAMP 0xe7
+#define MKV_SIMPLE_BLOCK 0xa3
+#define MKV_CUES 0x1c53bb6b
+#define MKV_CUE_POINT 0xbb
+#define MKV_CUE_TIME 0xb3
+#define MKV_CUE_TRACK_POSITIONS 0xb7
+#define MKV_CUE_TRACK 0xf7
+#define MKV_CUE_CLUSTER_POSITION 0xf1
+#define MKV_CUE_RELATIVE_POSITION 0xf0
+
+#define MKV_TRACK_TYPE_SUBTITLE 0x11
+
+// blocks store their time relative to the cluster in 16 bits
+#define MAX_CLUSTER_SPAN 32767
+
+// clusters start at an epoch start or acquisition point after this time (ms),
+// players seeking by the cues start reading subtitles at the cluster
+#define CLUSTER_LENGTH 5000
+
+// track numbers are written as a single byte in the blocks
+#define MAX_TRACKS 126
+
+typedef struct
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    int failed;
+} ebmlbuffer;
+
+// a display set of a track
+typedef struct
+{
+    int track;
+    size_t number;
+
+    // segments in the PGS stream and their size without the magic number and timestamps
+    size_t start;
+    size_t end;
+    size_t size;
+
+    // PTS in milliseconds, epoch start or acquisition point
+    int64_t time;
+    int key;
+
+    // segment position of the cluster and position of the block in the cluster, for the cues
+    size_t cluster;
+    size_t position;
+} matroskablock;
+
+static void put(ebmlbuffer *b, const void *data, size_t size)
+{
+    unsigned char *buffer;
+    size_t capacity;
+
+    if (b->failed)
+    {
+        return;
+    }
+    if (b->size + size > b->capacity)
+    {
+        capacity = b->capacity ? b->capacity : 65536;
+        while (capacity < b->size + size)
+        {
+            capacity *= 2;
+        }
+        buffer = (unsigned char*) realloc(b->data, capacity);
+        if (buffer == NULL)
+        {
+            b->failed = 1;
+            return;
+        }
+        b->data = buffer;
+        b->capacity = capacity;
+    }
+    memcpy(b->data + b->size, data, size);
+    b->size += size;
+}
+
+// big-endian number of width bytes
+static void putnumber(ebmlbuffer *b, uint64_t value, int width)
+{
+    unsigned char bytes[8];
+    int i;
+
+    for (i = 0; i < width; i++)
+    {
+        bytes[i] = (unsigned char) (value >> (8 * (width - 1 - i)));
+    }
+    put(b, bytes, width);
+}
+
+static void setnumber(ebmlbuffer *b, size_t position, uint64_t value, int width)
+{
+    int i;
+
+    if (b->failed)
+    {
+        return;
+    }
+    for (i = 0; i < width; i++)
+    {
+        b->data[position + i] = (unsigned char) (value >> (8 * (width - 1 - i)));
+    }
+}
+
+static void putid(ebmlbuffer *b, uint32_t id)
+{
+    putnumber(b, id, id > 0xffffff ? 4 : id > 0xffff ? 3 : id > 0xff ? 2 : 1);
+}
+
+// variable size integer of the shortest length, the value with all bits set is reserved
+static void putsize(ebmlbuffer *b, uint64_t size)
+{
+    int width;
+
+    width = 1;
+    while (width < 8 && size >= ((uint64_t) 1 << (7 * width)) - 1)
+    {
+        width++;
+    }
+    putnumber(b, size | ((uint64_t) 1 << (7 * width)), width);
+}
+
+static void putuint(ebmlbuffer *b, uint32_t id, uint64_t value)
+{
+    int width;
+
+    width = 1;
+    while (width < 8 && (value >> (8 * width)) != 0)
+    {
+        width++;
+    }
+    putid(b, id);
+    putsize(b, width);
+    putnumber(b, value, width);
+}
+
+static void putstring(ebmlbuffer *b, uint32_t id, const char *value)
+{
+    putid(b, id);
+    putsize(b, strlen(value));
+    put(b, value, strlen(value));
+}
+
+static void putfloat(ebmlbuffer *b, uint32_t id, double value)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    putid(b, id);
+    putsize(b, 8);
+    putnumber(b, bits, 8);
+}
+
+// writes the ID of a master element and an 8 byte size set by endmaster()
+// returns the position of the size
+static size_t startmaster(ebmlbuffer *b, uint32_t id)
+{
+    putid(b, id);
+    putnumber(b, (uint64_t) 1 << 56, 8);
+    return b->size - 8;
+}
+
+static void endmaster(ebmlbuffer *b, size_t position)
+{
+    setnumber(b, position, (b->size - position - 8) | ((uint64_t) 1 << 56), 8);
+}
+
+// writes a seek entry with an 8 byte position set once the element is written
+// returns the position of the position
+static size_t putseek(ebmlbuffer *b, uint32_t id)
+{
+    size_t seek;
+
+    seek = startmaster(b, MKV_SEEK);
+    putid(b, MKV_SEEK_ID);
+    putsize(b, 4);
+    putnumber(b, id, 4);
+    putid(b, MKV_SEEK_POSITION);
+    putsize(b, 8);
+    putnumber(b, 0, 8);
+    endmaster(b, seek);
+    return b->size - 8;
+}
+
+// splits a PGS stream into display sets, from the PCS up to END
+// returns 0 when the stream is not valid or out of memory
+static int addblocks(const pgs_matroska_track *track, int number, matroskablock **blocks, size_t *count, size_t *capacity)
+{
+    pgs_segment segment;
+    matroskablock *block, *resized;
+    size_t pos, length, first;
+    int open;
+
+    open = 0;
+    first = *count;
+    block = NULL;
+    for (pos = 0; pos < track->size; pos += length)
+    {
+        length = pgs_segment_parse(track->data + pos, track->size - pos, &segment);
+        if (length == 0)
+        {
+            return(0);
+        }
+
+        if (segment.type == PGS_SEGMENT_PCS)
+        {
+            if (open || segment.size < 8)
+            {
+                return(0);
+            }
+            if (*count == *capacity)
+            {
+                *capacity = *capacity ? *capacity * 2 : 256;
+                resized = (matroskablock*) realloc(*blocks, *capacity * sizeof(matroskablock));
+                if (resized == NULL)
+                {
+                    return(0);
+                }
+                *blocks = resized;
+            }
+            block = &(*blocks)[*count];
+            memset(block, 0, sizeof(matroskablock));
+            block->track = number;
+            block->number = *count - first;
+            block->start = pos;
+            block->time = ((int64_t) segment.pts + 45) / 90;
+            block->key = (segment.payload[7] & 0xc0) != PGS_STATE_NORMAL;
+            open = 1;
+        }
+        else if (!open)
+        {
+            return(0);
+        }
+
+        // the block has the segment type, size and payload
+        block->size += length - 10;
+        if (segment.type == PGS_SEGMENT_END)
+        {
+            block->end = pos + length;
+            (*count)++;
+            open = 0;
+        }
+    }
+    return !open;
+}
+
+// orders the blocks by time, the display sets of a track keep their order
+static int compareblocks(const void *a, const void *b)
+{
+    const matroskablock *x = (const matroskablock*) a;
+    const matroskablock *y = (const matroskablock*) b;
+
+    if (x->time != y->time)
+    {
+        return x->time < y->time ? -1 : 1;
+    }
+    if (x->track != y->track)
+    {
+        return x->track < y->track ? -1 : 1;
+    }
+    return x->number < y->number ? -1 : x->number > y->number;
+}
+
+static void putblock(ebmlbuffer *b, const pgs_matroska_track *track, const matroskablock *block, int64_t clustertime)
+{
+    pgs_segment segment;
+    size_t pos, length;
+    unsigned char header[4];
+
+    putid(b, MKV_SIMPLE_BLOCK);
+    putsize(b, sizeof(header) + block->size);
+    header[0] = (unsigned char) (0x80 | block->track);
+    header[1] = (unsigned char) ((block->time - clustertime) >> 8);
+    header[2] = (unsigned char) (block->time - clustertime);
+    header[3] = block->key ? 0x80 : 0x00;
+    put(b, header, sizeof(header));
+
+    for (pos = block->start; pos < block->end; pos += length)
+    {
+        length = pgs_segment_parse(track->data + pos, block->end - pos, &segment);
+        put(b, track->data + pos + 10, length - 10);
+    }
+}
+
+int pgs_matroska_mux(const pgs_matroska_track *tracks, int count, unsigned char **data, size_t *size)
+{
+    ebmlbuffer b;
+    matroskablock *blocks;
+    size_t blockcount, blockcapacity;
+    size_t segment, segmentdata, element, entry, cluster, clustersize, clusterdata, cuepoint;
+    size_t infoseek, tracksseek, cuesseek;
+    size_t i, keys;
+    int64_t clustertime, cuetime;
+    int t;
+
+    *data = NULL;
+    *size = 0;
+    if (count < 1 || count > MAX_TRACKS)
+    {
+        return(0);
+    }
+
+    blocks = NULL;
+    blockcount = 0;
+    blockcapacity = 0;
+    for (t = 0; t < count; t++)
+    {
+        if (!addblocks(&tracks[t], t + 1, &blocks, &blockcount, &blockcapacity))
+        {
+            free(blocks);
+            return(0);
+        }
+    }
+    if (blockcount > 0)
+    {
+        qsort(blocks, blockcount, sizeof(matroskablock), compareblocks);
+    }
+    keys = 0;
+    for (i = 0; i < blockcount; i++)
+    {
+        keys += blocks[i].key;
+    }
+
+    memset(&b, 0, sizeof(ebmlbuffer));
+    element = startmaster(&b, EBML_HEADER);
+    putuint(&b, EBML_VERSION, 1);
+    putuint(&b, EBML_READ_VERSION, 1);
+    putuint(&b, EBML_MAX_ID_LENGTH, 4);
+    putuint(&b, EBML_MAX_SIZE_LENGTH, 8);
+    putstring(&b, EBML_DOC_TYPE, "matroska");
+    putuint(&b, EBML_DOC_TYPE_VERSION, 4);
+    putuint(&b, EBML_DOC_TYPE_READ_VERSION, 2);
+    endmaster(&b, element);
+
+    // positions in the segment are counted from its data
+    segment = startmaster(&b, MKV_SEGMENT);
+    segmentdata = b.size;
+
+    element = startmaster(&b, MKV_SEEK_HEAD);
+    infoseek = putseek(&b, MKV_INFO);
+    tracksseek = putseek(&b, MKV_TRACKS);
+    cuesseek = keys > 0 ? putseek(&b, MKV_CUES) : 0;
+    endmaster(&b, element);
+
+    setnumber(&b, infoseek, b.size - segmentdata, 8);
+    element = startmaster(&b, MKV_INFO);
+    putuint(&b, MKV_TIMESTAMP_SCALE, PGS_MATROSKA_TIMESTAMP_SCALE);
+    if (blockcount > 0 && blocks[blockcount - 1].time > 0)
+    {
+        putfloat(&b, MKV_DURATION, (double) blocks[blockcount - 1].time);
+    }
+    putstring(&b, MKV_MUXING_APP, "pgs-codec");
+    putstring(&b, MKV_WRITING_APP, "pgs-codec");
+    endmaster(&b, element);
+
+    setnumber(&b, tracksseek, b.size - segmentdata, 8);
+    element = startmaster(&b, MKV_TRACKS);
+    for (t = 0; t < count; t++)
+    {
+        entry = startmaster(&b, MKV_TRACK_ENTRY);
+        putuint(&b, MKV_TRACK_NUMBER, t + 1);
+        putuint(&b, MKV_TRACK_UID, t + 1);
+        putuint(&b, MKV_TRACK_TYPE, MKV_TRACK_TYPE_SUBTITLE);
+        putuint(&b, MKV_FLAG_DEFAULT, tracks[t].isdefault ? 1 : 0);
+        putuint(&b, MKV_FLAG_FORCED, tracks[t].forced ? 1 : 0);
+        putuint(&b, MKV_FLAG_LACING, 0);
+        if (tracks[t].name)
+        {
+            putstring(&b, MKV_NAME, tracks[t].name);
+        }
+        putstring(&b, MKV_LANGUAGE, tracks[t].language ? tracks[t].language : "und");
+        putstring(&b, MKV_CODEC_ID, "S_HDMV/PGS");
+        endmaster(&b, entry);
+    }
+    endmaster(&b, element);
+
+    // a new cluster starts when the time of a block doesn't fit in the 16 bits relative to the cluster
+    cluster = 0;
+    clustersize = 0;
+    clusterdata = 0;
+    clustertime = 0;
+    for (i = 0; i < blockcount; i++)
+    {
+        if (i == 0 || blocks[i].time - clustertime > MAX_CLUSTER_SPAN ||
+            (blocks[i].key && blocks[i].time - clustertime >= CLUSTER_LENGTH))
+        {
+            if (i > 0)
+            {
+                endmaster(&b, clustersize);
+            }
+            cluster = b.size;
+            clustertime = blocks[i].time;
+            clustersize = startmaster(&b, MKV_CLUSTER);
+            clusterdata = b.size;
+            putuint(&b, MKV_TIMESTAMP, (uint64_t) clustertime);
+        }
+        blocks[i].cluster = cluster - segmentdata;
+        blocks[i].position = b.size - clusterdata;
+        putblock(&b, &tracks[blocks[i].track - 1], &blocks[i], clustertime);
+    }
+    if (blockcount > 0)
+    {
+        endmaster(&b, clustersize);
+    }
+
+    // display sets of several tracks at the same time share a cue point
+    if (keys > 0)
+    {
+        setnumber(&b, cuesseek, b.size - segmentdata, 8);
+        element = startmaster(&b, MKV_CUES);
+        cuepoint = 0;
+        cuetime = 0;
+        for (i = 0; i < blockcount; i++)
+        {
+            if (!blocks[i].key)
+            {
+                continue;
+            }
+            if (cuepoint == 0 || blocks[i].time != cuetime)
+            {
+                if (cuepoint != 0)
+                {
+                    endmaster(&b, cuepoint);
+                }
+                cuetime = blocks[i].time;
+                cuepoint = startmaster(&b, MKV_CUE_POINT);
+                putuint(&b, MKV_CUE_TIME, (uint64_t) blocks[i].time);
+            }
+            entry = startmaster(&b, MKV_CUE_TRACK_POSITIONS);
+            putuint(&b, MKV_CUE_TRACK, blocks[i].track);
+            putuint(&b, MKV_CUE_CLUSTER_POSITION, blocks[i].cluster);
+            putuint(&b, MKV_CUE_RELATIVE_POSITION, blocks[i].position);
+            endmaster(&b, entry);
+        }
+        endmaster(&b, cuepoint);
+        endmaster(&b, element);
+    }
+
+    endmaster(&b, segment);
+    free(blocks);
+
+    if (b.failed)
+    {
+        free(b.data);
+        return(0);
+    }
+    *data = b.data;
+    *size = b.size;
+    return(1);
+}
@@ -0,0 +1,251 @@
+#include "rle.h"
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// longest run a single code can store (14-bit)
+#define PGS_RLE_MAX_RUN 0x3fff
+
+size_t pgs_rle_bound(unsigned width, unsigned height)
+{
+    // runs of 1 or 2 pixels of a color besides 0 take 1 byte per pixel, a run of 3 pixels takes 3 bytes (00 83 cc),
+    // a single pixel of color 0 takes 2 bytes (00 01) and runs of 64 pixels and more take at most 4 bytes
+    // so no pixel takes more than 3 bytes, plus the end of line code
+    return ((size_t) width * 3 + 2) * height;
+}
+
+// emits the code for count pixels of the given color
+// codes:
+//   CC                  1 pixel of color CC (CC != 0)
+//   00 0L               L pixels of color 0 (L < 64)
+//   00 4L LL            L pixels of color 0 (L < 16384)
+//   00 8L CC            L pixels of color CC (L < 64)
+//   00 CL LL CC         L pixels of color CC (L < 16384)
+static inline unsigned char *emitrun(unsigned char *out, unsigned color, unsigned count)
+{
+    unsigned length;
+
+    while (count > 0)
+    {
+        length = count > PGS_RLE_MAX_RUN ? PGS_RLE_MAX_RUN : count;
+        count -= length;
+
+        if (length >= 0x40)
+        {
+            *out++ = 0x00;
+            if (color != 0)
+            {
+                *out++ = (unsigned char) (0xc0 | (length >> 8));
+                *out++ = (unsigned char) (length & 0xff);
+                *out++ = (unsigned char) color;
+            }
+            else
+            {
+                *out++ = (unsigned char) (0x40 | (length >> 8));
+                *out++ = (unsigned char) (length & 0xff);
+            }
+        }
+        else if (color != 0)
+        {
+            // every color besides 0 has a single byte code per pixel, cheaper than the 3 byte run up to 2 pixels
+            if (length <= 2)
+            {
+                *out++ = (unsigned char) color;
+                if (length == 2)
+                {
+                    *out++ = (unsigned char) color;
+                }
+            }
+            else
+            {
+                *out++ = 0x00;
+                *out++ = (unsigned char) (0x80 | length);
+                *out++ = (unsigned char) color;
+            }
+        }
+        else
+        {
+            *out++ = 0x00;
+            *out++ = (unsigned char) length;
+        }
+    }
+
+    return out;
+}
+
+static inline unsigned char *emitendofline(unsigned char *out)
+{
+    *out++ = 0x00;
+    *out++ = 0x00;
+    return out;
+}
+
+// length of the run of color starting at line[x]
+static inline unsigned runlengthscalar(const unsigned char *line, unsigned x, unsigned width, unsigned char color)
+{
+    unsigned end = x + 1;
+    while (end < width && line[end] == color)
+    {
+        end++;
+    }
+    return end - x;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+static inline unsigned runlengthvector(const unsigned char *line, unsigned x, unsigned width, unsigned char color)
+{
+    unsigned end = x + 1;
+
+#if defined(__AVX2__)
+    const __m256i color32 = _mm256_set1_epi8((char) color);
+    while (end + 32 <= width)
+    {
+        // bit set for every byte that matches the color
+        const unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i*) (line + end)), color32));
+        if (mask != 0xffffffffu)
+        {
+            return end + (unsigned) __builtin_ctz(~mask) - x;
+        }
+        end += 32;
+    }
+#endif
+
+    const __m128i color16 = _mm_set1_epi8((char) color);
+    while (end + 16 <= width)
+    {
+        const unsigned mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i*) (line + end)), color16));
+        if (mask != 0xffffu)
+        {
+            return end + (unsigned) __builtin_ctz(~mask) - x;
+        }
+        end += 16;
+    }
+
+    // remaining tail of the line
+    while (end < width && line[end] == color)
+    {
+        end++;
+    }
+    return end - x;
+}
+
+#else
+
+#define runlengthvector runlengthscalar
+
+#endif
+
+size_t pgs_rle_encode(const unsigned char *indices, unsigned width, unsigned height, size_t stride, unsigned char *out)
+{
+    unsigned char *begin = out;
+    const unsigned char *line;
+    unsigned x, y, length;
+
+    for (y = 0; y < height; y++)
+    {
+        line = indices + stride * y;
+        for (x = 0; x < width; x += length)
+        {
+            length = runlengthvector(line, x, width, line[x]);
+            out = emitrun(out, line[x], length);
+        }
+        out = emitendofline(out);
+    }
+
+    return (size_t) (out - begin);
+}
+
+size_t pgs_rle_encode_scalar(const unsigned char *indices, unsigned width, unsigned height, size_t stride, unsigned char *out)
+{
+    unsigned char *begin = out;
+    const unsigned char *line;
+    unsigned x, y, length;
+
+    for (y = 0; y < height; y++)
+    {
+        line = indices + stride * y;
+        for (x = 0; x < width; x += length)
+        {
+            length = runlengthscalar(line, x, width, line[x]);
+            out = emitrun(out, line[x], length);
+        }
+        out = emitendofline(out);
+    }
+
+    return (size_t) (out - begin);
+}
+
+int pgs_rle_decode(const unsigned char *data, size_t size, unsigned width, unsigned height, unsigned char *indices)
+{
+    size_t p;
+    unsigned x, y, length;
+    unsigned char color, flags;
+
+    p = 0;
+    x = 0;
+    y = 0;
+    while (y < height)
+    {
+        if (p >= size)
+        {
+            return 0;
+        }
+        color = data[p++];
+        length = 1;
+
+        if (color == 0)
+        {
+            if (p >= size)
+            {
+                return 0;
+            }
+            flags = data[p++];
+            if (flags == 0)
+            {
+                // end of line
+                if (x != width)
+                {
+                    return 0;
+                }
+                x = 0;
+                y++;
+                continue;
+            }
+
+            length = flags & 0x3f;
+            if (flags & 0x40)
+            {
+                if (p >= size)
+                {
+                    return 0;
+                }
+                length = (length << 8) | data[p++];
+            }
+            if (flags & 0x80)
+            {
+                if (p >= size)
+                {
+                    return 0;
+                }
+                color = data[p++];
+            }
+        }
+
+        if (length == 0 || length > width - x)
+        {
+            return 0;
+        }
+        memset(indices + (size_t) y * width + x, color, length);
+        x += length;
+    }
+
+    return p == size;
+}
@@ -0,0 +1,117 @@
+#include "timing.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const struct
+{
+    const char *name;
+    int code;
+    double frameticks;
+} framerates[6] = {
+    {"23.976", 0x10, PGS_TICKS_PER_SECOND * 1001.0 / 24000.0},
+    {"24", 0x20, PGS_TICKS_PER_SECOND / 24.0},
+    {"25", 0x30, PGS_TICKS_PER_SECOND / 25.0},
+    {"29.97", 0x40, PGS_TICKS_PER_SECOND * 1001.0 / 30000.0},
+    {"50", 0x60, PGS_TICKS_PER_SECOND / 50.0},
+    {"59.94", 0x70, PGS_TICKS_PER_SECOND * 1001.0 / 60000.0},
+};
+
+int pgs_framerate_parse(const char *name, int *code, double *frameticks)
+{
+    int i;
+
+    for (i = 0; i < 6; i++)
+    {
+        if (strcmp(name, framerates[i].name) == 0)
+        {
+            *code = framerates[i].code;
+            *frameticks = framerates[i].frameticks;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+double pgs_framerate_ticks(int code)
+{
+    int i;
+
+    for (i = 0; i < 6; i++)
+    {
+        if (framerates[i].code == code)
+        {
+            return framerates[i].frameticks;
+        }
+    }
+    return 0.0;
+}
+
+void pgs_timemap_init(pgs_timemap *map)
+{
+    memset(map, 0, sizeof(pgs_timemap));
+    map->scale = 1.0;
+}
+
+void pgs_timemap_free(pgs_timemap *map)
+{
+    free(map->edits);
+    pgs_timemap_init(map);
+}
+
+int pgs_timemap_add(pgs_timemap *map, int64_t time, int64_t offset)
+{
+    pgs_edit *edits;
+    int capacity;
+
+    if (map->count > 0 && time <= map->edits[map->count - 1].time)
+    {
+        return 0;
+    }
+    if (map->count == map->capacity)
+    {
+        capacity = map->capacity ? map->capacity * 2 : 16;
+        edits = (pgs_edit*) realloc(map->edits, capacity * sizeof(pgs_edit));
+        if (edits == NULL)
+        {
+            return 0;
+        }
+        map->edits = edits;
+        map->capacity = capacity;
+    }
+    map->edits[map->count].time = time;
+    map->edits[map->count].offset = offset;
+    map->count++;
+    return 1;
+}
+
+int64_t pgs_timemap_apply(const pgs_timemap *map, int64_t time)
+{
+    double scaled;
+    int64_t result;
+    int low, high, middle;
+
+    scaled = (double) time * map->scale;
+    result = (int64_t) (scaled >= 0.0 ? scaled + 0.5 : scaled - 0.5) + map->offset;
+
+    // last edit at or before the time
+    low = 0;
+    high = map->count;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        if (map->edits[middle].time <= time)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low > 0)
+    {
+        result += map->edits[low - 1].offset;
+    }
+    return result;
+}
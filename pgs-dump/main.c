@@ -0,0 +1,889 @@
+/*
+ * pgsdump
+ *
+ * Decodes a PGS subtitle stream (.sup) with the pgs-codec decoder.
+ * Prints the timeline of all display sets, writes the objects on screen as
+ * PNG files and verifies the stream against the images of a pgssup manifest.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <png.h>
+
+#include "manifest.h"
+
+#include <pgs/color.h>
+#include <pgs/decoder.h>
+#include <pgs/index.h>
+
+// time after the start of a subtitle it is checked at (ms), pgssup delays display sets by a few frames at most
+#define CHECK_DELAY 100
+
+typedef struct
+{
+    pgs_color_table colors;
+
+    // write PNG files with the palette of the display set instead of RGBA
+    int indexed;
+
+    // directory of the PNG files and timeline.txt, NULL prints the timeline only
+    const char *outdir;
+
+    // bytes of the sup file to decode, -t starts at the entry point before the time
+    size_t start;
+    size_t end;
+} dumpoptions;
+
+// a subtitle of the manifest to verify
+typedef struct
+{
+    int number;
+    long start;
+    long end;
+
+    // the subtitle is fully visible at this time (ms), after its fade in
+    long check;
+
+    // the fades take the whole subtitle, it is never fully visible
+    int fading;
+
+    int x;
+    int y;
+    char *image;
+} verifyentry;
+
+typedef struct
+{
+    verifyentry *entries;
+    int count;
+    int next;
+    int differ;
+} verifylist;
+
+long parsetime(const char *time)
+{
+    int h, m, s, ms;
+    h = 0;
+    m = 0;
+    s = 0;
+    ms = 0;
+    sscanf(time, "%2d:%2d:%2d.%3d", &h, &m, &s, &ms);
+    return h * 3600000L + m * 60000L + s * 1000L + ms;
+}
+
+void formattime(long ms, char *text, size_t size)
+{
+    snprintf(text, size, "%ld:%02ld:%02ld.%03ld", ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000);
+}
+
+int readfile(const char *path, unsigned char **data, size_t *size)
+{
+    FILE *fp;
+    long length;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return(0);
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        return(0);
+    }
+
+    *size = (size_t) length;
+    *data = (unsigned char*) malloc(*size ? *size : 1);
+    if (*data == NULL || fread(*data, 1, *size, fp) != *size)
+    {
+        free(*data);
+        fclose(fp);
+        return(0);
+    }
+    fclose(fp);
+    return(1);
+}
+
+// reads a PNG file as 8-bit RGBA with the transformations of pgssup
+unsigned char *loadpng(const char *path, unsigned *width, unsigned *height)
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_uint_32 png_w, png_h;
+    int colortype, bit_depth;
+    unsigned char * volatile rgba;
+    png_bytep * volatile rows;
+    FILE *fp;
+    unsigned j;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return(NULL);
+    }
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info_ptr = png_ptr ? png_create_info_struct(png_ptr) : NULL;
+    rgba = NULL;
+    rows = NULL;
+    if (info_ptr == NULL || setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        free(rgba);
+        free(rows);
+        fclose(fp);
+        return(NULL);
+    }
+
+    png_init_io(png_ptr, fp);
+    png_read_info(png_ptr, info_ptr);
+    png_get_IHDR(png_ptr, info_ptr, &png_w, &png_h, &bit_depth, &colortype, NULL, NULL, NULL);
+
+    // palette, tRNS and gray below 8 bits are expanded, 16 bits are reduced, alpha is added when missing
+    png_set_expand(png_ptr);
+    png_set_strip_16(png_ptr);
+    if (colortype == PNG_COLOR_TYPE_GRAY || colortype == PNG_COLOR_TYPE_GRAY_ALPHA)
+    {
+        png_set_gray_to_rgb(png_ptr);
+    }
+    if (!(colortype & PNG_COLOR_MASK_ALPHA))
+    {
+        png_set_add_alpha(png_ptr, 255, PNG_FILLER_AFTER);
+    }
+    png_read_update_info(png_ptr, info_ptr);
+
+    rgba = (unsigned char*) malloc((size_t) png_w * png_h * 4);
+    rows = (png_bytep*) malloc(png_h * sizeof(png_bytep));
+    if (rgba == NULL || rows == NULL)
+    {
+        png_error(png_ptr, "out of memory");
+    }
+    for (j = 0; j < png_h; j++)
+    {
+        rows[j] = rgba + (size_t) png_w * 4 * j;
+    }
+    png_read_image(png_ptr, rows);
+    png_read_end(png_ptr, NULL);
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    free(rows);
+    fclose(fp);
+
+    *width = png_w;
+    *height = png_h;
+    return(rgba);
+}
+
+// writes palette indices as an indexed PNG file or, without palette, RGBA pixels
+int writepng(const char *path, unsigned width, unsigned height, const unsigned char *pixels, const unsigned char palette[256][4])
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_color plte[256];
+    png_byte trns[256];
+    FILE *fp;
+    unsigned j;
+
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return(0);
+    }
+    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info_ptr = png_ptr ? png_create_info_struct(png_ptr) : NULL;
+    if (info_ptr == NULL || setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        fclose(fp);
+        return(0);
+    }
+
+    png_init_io(png_ptr, fp);
+    png_set_compression_level(png_ptr, 1);
+    if (palette)
+    {
+        png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_PALETTE,
+                     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        for (j = 0; j < 256; j++)
+        {
+            plte[j].red = palette[j][0];
+            plte[j].green = palette[j][1];
+            plte[j].blue = palette[j][2];
+            trns[j] = palette[j][3];
+        }
+        png_set_PLTE(png_ptr, info_ptr, plte, 256);
+        png_set_tRNS(png_ptr, info_ptr, trns, 256, NULL);
+    }
+    else
+    {
+        png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGBA,
+                     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    }
+    png_write_info(png_ptr, info_ptr);
+    for (j = 0; j < height; j++)
+    {
+        png_write_row(png_ptr, (png_const_bytep) (pixels + (size_t) width * (palette ? 1 : 4) * j));
+    }
+    png_write_end(png_ptr, NULL);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+    return fclose(fp) == 0;
+}
+
+const char *statename(int state)
+{
+    switch (state)
+    {
+        case PGS_STATE_EPOCH_START:
+            return "epoch start";
+        case PGS_STATE_ACQUISITION_POINT:
+            return "acquisition point";
+        default:
+            return "normal";
+    }
+}
+
+// prints a line of the timeline for the display set which just ended
+void writetimeline(FILE *fp, const pgs_decoder *decoder, int number, size_t offset, size_t size)
+{
+    const pgs_composition *composition;
+    const pgs_composition_object *object;
+    const pgs_object *data;
+    char time[32];
+    int i;
+
+    composition = &decoder->composition;
+    formattime(decoder->pts / 90, time, sizeof(time));
+    fprintf(fp, "%6d  %s  pts %10u  dts %10u  %-17s  composition %5u  ",
+            number, time, decoder->pts, decoder->dts, statename(composition->state), composition->number);
+
+    if (composition->count == 0)
+    {
+        fprintf(fp, "cleared");
+    }
+    else
+    {
+        fprintf(fp, "palette %u v%u%s  windows %d  objects",
+                composition->palette_id, decoder->palettes[composition->palette_id].version,
+                composition->palette_update ? " update" : "", decoder->windowcount);
+        for (i = 0; i < composition->count; i++)
+        {
+            object = &composition->objects[i];
+            data = &decoder->objects[object->object_id];
+            fprintf(fp, " %u:%ux%u@%u,%u%s", object->object_id, data->width, data->height, object->x, object->y,
+                    object->forced ? " forced" : "");
+        }
+    }
+    fprintf(fp, "  (%lu bytes at %lu)\n", (unsigned long) size, (unsigned long) offset);
+}
+
+// writes all objects on screen, palette updates write the objects again with their new colors
+int writeobjects(const dumpoptions *options, const pgs_decoder *decoder, int number)
+{
+    const pgs_composition *composition;
+    const pgs_object *data;
+    const unsigned char (*entries)[4];
+    unsigned char palette[256][4];
+    unsigned char *indices;
+    unsigned char *rgba;
+    char path[1024];
+    size_t p, pixels;
+    int i, j, result;
+
+    composition = &decoder->composition;
+    entries = (const unsigned char (*)[4]) decoder->palettes[composition->palette_id].entries;
+    for (j = 0; j < 256; j++)
+    {
+        pgs_color_convert_rgb(&options->colors, entries[j][0], entries[j][2], entries[j][1],
+                              &palette[j][0], &palette[j][1], &palette[j][2]);
+        palette[j][3] = entries[j][3];
+    }
+
+    for (i = 0; i < composition->count; i++)
+    {
+        data = &decoder->objects[composition->objects[i].object_id];
+        pixels = (size_t) data->width * data->height;
+        indices = (unsigned char*) malloc(pixels ? pixels : 1);
+        rgba = options->indexed ? NULL : (unsigned char*) malloc(pixels * 4 + 1);
+        if (indices == NULL || (!options->indexed && rgba == NULL))
+        {
+            printf("Error: out of memory\n");
+            free(indices);
+            free(rgba);
+            return(0);
+        }
+        if (!pgs_decoder_object(decoder, composition->objects[i].object_id, indices))
+        {
+            printf("Error: the data of object %u in display set %d is not valid\n", composition->objects[i].object_id, number);
+            free(indices);
+            free(rgba);
+            return(0);
+        }
+
+        snprintf(path, sizeof(path), "%s/%06d-%d.png", options->outdir, number, i);
+        if (options->indexed)
+        {
+            result = writepng(path, data->width, data->height, indices, (const unsigned char (*)[4]) palette);
+        }
+        else
+        {
+            for (p = 0; p < pixels; p++)
+            {
+                memcpy(rgba + p * 4, palette[indices[p]], 4);
+            }
+            result = writepng(path, data->width, data->height, rgba, NULL);
+        }
+        free(indices);
+        free(rgba);
+
+        if (!result)
+        {
+            printf("Error: the PNG file \"%s\" could not be written\n", path);
+            return(0);
+        }
+    }
+
+    return(1);
+}
+
+int compareentries(const void *a, const void *b)
+{
+    const verifyentry *x;
+    const verifyentry *y;
+    x = (const verifyentry*) a;
+    y = (const verifyentry*) b;
+    if (x->check != y->check)
+    {
+        return x->check < y->check ? -1 : 1;
+    }
+    return x->number - y->number;
+}
+
+void freeentries(verifylist *list)
+{
+    int i;
+    for (i = 0; i < list->count; i++)
+    {
+        free(list->entries[i].image);
+    }
+    free(list->entries);
+    memset(list, 0, sizeof(verifylist));
+}
+
+// reads all subtitles of the manifest, ordered by the time they are checked
+// colormatrix is set to the colormatrix attribute of the manifest
+int readentries(const char *path, verifylist *list, char *colormatrix, size_t colormatrixsize)
+{
+    manifest xml;
+    manifestentry entry;
+    verifyentry *entries;
+    verifyentry *e;
+    int capacity, status;
+    int doffsetx, doffsety;
+    long fadein, fadeout, duration;
+
+    memset(list, 0, sizeof(verifylist));
+    if (!manifestopen(&xml, path))
+    {
+        printf("%s\n", xml.error);
+        manifestclose(&xml);
+        return(0);
+    }
+    snprintf(colormatrix, colormatrixsize, "%s", xml.colormatrix);
+    doffsetx = 0;
+    doffsety = 0;
+    sscanf(xml.defaultoffset, "%d,%d", &doffsetx, &doffsety);
+
+    capacity = 0;
+    while ((status = manifestnext(&xml, &entry)) == 1)
+    {
+        if (list->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            entries = (verifyentry*) realloc(list->entries, capacity * sizeof(verifyentry));
+            if (entries == NULL)
+            {
+                status = -1;
+                snprintf(xml.error, sizeof(xml.error), "Error: out of memory");
+                break;
+            }
+            list->entries = entries;
+        }
+
+        e = &list->entries[list->count];
+        e->number = list->count + 1;
+        e->start = parsetime(entry.starttime);
+        e->end = parsetime(entry.endtime);
+        e->x = doffsetx;
+        e->y = doffsety;
+        if (entry.offset[0] != 0)
+        {
+            sscanf(entry.offset, "%d,%d", &e->x, &e->y);
+        }
+
+        // fades are shortened like pgssup does when they are longer than the subtitle
+        fadein = 0;
+        fadeout = 0;
+        sscanf(entry.fadein, "%ld", &fadein);
+        sscanf(entry.fadeout, "%ld", &fadeout);
+        fadein = fadein < 0 ? 0 : fadein;
+        fadeout = fadeout < 0 ? 0 : fadeout;
+        duration = e->end > e->start ? e->end - e->start : 0;
+        e->fading = fadein + fadeout >= duration && fadein + fadeout > 0;
+        if (fadein + fadeout > duration && fadein + fadeout > 0)
+        {
+            fadein = duration * fadein / (fadein + fadeout);
+            fadeout = duration - fadein;
+        }
+
+        // checked a little after the fade in, at most in the middle of the fully visible part
+        e->check = (e->start + fadein + e->end - fadeout) / 2;
+        if (e->check > e->start + fadein + CHECK_DELAY)
+        {
+            e->check = e->start + fadein + CHECK_DELAY;
+        }
+        if (e->fading && e->check >= e->end && e->end > e->start)
+        {
+            e->check = e->end - 1;
+        }
+
+        e->image = strdup(entry.image);
+        if (e->image == NULL)
+        {
+            status = -1;
+            snprintf(xml.error, sizeof(xml.error), "Error: out of memory");
+            break;
+        }
+        list->count++;
+    }
+
+    if (status == -1)
+    {
+        printf("%s\n", xml.error);
+        manifestclose(&xml);
+        freeentries(list);
+        return(0);
+    }
+    manifestclose(&xml);
+
+    qsort(list->entries, list->count, sizeof(verifyentry), compareentries);
+    return(1);
+}
+
+// compares a subtitle with the object at its position on screen
+// returns 1 when it matches, 0 when it differs or is not shown, -1 on errors
+int checkentry(const pgs_color_table *colors, const pgs_decoder *decoder, int shown, const verifyentry *e)
+{
+    const pgs_composition *composition;
+    const pgs_composition_object *object;
+    const pgs_object *data;
+    const unsigned char *entry;
+    const unsigned char *pixel;
+    unsigned char *rgba;
+    unsigned char *indices;
+    unsigned char expected[4];
+    unsigned width, height;
+    unsigned long differ, first;
+    char time[32];
+    size_t p, pixels;
+    int i;
+
+    formattime(e->check, time, sizeof(time));
+    rgba = loadpng(e->image, &width, &height);
+    if (rgba == NULL)
+    {
+        printf("Error: file \"%s\" could not be read\n", e->image);
+        return(-1);
+    }
+
+    // the object of the subtitle has the size of its image and is placed at its offset
+    composition = &decoder->composition;
+    object = NULL;
+    data = NULL;
+    for (i = 0; shown && i < composition->count; i++)
+    {
+        data = &decoder->objects[composition->objects[i].object_id];
+        if ((int) composition->objects[i].x == e->x && (int) composition->objects[i].y == e->y &&
+            data->width == width && data->height == height)
+        {
+            object = &composition->objects[i];
+            break;
+        }
+    }
+    if (object == NULL)
+    {
+        printf("Error: subtitle %d (%s) is not shown at %s\n", e->number, e->image, time);
+        free(rgba);
+        return(0);
+    }
+
+    pixels = (size_t) width * height;
+    indices = (unsigned char*) malloc(pixels ? pixels : 1);
+    if (indices == NULL || !pgs_decoder_object(decoder, object->object_id, indices))
+    {
+        printf("Error: the object of subtitle %d (%s) could not be decoded\n", e->number, e->image);
+        free(indices);
+        free(rgba);
+        return(indices == NULL ? -1 : 0);
+    }
+
+    // colors are compared as YCrCbA, fully transparent pixels only by their alpha,
+    // a subtitle which is never fully visible may have any lower alpha
+    differ = 0;
+    first = 0;
+    for (p = 0; p < pixels; p++)
+    {
+        pixel = rgba + p * 4;
+        entry = decoder->palettes[composition->palette_id].entries[indices[p]];
+        if (pixel[3] == 0)
+        {
+            if (entry[3] != 0)
+            {
+                first = differ++ ? first : (unsigned long) p;
+            }
+            continue;
+        }
+        pgs_color_convert(colors, pixel[0], pixel[1], pixel[2], &expected[0], &expected[2], &expected[1]);
+        expected[3] = e->fading && entry[3] <= pixel[3] ? entry[3] : pixel[3];
+        if (memcmp(entry, expected, 4) != 0)
+        {
+            first = differ++ ? first : (unsigned long) p;
+        }
+    }
+    free(indices);
+    free(rgba);
+
+    if (differ)
+    {
+        printf("Error: subtitle %d (%s) differs at %s, %lu of %lu pixels, the first at %lu,%lu\n",
+               e->number, e->image, time, differ, (unsigned long) pixels, first % width, first / width);
+        return(0);
+    }
+    return(1);
+}
+
+// verifies all subtitles checked before pts with the current state of the decoder
+int verifyuntil(verifylist *list, const pgs_color_table *colors, const pgs_decoder *decoder, int shown, long long pts)
+{
+    int result;
+
+    while (list->next < list->count && (long long) list->entries[list->next].check * 90 < pts)
+    {
+        result = checkentry(colors, decoder, shown, &list->entries[list->next]);
+        if (result == -1)
+        {
+            return(0);
+        }
+        list->differ += !result;
+        list->next++;
+    }
+    return(1);
+}
+
+int dump(const unsigned char *data, const dumpoptions *options, FILE *timeline, verifylist *list)
+{
+    pgs_decoder decoder;
+    pgs_segment segment;
+    size_t pos, length, start;
+    int number, shown, status;
+
+    pgs_decoder_init(&decoder);
+    number = 0;
+    shown = 0;
+    start = options->start;
+    for (pos = options->start; pos < options->end; pos += length)
+    {
+        length = pgs_segment_parse(data + pos, options->end - pos, &segment);
+        if (length == 0)
+        {
+            printf("Error: no valid segment at byte %lu\n", (unsigned long) pos);
+            pgs_decoder_free(&decoder);
+            return(0);
+        }
+
+        // the state of the previous display set is on screen until the next one
+        if (segment.type == PGS_SEGMENT_PCS)
+        {
+            if (list && !verifyuntil(list, &options->colors, &decoder, shown, segment.pts))
+            {
+                pgs_decoder_free(&decoder);
+                return(0);
+            }
+            start = pos;
+        }
+
+        status = pgs_decoder_push(&decoder, &segment);
+        if (status == -1)
+        {
+            printf("Error: %s (segment at byte %lu)\n", decoder.error, (unsigned long) pos);
+            pgs_decoder_free(&decoder);
+            return(0);
+        }
+        if (status == 1)
+        {
+            shown = 1;
+            if (timeline)
+            {
+                writetimeline(timeline, &decoder, number, start, pos + length - start);
+            }
+            if (options->outdir && decoder.composition.count > 0 && !writeobjects(options, &decoder, number))
+            {
+                pgs_decoder_free(&decoder);
+                return(0);
+            }
+            number++;
+        }
+    }
+
+    if (decoder.open)
+    {
+        printf("Error: the last display set has no end segment\n");
+        pgs_decoder_free(&decoder);
+        return(0);
+    }
+
+    // subtitles after the last display set are checked against the final state
+    status = list ? verifyuntil(list, &options->colors, &decoder, shown, 0x7fffffffffffffffLL) : 1;
+    pgs_decoder_free(&decoder);
+
+    if (status)
+    {
+        printf("%d display sets\n", number);
+    }
+    return(status);
+}
+
+// finds the display sets on screen at the time (ms) with the seek index <supfile>.idx, it is built when there is none
+// sets start and end of the options to the entry point before the time and the end of the last display set up to it
+// returns 0 when the time is before the first subtitle or the index is not valid
+int seek(const char *path, const unsigned char *data, size_t size, long time, dumpoptions *options)
+{
+    pgs_index index;
+    pgs_segment segment;
+    const pgs_index_entry *entry;
+    unsigned char *indexdata;
+    size_t indexsize, pos, length;
+    char indexpath[1024];
+    char text[32];
+    int status;
+
+    pgs_index_init(&index);
+    snprintf(indexpath, sizeof(indexpath), "%s.idx", path);
+    if (readfile(indexpath, &indexdata, &indexsize))
+    {
+        status = pgs_index_parse(&index, indexdata, indexsize) && index.supsize == size;
+        free(indexdata);
+        if (!status)
+        {
+            printf("Error: the index \"%s\" doesn't belong to the sup file\n", indexpath);
+            pgs_index_free(&index);
+            return(0);
+        }
+    }
+    else if (!pgs_index_build(&index, data, size))
+    {
+        printf("Error: the sup file can't be indexed\n");
+        pgs_index_free(&index);
+        return(0);
+    }
+
+    entry = pgs_index_find(&index, (uint32_t) (time * 90));
+    if (entry == NULL || entry->offset >= size)
+    {
+        formattime(time, text, sizeof(text));
+        printf("Error: no subtitle starts at or before %s\n", text);
+        pgs_index_free(&index);
+        return(0);
+    }
+    options->start = (size_t) entry->offset;
+    pgs_index_free(&index);
+
+    // the display sets up to the next one after the time
+    for (pos = options->start; pos < size; pos += length)
+    {
+        length = pgs_segment_parse(data + pos, size - pos, &segment);
+        if (length == 0 || (pos > options->start && segment.type == PGS_SEGMENT_PCS && segment.pts > (uint32_t) (time * 90)))
+        {
+            break;
+        }
+    }
+    options->end = pos;
+    return(1);
+}
+
+void help()
+{
+    printf("Syntax: pgsdump [options] <supfile> [outputdir]\n");
+    printf("\n");
+    printf("Prints the timeline of all display sets. With an output directory the timeline is written\n");
+    printf("to timeline.txt and the objects on screen after every display set to <displayset>-<object>.png.\n");
+    printf("\n");
+    printf("Options\n");
+    printf(" -m <matrix>          Color matrix of the palette: bt601, bt709, bt601-limited, bt709-limited (default: bt601)\n");
+    printf(" -i                   Write PNG files with the palette of the display set instead of RGBA\n");
+    printf(" -t <time>            Only decode the display sets needed for the screen at H:MM:SS.mmm, starting at the\n");
+    printf("                      epoch start or acquisition point before it found with the seek index <supfile>.idx\n");
+    printf(" --verify <xmlfile>   Compare every subtitle of the pgssup manifest with the object on screen once it is\n");
+    printf("                      fully visible, the colors must match exactly. The color matrix of the manifest is used\n");
+    printf("                      unless -m is given.\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *positional[2];
+    const char *colormatrix;
+    const char *verifypath;
+    const char *seektime;
+    char manifestmatrix[32];
+    char path[1024];
+    dumpoptions options;
+    pgs_color_matrix matrix;
+    pgs_color_range range;
+    verifylist list;
+    unsigned char *data;
+    size_t size;
+    FILE *timeline;
+    int positionals;
+    int status;
+    int i;
+
+    memset(&options, 0, sizeof(dumpoptions));
+    colormatrix = NULL;
+    verifypath = NULL;
+    seektime = NULL;
+    positionals = 0;
+    manifestmatrix[0] = 0;
+
+    // parse command line arguments
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-h") == 0)
+        {
+            help();
+            return(0);
+        }
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+        {
+            colormatrix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--verify") == 0 && i + 1 < argc)
+        {
+            verifypath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-i") == 0)
+        {
+            options.indexed = 1;
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            seektime = argv[++i];
+        }
+        else if (argv[i][0] == 0x2d)
+        {
+            printf("Error: unknown option: %s\n", argv[i]);
+            return(1);
+        }
+        else if (positionals < 2)
+        {
+            positional[positionals++] = argv[i];
+        }
+        else
+        {
+            printf("Error: syntax error\n");
+            return(1);
+        }
+    }
+    if (positionals == 0)
+    {
+        help();
+        return(0);
+    }
+    options.outdir = positionals == 2 ? positional[1] : NULL;
+    if (seektime && verifypath)
+    {
+        printf("Error: --verify checks the whole sup file, it can't be used with -t\n");
+        return(1);
+    }
+
+    if (verifypath && !readentries(verifypath, &list, manifestmatrix, sizeof(manifestmatrix)))
+    {
+        return(1);
+    }
+
+    // the command line takes precedence over the manifest
+    if (colormatrix == NULL)
+    {
+        colormatrix = manifestmatrix[0] ? manifestmatrix : "bt601";
+    }
+    if (!pgs_color_parse(colormatrix, &matrix, &range))
+    {
+        printf("Error: unknown color matrix: %s\n", colormatrix);
+        if (verifypath)
+        {
+            freeentries(&list);
+        }
+        return(1);
+    }
+    pgs_color_table_init(&options.colors, matrix, range);
+
+    if (!readfile(positional[0], &data, &size))
+    {
+        printf("Error: the sup file \"%s\" could not be read\n", positional[0]);
+        if (verifypath)
+        {
+            freeentries(&list);
+        }
+        return(1);
+    }
+
+    // the whole stream, or only the display sets on screen at the time
+    options.start = 0;
+    options.end = size;
+    if (seektime && !seek(positional[0], data, size, parsetime(seektime), &options))
+    {
+        free(data);
+        return(1);
+    }
+
+    // only verifying doesn't print the timeline
+    timeline = verifypath ? NULL : stdout;
+    if (options.outdir)
+    {
+        snprintf(path, sizeof(path), "%s/timeline.txt", options.outdir);
+        timeline = fopen(path, "w");
+        if (timeline == NULL)
+        {
+            printf("Error: \"%s\" could not be opened\n", path);
+            free(data);
+            if (verifypath)
+            {
+                freeentries(&list);
+            }
+            return(1);
+        }
+    }
+
+    status = dump(data, &options, timeline, verifypath ? &list : NULL);
+
+    if (options.outdir && fclose(timeline) != 0 && status)
+    {
+        printf("Error: \"%s\" could not be written\n", path);
+        status = 0;
+    }
+    free(data);
+
+    if (verifypath)
+    {
+        if (status)
+        {
+            printf("%d subtitles verified, %d differ\n", list.count, list.differ);
+            status = list.differ == 0;
+        }
+        freeentries(&list);
+    }
+
+    return(status ? 0 : 1);
+}
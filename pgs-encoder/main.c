@@ -16,12 +16,25 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 #include <png.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <unistd.h>
+#include <pthread.h>
+
+#include "manifest.h"
+
+#include <pgs/color.h>
+#include <pgs/decoder.h>
+#include <pgs/index.h>
+#include <pgs/matroska.h>
+#include <pgs/rle.h>
+#include <pgs/timing.h>
 
 int matchchar(char f[], char q[], int p)
 {
@@ -132,512 +145,743 @@ void inttobyte(int l, char *c1, char *c2)
     *c2 = l - (*c1) * 256;
 }
 
-void help()
+// number of slots in the color lookup table (power of 2, at least twice the palette size)
+#define COLORTABLE_SIZE 1024
+
+// open addressing hash table mapping packed RGBA colors to palette indices
+typedef struct
 {
-    printf("Syntax: pgssup [options] <xmlfile> <outputfile>\n");
-    printf("\n");
-    printf("Options\n");
-    printf(" -s <WxH>        Size of Video frame (default: 1920x1080)\n");
-    printf("\n");
-    printf("XML structure:\n");
-    printf("\n");
-    printf("FOR EXAMPLE\n");
-    printf("<pgssup defaultoffset=\"0,920\">\n");
-    printf("    <subtitle starttime=\"00:00:54.384\" endtime=\"00:00:56.932\" image=\"/home/hoge/sub00000.png\" />\n");
-    printf("    <subtitle starttime=\"00:00:59.837\" endtime=\"00:01:01.411\" offset=\"1000,50\" image=\"/home/hoge/sub00001.png\" />\n");
-    printf("    <subtitle starttime=\"00:01:10.734\" endtime=\"00:01:12.638\" view=\"forced\" image=\"/home/hoge/sub00002.png\" />\n");
-    printf("</pgssup>\n");
-    printf("\n");
-    printf("defaultoffset: Default offset of subtitles. If the offset of subtitles is null, this value will set to the subtitle. (default=0,0)\n");
-    printf("offset:        the position of subtitle on the display.\n");
-    printf("view:          Subtitles will be forced to display if this property is \"forced\".\n");
-    printf("image:         This image should have less than 256 colors.\n");
-    printf("\n");
+    unsigned int color[COLORTABLE_SIZE];
+    short index[COLORTABLE_SIZE]; // -1: empty slot
+} colortable;
+
+// pack a RGBA pixel into a 32-bit integer
+unsigned int packcolor(const unsigned char *p)
+{
+    return (unsigned int) p[0] | ((unsigned int) p[1] << 8) | ((unsigned int) p[2] << 16) | ((unsigned int) p[3] << 24);
 }
 
-int main(int argc, char *argv[])
+unsigned int colortableslot(unsigned int color)
 {
-    printf("==============================================\n");
-    printf("| PGSSUP version 0.1                         |\n");
-    printf("| Koichi Akabe 2009 <mail@vbkaisetsu.com>    |\n");
-    printf("| Last modified: 2009-01-13 (YYYY-MM-DD)     |\n");
-    printf("| License: GNU Lesser General Public License |\n");
-    printf("==============================================\n");
-    printf("\n");
+    // multiplicative hashing, take the upper bits
+    return (color * 2654435761u) >> 22;
+}
 
-    int i, j, k;
-    int width, height;
-    width = 1920;
-    height = 1080;
-    char xmlpath[512];
-    char outpath[512];
+void colortableclear(colortable *t)
+{
+    int i;
+    for (i = 0; i < COLORTABLE_SIZE; i++)
+    {
+        t->index[i] = -1;
+    }
+}
 
-    // parse command line arguments
-    for (i = 1; i < argc - 2; i++)
+// returns the palette index of the color or -1 if it isn't in the table
+int colortablefind(const colortable *t, unsigned int color)
+{
+    unsigned int slot;
+    slot = colortableslot(color);
+    while (t->index[slot] != -1)
     {
-        if (argv[i][0] == 0x2d)
+        if (t->color[slot] == color)
         {
-            if (strcmp(argv[i], "-s") == 0)
-            {
-                i++;
-                sscanf(argv[i], "%dx%d", &width, &height);
-                if (width == 0 || height == 0)
-                {
-                    printf("Error: video size failed\n");
-                    return(1);
-                }
-            }
-            else if (strcmp(argv[i], "-h") == 0)
-            {
-                help();
-                return(0);
-            }
-            else
-            {
-                printf("Error: unknown option: %s\n", argv[i]);
-                return(1);
-            }
+            return t->index[slot];
         }
+        slot = (slot + 1) & (COLORTABLE_SIZE - 1);
     }
-    if (argc == 1)
+    return(-1);
+}
+
+void colortableinsert(colortable *t, unsigned int color, int index)
+{
+    unsigned int slot;
+    slot = colortableslot(color);
+    while (t->index[slot] != -1)
     {
-        help();
-        return(0);
+        slot = (slot + 1) & (COLORTABLE_SIZE - 1);
     }
-    if (argc == 2)
+    t->color[slot] = color;
+    t->index[slot] = index;
+}
+
+// palette index of a pixel, fully transparent pixels use 0xff
+int pixelindex(const colortable *t, const unsigned char *p)
+{
+    if (p[3] == 0)
     {
-        if (strcmp(argv[1], "-h") == 0)
+        return(0xff);
+    }
+    return colortablefind(t, packcolor(p));
+}
+
+// subtitles overlapping in time are encoded together, each with its own object
+#define MAX_SUBTITLES 2
+
+// all segments of a subtitle except the object data fit into this many bytes
+// (PCS, WDS, PDS with 256 entries, the first ODS header, END and the clearing display set)
+// a display set with several subtitles reserves this for every subtitle
+#define DISPLAYSET_SEGMENTS_SIZE 2048
+
+// bytes added by every further ODS segment of a split object
+#define ODS_FRAGMENT_HEADER_SIZE 17
+
+// size of a palette-only display set (PCS with all objects, PDS with 256 entries, END)
+#define PALETTE_UPDATE_SIZE 1348
+
+// fades are split into palette updates of at least this duration (ms)
+#define FADE_STEP 40
+
+// maximum number of palette updates of a single fade
+#define FADE_MAX_STEPS 64
+
+// size of the display set clearing the screen at the end of a subtitle (PCS, WDS with all windows, END)
+#define CLEAR_SIZE (24 + 13 + 1 + MAX_SUBTITLES * 9 + 13)
+
+// decoder model of the Blu-ray graphics decoder in 90 kHz ticks: objects are decoded at 128 Mbit/s
+// into the object buffer, the graphics plane is initialized and windows are drawn at 256 Mbit/s
+#define DECODE_TICKS(pixels) (((pixels) * 9 + 1599) / 1600)
+#define TRANSFER_TICKS(pixels) (((pixels) * 9 + 3199) / 3200)
+
+// options shared by all display sets
+typedef struct
+{
+    int width;
+    int height;
+    int doffsetx;
+    int doffsety;
+
+    // frame rate code of the PCS and duration of a frame (90 kHz)
+    int framerate;
+    double frameticks;
+
+    // RGB -> YCrCb conversion of the palette
+    pgs_color_table colors;
+} encoderoptions;
+
+// a subtitle of the manifest, the strings are copies of the manifest entry
+typedef struct
+{
+    int number;
+    char *starttime;
+    char *endtime;
+    char *offset;
+    char *view;
+    char *image;
+    char *fadein;
+    char *fadeout;
+
+    // start and end time (ms)
+    long start;
+    long end;
+} subtitle;
+
+// a window of the WDS
+typedef struct
+{
+    int x;
+    int y;
+    int width;
+    int height;
+} displaywindow;
+
+// one or more subtitles and their encoded display sets
+typedef struct
+{
+    // number of the first subtitle
+    int number;
+    subtitle subtitles[MAX_SUBTITLES];
+    int count;
+
+    // the subtitles end at this time (ms) at the latest, -1: no limit
+    long cut;
+
+    // set when encoding has finished (guarded by the queue lock when encoding in parallel)
+    int finished;
+
+    // the display sets were copied from the patched sup file, they aren't encoded
+    int copied;
+
+    // 1: encoded, 0: failed
+    int status;
+    int supt;
+    int bitmapsize;
+
+    // presentation times (90 kHz) and windows of the display sets
+    // the display set clearing the screen starts at cleart and ends at supt
+    long startpts;
+    long endpts;
+    displaywindow windows[MAX_SUBTITLES];
+    int windowcount;
+    int cleart;
+
+    // encoded display sets and object data
+    // the buffers only grow and are reused by the next subtitles encoded into this display set
+    char *supdata;
+    size_t supcapacity;
+    unsigned char *rledata;
+    size_t rlecapacity;
+
+    // messages, printed in manifest order by the writer
+    char *log;
+    size_t logsize;
+    size_t logcapacity;
+} displayset;
+
+void logprintf(displayset *ds, const char *format, ...)
+{
+    va_list args;
+    int length;
+    size_t capacity;
+    char *log;
+
+    va_start(args, format);
+    length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length < 0)
+    {
+        return;
+    }
+
+    if (ds->logsize + length + 1 > ds->logcapacity)
+    {
+        capacity = ds->logcapacity ? ds->logcapacity * 2 : 512;
+        while (capacity < ds->logsize + length + 1)
         {
-            help();
-            return(0);
+            capacity *= 2;
         }
-        else
+        log = (char*) realloc(ds->log, capacity);
+        if (log == NULL)
         {
-            printf("Error: syntax error\n");
-            return(1);
+            return;
         }
+        ds->log = log;
+        ds->logcapacity = capacity;
     }
 
-    sprintf(xmlpath, "%s", argv[argc - 2]);
-    sprintf(outpath, "%s", argv[argc - 1]);
+    va_start(args, format);
+    vsnprintf(ds->log + ds->logsize, length + 1, format, args);
+    va_end(args);
+    ds->logsize += length;
+}
 
-    char path[512];
-    long fsize;
-    FILE *fp;
-    getabsolutepath(xmlpath, path);
-    fp = fopen(path, "r");
-    if (fp == NULL)
+// grows the buffer to at least size bytes, the contents are kept
+// returns 0 when out of memory
+int reservebuffer(void **buffer, size_t *capacity, size_t size)
+{
+    size_t newcapacity;
+    void *newbuffer;
+
+    if (size <= *capacity)
     {
-        printf("Error: xml file \"%s\" opening faild\n", path);
         return(1);
     }
-    fseek(fp, 0, SEEK_END);
-    fsize = ftell(fp);
-    char xml[fsize + 32];
-    fseek(fp, 0, SEEK_SET);
-    for (i = 0; i < fsize; i++)
+
+    newcapacity = *capacity ? *capacity : 65536;
+    while (newcapacity < size)
     {
-        xml[i] = (char) fgetc(fp);
+        newcapacity *= 2;
     }
-    fclose(fp);
+    newbuffer = realloc(*buffer, newcapacity);
+    if (newbuffer == NULL)
+    {
+        return(0);
+    }
+    *buffer = newbuffer;
+    *capacity = newcapacity;
+    return(1);
+}
 
-    char defaultoffsetc[16];
-    char starttimec[16384][16];
-    char endtimec[16384][16];
-    char offsetc[16384][16];
-    char viewc[16384][16];
-    char imagec[16384][256];
-    int tagquo, tagtype;
-    tagquo = 0;
-    tagtype = 0;
-
-    int h1, m1, s1, ms1, h2, m2, s2, ms2;
-    long starttime;
-    long endtime;
-    char pngfile[128];
-    char b1, b2, b3, b4;
-    char *supdata = NULL;
-    int c;
-    c = 0;
-    char *writer;
-    int targetpoint;
-    char dummy[65536];
-    writer = dummy;
-    targetpoint = 0;
-    defaultoffsetc[0] = 0;
-    for (i = 0; i < 16384; i++)
+// hh:mm:ss.mmm to milliseconds, -1 when the time is not valid
+long parsetime(const char *time)
+{
+    int h, m, s, ms;
+    if (sscanf(time, "%2d:%2d:%2d.%3d", &h, &m, &s, &ms) != 4 || h < 0 || m < 0 || s < 0 || ms < 0)
     {
-        starttimec[i][0] = 0;
-        endtimec[i][0] = 0;
-        offsetc[i][0] = 0;
-        viewc[i][0] = 0;
-        imagec[i][0] = 0;
+        return(-1);
     }
+    return h * 3600000L + m * 60000L + s * 1000L + ms;
+}
 
-    char q[32];
-    int knowntag;
-    int jumpquo;
-    jumpquo = 0;
-    knowntag = 0;
+// copies the manifest entry, the entry itself is only valid until the next one is read
+int subtitleinit(subtitle *sub, int number, const manifestentry *entry)
+{
+    sub->number = number;
+    sub->starttime = strdup(entry->starttime);
+    sub->endtime = strdup(entry->endtime);
+    sub->offset = strdup(entry->offset);
+    sub->view = strdup(entry->view);
+    sub->image = strdup(entry->image);
+    sub->fadein = strdup(entry->fadein);
+    sub->fadeout = strdup(entry->fadeout);
+    sub->start = parsetime(entry->starttime);
+    sub->end = parsetime(entry->endtime);
+    return sub->starttime && sub->endtime && sub->offset && sub->view && sub->image && sub->fadein && sub->fadeout;
+}
 
-    printf("Info: parsing xml ...\n");
-    for (i = 0; i < fsize; i++)
+void subtitlefree(subtitle *sub)
+{
+    free(sub->starttime);
+    free(sub->endtime);
+    free(sub->offset);
+    free(sub->view);
+    free(sub->image);
+    free(sub->fadein);
+    free(sub->fadeout);
+    memset(sub, 0, sizeof(subtitle));
+}
+
+// releases the subtitles, but keeps the buffers for the next ones
+void displaysetclear(displayset *ds)
+{
+    int i;
+    for (i = 0; i < MAX_SUBTITLES; i++)
     {
-        if (xml[i] == 0x3c && tagquo == 0)
-        {
-            knowntag = 0;
-            tagquo = 1;
-            sprintf(q, "<pgssup");
-            if (matchchar(xml, q, i) && (xml[i + 7] == 0x20 || xml[i + 7] == 0x3e))
-            {
-                if (tagtype == 0)
-                {
-                    tagtype = 1;
-                    knowntag = 1;
-                }
-                else
-                {
-                    printf("Error: the pgssup tag should be in the root\n");
-                    return(1);
-                }
-            }
-            sprintf(q, "<subtitle");
-            if (matchchar(xml, q, i) && (xml[i + 9] == 0x20 || xml[i + 9] == 0x3e))
-            {
-                if (tagtype == 1)
-                {
-                    tagtype = 2;
-                    knowntag = 1;
-                }
-                else
-                {
-                    printf("Error: the subtitle tag should be in the pgssup tag\n");
-                    return(1);
-                }
-                c++;
-            }
-            sprintf(q, "</subtitle>");
-            if (matchchar(xml, q, i))
-            {
-                if (tagtype == 2)
-                {
-                    tagtype = 1;
-                    knowntag = 1;
-                }
-                else
-                {
-                    printf("Error: XML syntax is wrong\n");
-                    return(1);
-                }
-            }
-            sprintf(q, "</pgssup>");
-            if (matchchar(xml, q, i))
-            {
-                if (tagtype == 1)
-                {
-                    tagtype = 0;
-                    knowntag = 1;
-                }
-                else
-                {
-                    printf("Error: XML syntax is wrong\n");
-                    return(1);
-                }
-            }
-            if (!knowntag)
-            {
-                // NOTE (magiruuvelvet): quick patch to not die on XML comments
-                // printf("Error: unknown tag\n");
-                // return(1);
-            }
-        }
-        if (xml[i - 1] == 0x22 && tagquo == 1 && jumpquo == 0)
-        {
-            tagquo = 2;
-            sprintf(q, " defaultoffset=");
-            if (tagtype == 1 && matchchar(xml, q, i - 16))
-            {
-                targetpoint = 0;
-                writer = defaultoffsetc;
-            }
-            sprintf(q, " starttime=");
-            if (tagtype == 2 && matchchar(xml, q, i - 12))
-            {
-                targetpoint = 0;
-                writer = starttimec[c - 1];
-            }
-            sprintf(q, " endtime=");
-            if (tagtype == 2 && matchchar(xml, q, i - 10))
-            {
-                targetpoint = 0;
-                writer = endtimec[c - 1];
-            }
-            sprintf(q, " offset=");
-            if (tagtype == 2 && matchchar(xml, q, i - 9))
-            {
-                targetpoint = 0;
-                writer = offsetc[c - 1];
-            }
-            sprintf(q, " view=");
-            if (tagtype == 2 && matchchar(xml, q, i - 7))
-            {
-                targetpoint = 0;
-                writer = viewc[c - 1];
-            }
-            sprintf(q, " image=");
-            if (tagtype == 2 && matchchar(xml, q, i - 8))
-            {
-                targetpoint = 0;
-                writer = imagec[c - 1];
-            }
-        }
-        if (jumpquo == 1)
-        {
-            jumpquo = 0;
-        }
-        if (xml[i] == 0x22 && tagquo == 2)
-        {
-            tagquo = 1;
-            writer[targetpoint] = 0;
-            writer = dummy;
-            jumpquo = 1;
-        }
-        if (xml[i] == 0x3e && tagquo == 1)
-        {
-            tagquo = 0;
-            if (xml[i - 1] == 0x2f)
-            {
-                tagtype--;
-            }
-        }
-        writer[targetpoint] = xml[i];
-        targetpoint++;
+        subtitlefree(&ds->subtitles[i]);
     }
-    if (tagtype != 0)
+    ds->number = 0;
+    ds->count = 0;
+    ds->cut = -1;
+    ds->finished = 0;
+    ds->copied = 0;
+    ds->status = 0;
+    ds->supt = 0;
+    ds->bitmapsize = 0;
+    ds->windowcount = 0;
+    ds->cleart = 0;
+    ds->logsize = 0;
+}
+
+void displaysetfree(displayset *ds)
+{
+    displaysetclear(ds);
+    free(ds->supdata);
+    free(ds->rledata);
+    free(ds->log);
+    memset(ds, 0, sizeof(displayset));
+}
+
+// number of palette updates for a fade of the given duration (ms)
+int fadesteps(long duration)
+{
+    long steps;
+    if (duration <= 0)
     {
-        printf("Error: XML is not valid\n");
-        return(1);
+        return(0);
     }
-    if (tagquo != 0)
+    steps = duration / FADE_STEP;
+    if (steps < 1)
     {
-        printf("Error: XML is not valid\n");
         return(1);
     }
-    printf("Info: loading xml completed\n");
-    printf("\n");
+    return steps > FADE_MAX_STEPS ? FADE_MAX_STEPS : (int) steps;
+}
 
-    png_structp png_ptr;
-    png_infop info_ptr;
-    png_infop end_info;
-    unsigned char pngheader[16];
-    int is_png;
-    unsigned char palette_r[256];
-    unsigned char palette_g[256];
-    unsigned char palette_b[256];
-    unsigned char palette_a[256];
-    int palette_c;
-    png_uint_32 png_h, png_w;
-    int colortype, bit_depth;
-    int x, y;
-    int offsetx, offsety, onoff;
-    FILE *pngf;
-    int supt;
-    int writtenbyte;
-    signed char Cr, Cb;
-    unsigned char Y;
-    int prevpalette;
-    int colorseqcount;
-    int bmplengthtarget;
-    int bmplength;
-    int doffsetx, doffsety;
-    sscanf(defaultoffsetc, "%d,%d", &doffsetx, &doffsety);
-    getabsolutepath(outpath, path);
-    fp = fopen(path, "wb");
-    int aflag;
-    aflag = 0;
+// alpha of a palette entry at level of levels (levels: fully visible)
+unsigned char fadealpha(unsigned char alpha, int level, int levels)
+{
+    return (unsigned char) ((alpha * level + levels / 2) / levels);
+}
 
-    if (fp == NULL)
-    {
-        printf("Error: the sup file \"%s\" could not be opened\n", path);
-        return(1);
-    }
+// writes the 13 byte header of a segment
+void segmentheader(char *p, long pts, int type, int size)
+{
+    char b1, b2, b3, b4;
 
-    // initial reserved size of a display set
-    size_t dssize;
-    dssize = 67000;
+    // 0x5047 (PG)
+    p[0] = 0x50;
+    p[1] = 0x47;
+
+    // presentation time
+    longtobyte(pts, &b1, &b2, &b3, &b4);
+    p[2] = b1;
+    p[3] = b2;
+    p[4] = b3;
+    p[5] = b4;
+
+    // decoding time
+    p[6] = 0x00;
+    p[7] = 0x00;
+    p[8] = 0x00;
+    p[9] = 0x00;
+
+    // segment type and size (16-bit)
+    p[10] = (char) type;
+    inttobyte(size, &b1, &b2);
+    p[11] = b1;
+    p[12] = b2;
+}
 
-    // iterate over all subtitles
-    for (i = 0; i < c; i++)
+// a composition object of the PCS
+typedef struct
+{
+    int id;
+    int window;
+    int forced;
+    int x;
+    int y;
+} compositionobject;
+
+// 0x16 (PCS), the composition number is set by the writer
+// returns the number of bytes written
+int writepcs(char *p, long pts, const encoderoptions *options, int state, int paletteupdate, const compositionobject *objects, int count)
+{
+    char b1, b2;
+    int t, j;
+
+    segmentheader(p, pts, 0x16, 11 + count * 8);
+
+    // video dimensions
+    inttobyte(options->width, &b1, &b2);
+    p[13] = b1;
+    p[14] = b2;
+    inttobyte(options->height, &b1, &b2);
+    p[15] = b1;
+    p[16] = b2;
+
+    // frame rate
+    // 0x10: 23.976, 0x20: 24, 0x30: 25, 0x40: 29.97, 0x60: 50, 0x70: 59.94
+    p[17] = (char) options->framerate;
+
+    // composition number (16-bit)
+    p[18] = 0x00;
+    p[19] = 0x00;
+
+    // composition state
+    // 0x00: normal
+    // 0x40: acquisition point
+    // 0x80: epoch start
+    p[20] = (char) state;
+
+    // palette update flag
+    // 0x00: false
+    // 0x80: true
+    p[21] = paletteupdate ? (char) 0x80 : 0x00;
+
+    // palette id
+    p[22] = 0x00;
+
+    // number of composition objects (8-bit)
+    p[23] = (char) count;
+    t = 24;
+
+    for (j = 0; j < count; j++)
     {
-        // must be resized when writing image data
-        supdata = (char*) malloc(dssize);
-
-        supt = 0;
-        palette_c = 0;
-        sscanf(starttimec[i], "%2d:%2d:%2d.%3d", &h1, &m1, &s1, &ms1);
-        sscanf(endtimec[i], "%2d:%2d:%2d.%3d", &h2, &m2, &s2, &ms2);
-        sscanf(imagec[i], "%s", pngfile);
-        sscanf(offsetc[i], "%d,%d", &offsetx, &offsety);
-        if (offsetc[i][0] == 0x00)
-        {
-            offsetx = doffsetx;
-            offsety = doffsety;
-        }
-        sprintf(q, "forced");
-        if (matchchar(viewc[i], q, 0))
-        {
-            onoff = 1;
-            printf("Info: including subtitle %d... (%d:%02d:%02d.%03d - %d:%02d:%02d.%03d forced)\n", i + 1, h1, m1, s1, ms1, h2, m2, s2, ms2);
-        }
-        else
-        {
-            onoff = 0;
-            printf("Info: including subtitle %d... (%d:%02d:%02d.%03d - %d:%02d:%02d.%03d)\n", i + 1, h1, m1, s1, ms1, h2, m2, s2, ms2);
-        }
-
-        // calculate timestamps
-        starttime = h1 * 3600000 + m1 * 60000 + s1 * 1000 + ms1;
-        endtime = h2 * 3600000 + m2 * 60000 + s2 * 1000 + ms2;
-        starttime *= 90;
-        endtime *= 90;
-
-        // header of each segment
-        // 0x5047 (PG)
-
-        // 0x16 (PCS)
-        supdata[supt] = 0x50;
-        supdata[supt + 1] = 0x47;
-
-        // start time
-        longtobyte(starttime, &b1, &b2, &b3, &b4);
-        supdata[supt + 2] = b1;
-        supdata[supt + 3] = b2;
-        supdata[supt + 4] = b3;
-        supdata[supt + 5] = b4;
-
-        // decoding time
-        supdata[supt + 6] = 0x00;
-        supdata[supt + 7] = 0x00;
-        supdata[supt + 8] = 0x00;
-        supdata[supt + 9] = 0x00;
-
-        // PCS segment type
-        supdata[supt + 10] = 0x16;
-
-        // segment size (16-bit)
-        supdata[supt + 11] = 0x00;
-        supdata[supt + 12] = 0x13;
-
-        // video dimensions
-        inttobyte(width, &b1, &b2);
-        supdata[supt + 13] = b1;
-        supdata[supt + 14] = b2;
-        inttobyte(height, &b1, &b2);
-        supdata[supt + 15] = b1;
-        supdata[supt + 16] = b2;
-
-        // frame rate (always 0x10, can be ignored)
-        supdata[supt + 17] = 0x10;
-
-        // composition number (16-bit)
-        supdata[supt + 18] = 0x00;
-        supdata[supt + 19] = 0x00;
-
-        // composition state
-        // 0x00: normal
-        // 0x40: acquisition point
-        // 0x80: epoch start
-        supdata[supt + 20] = 0x80;
-
-        // palette update flag
-        // 0x00: false
-        // 0x80: true
-        supdata[supt + 21] = 0x00;
-
-        // palette id
-        supdata[supt + 22] = 0x00;
-
-        // number of composition objects (8-bit)
-        supdata[supt + 23] = 0x01;
-
         // object id (16-bit)
-        supdata[supt + 24] = 0x00;
-        supdata[supt + 25] = 0x00;
+        inttobyte(objects[j].id, &b1, &b2);
+        p[t] = b1;
+        p[t + 1] = b2;
 
         // window id (8-bit)
-        supdata[supt + 26] = 0x00;
+        p[t + 2] = (char) objects[j].window;
 
         // object cropped flag (8-bit)
-        if (onoff != 0)
-        {
-            supdata[supt + 27] = 0x40; // force display
-        }
-        else
-        {
-            supdata[supt + 27] = 0x00; // off
-        }
+        // 0x40: force display
+        p[t + 3] = objects[j].forced ? 0x40 : 0x00;
 
         // image position
-        inttobyte(offsetx, &b1, &b2);
-        supdata[supt + 28] = b1;
-        supdata[supt + 29] = b2;
-        inttobyte(offsety, &b1, &b2);
-        supdata[supt + 30] = b1;
-        supdata[supt + 31] = b2;
+        inttobyte(objects[j].x, &b1, &b2);
+        p[t + 4] = b1;
+        p[t + 5] = b2;
+        inttobyte(objects[j].y, &b1, &b2);
+        p[t + 6] = b1;
+        p[t + 7] = b2;
+        t += 8;
+    }
 
-        // end of segment (19 bytes long) [0x0013]
+    return(t);
+}
 
-        supt += 32;
+// 0x17 (WDS), the windows must not change within an epoch
+// returns the number of bytes written
+int writewds(char *p, long pts, const displaywindow *windows, int count)
+{
+    char b1, b2;
+    int t, j;
 
-        // PNG
-        png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-        if (!png_ptr)
-        {
-            printf("Error: file \"%s\" could not be opened\n", pngfile);
-            free(supdata);
-            return(1);
-        }
-        info_ptr = png_create_info_struct(png_ptr);
-        if (!info_ptr)
+    segmentheader(p, pts, 0x17, 1 + count * 9);
+
+    // number of windows
+    p[13] = (char) count;
+    t = 14;
+
+    for (j = 0; j < count; j++)
+    {
+        // window id
+        p[t] = (char) j;
+
+        // window position
+        inttobyte(windows[j].x, &b1, &b2);
+        p[t + 1] = b1;
+        p[t + 2] = b2;
+        inttobyte(windows[j].y, &b1, &b2);
+        p[t + 3] = b1;
+        p[t + 4] = b2;
+
+        // window dimensions
+        inttobyte(windows[j].width, &b1, &b2);
+        p[t + 5] = b1;
+        p[t + 6] = b2;
+        inttobyte(windows[j].height, &b1, &b2);
+        p[t + 7] = b1;
+        p[t + 8] = b2;
+        t += 9;
+    }
+
+    return(t);
+}
+
+// 0x14 (PDS) with YCrCb and alpha entries, the alpha of every entry is scaled to level of levels
+// the palette version is set by the writer
+// returns the number of bytes written
+int writepds(char *p, long pts, const unsigned char palette[][4], int count, int level, int levels)
+{
+    int t, j;
+
+    segmentheader(p, pts, 0x14, count * 5 + 2);
+
+    // palette id
+    p[13] = 0x00;
+
+    // palette version number
+    p[14] = 0x00;
+    t = 15;
+
+    for (j = 0; j < count; j++)
+    {
+        // palette entry id
+        p[t] = (char) j;
+
+        p[t + 1] = (char) palette[j][0];                               // luminance
+        p[t + 2] = (char) palette[j][1];                               // color difference red
+        p[t + 3] = (char) palette[j][2];                               // color difference blue
+        p[t + 4] = (char) fadealpha(palette[j][3], level, levels);     // transparency
+        t += 5;
+    }
+
+    return(t);
+}
+
+// 0x15 (ODS), objects larger than a single segment are split into several ODS segments
+// the first segment carries the object data length and the image size, the object version is set by the writer
+// returns the number of bytes written
+int writeods(char *p, long pts, int id, const unsigned char *rle, size_t rlelength, int width, int height)
+{
+    char b1, b2;
+    size_t rlepos;
+    size_t fragmentlength;
+    int odsheader;
+    int fragment;
+    int t;
+
+    t = 0;
+    for (rlepos = 0, fragment = 0; fragment == 0 || rlepos < rlelength; fragment++)
+    {
+        // segment size (16-bit), at most 65535 bytes
+        odsheader = fragment == 0 ? 11 : 4;
+        fragmentlength = rlelength - rlepos;
+        if (fragmentlength > (size_t) (65535 - odsheader))
         {
-            png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
-            printf("Error: file \"%s\" could not be opened\n", pngfile);
-            free(supdata);
-            return(1);
+            fragmentlength = 65535 - odsheader;
         }
-        end_info = png_create_info_struct(png_ptr);
-        if (!end_info)
+        segmentheader(p + t, pts, 0x15, odsheader + (int) fragmentlength);
+
+        // object id (16-bit)
+        inttobyte(id, &b1, &b2);
+        p[t + 13] = b1;
+        p[t + 14] = b2;
+
+        // object version number
+        p[t + 15] = 0x00;
+
+        // last in sequence flag
+        // 0x40: last in sequence
+        // 0x80: first in sequence
+        // 0xC0: first and last in sequence (0x40 | 0x80)
+        p[t + 16] = 0x00;
+        if (fragment == 0)
         {
-            png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
-            printf("Error: file \"%s\" could not be opened\n", pngfile);
-            free(supdata);
-            return(1);
+            p[t + 16] |= 0x80;
         }
-        getabsolutepath(pngfile, path);
-        pngf = fopen(path, "rb");
-        if (pngf == NULL)
+        if (rlepos + fragmentlength == rlelength)
         {
-            printf("Error: file \"%s\" could not be opened\n", path);
-            free(supdata);
-            return(1);
+            p[t + 16] |= 0x40;
         }
-        if (fread(pngheader, 1, 8, pngf) < 8)
+
+        if (fragment == 0)
         {
-            printf("Error: file \"%s\" is not PNG format\n", path);
-            free(supdata);
-            return(1);
+            // object data length (24-bit)
+            p[t + 17] = (char) ((rlelength + 4) >> 16);
+            p[t + 18] = (char) ((rlelength + 4) >> 8);
+            p[t + 19] = (char) (rlelength + 4);
+
+            // image size
+            inttobyte(width, &b1, &b2);
+            p[t + 20] = b1;
+            p[t + 21] = b2;
+            inttobyte(height, &b1, &b2);
+            p[t + 22] = b1;
+            p[t + 23] = b2;
         }
-        is_png = !png_sig_cmp(pngheader, 0, 8);
-        if (!is_png)
+
+        // object data (variable length)
+        t += 13 + odsheader;
+        memcpy(p + t, rle + rlepos, fragmentlength);
+        t += (int) fragmentlength;
+        rlepos += fragmentlength;
+    }
+
+    return(t);
+}
+
+// 0x80 (END), the segment size of END is always zero
+// returns the number of bytes written
+int writeend(char *p, long pts)
+{
+    segmentheader(p, pts, 0x80, 0);
+    return(13);
+}
+
+// writes the display set clearing the windows (PCS without objects, WDS, END)
+// returns the number of bytes written, at most CLEAR_SIZE
+int writeclear(char *p, long pts, const encoderoptions *options, const displaywindow *windows, int count)
+{
+    int t;
+
+    t = writepcs(p, pts, options, 0x00, 0, NULL, 0);
+    t += writewds(p + t, pts, windows, count);
+    t += writeend(p + t, pts);
+    return(t);
+}
+
+// writes a display set which only replaces the palette of the objects on screen (PCS, PDS, END)
+// returns the number of bytes written, at most PALETTE_UPDATE_SIZE
+int paletteupdate(char *p, long pts, const encoderoptions *options, const compositionobject *objects, int count,
+                  const unsigned char palette[][4], int palette_c, int level, int levels)
+{
+    int t;
+
+    // normal composition with palette update flag, the objects and windows stay as they are
+    t = writepcs(p, pts, options, 0x00, 1, objects, count);
+    t += writepds(p + t, pts, palette, palette_c, level, levels);
+    t += writeend(p + t, pts);
+    return(t);
+}
+
+// bitmap of a subtitle as palette indices
+typedef struct
+{
+    unsigned char *indices;
+    int width;
+    int height;
+
+    // RGBA palette
+    unsigned char palette[256][4];
+    int count;
+
+    // index of fully transparent pixels (can be an undefined entry), -1: no transparent pixels
+    int transparent;
+} subtitleimage;
+
+// reads a PNG file into palette indices
+// palette images are used as is, other images must have at most 256 colors
+// returns 1 on success and 0 on failure
+int loadimage(displayset *ds, const char *pngfile, subtitleimage *image)
+{
+    char path[512];
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_infop end_info;
+    unsigned char pngheader[16];
+    int is_png;
+    unsigned char palette_r[256];
+    unsigned char palette_g[256];
+    unsigned char palette_b[256];
+    unsigned char palette_a[256];
+    int palette_c;
+    colortable colors;
+    unsigned int color;
+    int indexed;
+    int bpp;
+    int transparent;
+    png_colorp plte;
+    int num_plte;
+    png_bytep trans;
+    int num_trans;
+    png_color_16p transcolor;
+    png_uint_32 png_h, png_w;
+    int colortype, bit_depth;
+    png_uint_32 x, y;
+    FILE *pngf;
+    unsigned char *indices;
+    unsigned char *bmbuff;
+    unsigned char **pixel;
+    int aflag;
+    int j;
+
+    memset(image, 0, sizeof(subtitleimage));
+
+    // PNG
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png_ptr)
+    {
+        logprintf(ds, "Error: file \"%s\" could not be opened\n", pngfile);
+        return(0);
+    }
+    info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr)
+    {
+        png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
+        logprintf(ds, "Error: file \"%s\" could not be opened\n", pngfile);
+        return(0);
+    }
+    end_info = png_create_info_struct(png_ptr);
+    if (!end_info)
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+        logprintf(ds, "Error: file \"%s\" could not be opened\n", pngfile);
+        return(0);
+    }
+    getabsolutepath((char*) pngfile, path);
+    pngf = fopen(path, "rb");
+    if (pngf == NULL)
+    {
+        logprintf(ds, "Error: file \"%s\" could not be opened\n", path);
+        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+        return(0);
+    }
+    if (fread(pngheader, 1, 8, pngf) < 8)
+    {
+        logprintf(ds, "Error: file \"%s\" is not PNG format\n", path);
+        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+        fclose(pngf);
+        return(0);
+    }
+    is_png = !png_sig_cmp(pngheader, 0, 8);
+    if (!is_png)
+    {
+        logprintf(ds, "Error: file \"%s\" is not PNG format\n", path);
+        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+        fclose(pngf);
+        return(0);
+    }
+    png_init_io(png_ptr, pngf);
+    png_set_sig_bytes(png_ptr, 8);
+    png_read_info(png_ptr, info_ptr);
+    png_get_IHDR(png_ptr, info_ptr, &png_w, &png_h, &bit_depth, &colortype, NULL, NULL, NULL);
+
+    // palette images are used as is, the rows contain palette indices (1 byte per pixel)
+    indexed = colortype == PNG_COLOR_TYPE_PALETTE && png_get_PLTE(png_ptr, info_ptr, &plte, &num_plte);
+    if (indexed)
+    {
+        bpp = 1;
+        if (bit_depth < 8)
         {
-            printf("Error: file \"%s\" is not PNG format\n", path);
-            free(supdata);
-            return(1);
+            png_set_packing(png_ptr);
         }
-        png_init_io(png_ptr, pngf);
-        png_set_sig_bytes(png_ptr, 8);
-        png_read_info(png_ptr, info_ptr);
-        png_get_IHDR(png_ptr, info_ptr, &png_w, &png_h, &bit_depth, &colortype, NULL, NULL, NULL);
+    }
+    else
+    {
+        bpp = 4;
         if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
         {
             png_set_expand(png_ptr);
@@ -666,588 +910,2292 @@ int main(int argc, char *argv[])
         {
             png_set_add_alpha(png_ptr, 255, PNG_FILLER_AFTER);
         }
-        unsigned char *bmbuff;
-        unsigned char **pixel;
-        bmbuff = (unsigned char*) malloc(png_w * png_h * 4);
-        pixel = (unsigned char**) malloc(png_w * png_h * 4);
-        for (j = 0; j < png_h; j++)
-        {
-            pixel[j] = bmbuff + png_w * 4 * j;
-        }
-        png_read_update_info(png_ptr, info_ptr);
-        png_read_image(png_ptr, pixel);
-
-        png_read_end(png_ptr, end_info);
-        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
-
-        // close PNG file here as it is no longer needed
-        fclose(pngf);
-
-        // 0x17 (WDS)
-        supdata[supt] = 0x50;
-        supdata[supt + 1] = 0x47;
-
-        // start time
-        longtobyte(starttime, &b1, &b2, &b3, &b4);
-        supdata[supt + 2] = b1;
-        supdata[supt + 3] = b2;
-        supdata[supt + 4] = b3;
-        supdata[supt + 5] = b4;
-
-        // decoding time
-        supdata[supt + 6] = 0x00;
-        supdata[supt + 7] = 0x00;
-        supdata[supt + 8] = 0x00;
-        supdata[supt + 9] = 0x00;
-
-        // WDS segment type
-        supdata[supt + 10] = 0x17;
-
-        // segment size (16-bit)
-        supdata[supt + 11] = 0x00;
-        supdata[supt + 12] = 0x0A;
+    }
+    bmbuff = (unsigned char*) malloc(png_w * png_h * bpp);
+    pixel = (unsigned char**) malloc(png_h * sizeof(unsigned char*));
+    for (y = 0; y < png_h; y++)
+    {
+        pixel[y] = bmbuff + png_w * bpp * y;
+    }
+    png_read_update_info(png_ptr, info_ptr);
+    png_read_image(png_ptr, pixel);
 
-        // number of windows
-        supdata[supt + 13] = 0x01;
+    png_read_end(png_ptr, end_info);
 
-        // window id
-        supdata[supt + 14] = 0x00;
+    // take over PLTE and tRNS before the png structures are destroyed
+    palette_c = 0;
+    if (indexed)
+    {
+        num_trans = 0;
+        if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+        {
+            png_get_tRNS(png_ptr, info_ptr, &trans, &num_trans, &transcolor);
+        }
+        palette_c = num_plte;
+        for (j = 0; j < palette_c; j++)
+        {
+            palette_r[j] = plte[j].red;
+            palette_g[j] = plte[j].green;
+            palette_b[j] = plte[j].blue;
+            palette_a[j] = j < num_trans ? trans[j] : 255;
+        }
+    }
 
-        // window position
-        inttobyte(offsetx, &b1, &b2);
-        supdata[supt + 15] = b1;
-        supdata[supt + 16] = b2;
-        inttobyte(offsety, &b1, &b2);
-        supdata[supt + 17] = b1;
-        supdata[supt + 18] = b2;
+    png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
 
-        // window dimensions
-        inttobyte(png_w, &b1, &b2);
-        supdata[supt + 19] = b1;
-        supdata[supt + 20] = b2;
-        inttobyte(png_h, &b1, &b2);
-        supdata[supt + 21] = b1;
-        supdata[supt + 22] = b2;
+    // close PNG file here as it is no longer needed
+    fclose(pngf);
 
-        // end of segment (10 bytes long) [0x000A]
+    aflag = 0;
+    image->transparent = -1;
 
-        supt += 23;
-        palette_c = 0;
-        aflag = 0;
-        palette_c = 0;
+    // fully transparent entries are merged into index 0 when the palette is ordered
+    if (indexed)
+    {
+        for (transparent = 0; transparent < palette_c; transparent++)
+        {
+            if (palette_a[transparent] == 0)
+            {
+                image->transparent = transparent;
+                break;
+            }
+        }
+        logprintf(ds, "Info: the png file \"%s\" has %d palette entries; size: %dx%d\n", pngfile, palette_c, (int)png_w, (int)png_h);
+    }
 
-        // creating color palette
-        for (j = 0; j < 256; j++)
+    // creating color palette
+    for (j = 0; !indexed && j < 256; j++)
+    {
+        palette_r[j] = 0;
+        palette_g[j] = 0;
+        palette_b[j] = 0;
+        palette_a[j] = 0;
+    }
+    colortableclear(&colors);
+    for (y = 0; !indexed && y < png_h; y++)
+    {
+        for (x = 0; x < png_w; x++)
         {
-            palette_r[j] = 0;
-            palette_g[j] = 0;
-            palette_b[j] = 0;
-            palette_a[j] = 0;
+            if (pixel[y][x * 4 + 3] == 0)
+            {
+                aflag = 1;
+                continue;
+            }
+            color = packcolor(&pixel[y][x * 4]);
+            if (colortablefind(&colors, color) == -1)
+            {
+                if (palette_c == 256)
+                {
+                    logprintf(ds, "Error: the png file \"%s\" has more than 256 colors\n", pngfile);
+                    free(pixel);
+                    free(bmbuff);
+                    return(0);
+                }
+                palette_r[palette_c] = pixel[y][x * 4];
+                palette_g[palette_c] = pixel[y][x * 4 + 1];
+                palette_b[palette_c] = pixel[y][x * 4 + 2];
+                palette_a[palette_c] = pixel[y][x * 4 + 3];
+                colortableinsert(&colors, color, palette_c);
+                palette_c++;
+            }
         }
+    }
+
+    if (aflag == 1 && palette_c == 256)
+    {
+        logprintf(ds, "Error: the png file \"%s\" has more than 256 colors\n", pngfile);
+        free(pixel);
+        free(bmbuff);
+        return(0);
+    }
+    if (!indexed)
+    {
+        logprintf(ds, "Info: the png file \"%s\" has %d color(s); size: %dx%d\n", pngfile, palette_c, (int)png_w, (int)png_h);
+    }
+
+    // palette index of every pixel, palette images already consist of indices
+    if (indexed)
+    {
+        indices = bmbuff;
+    }
+    else
+    {
+        indices = (unsigned char*) malloc(png_w * png_h);
         for (y = 0; y < png_h; y++)
         {
             for (x = 0; x < png_w; x++)
             {
-                if (pixel[y][x * 4 + 3] == 0)
+                // repeated pixels don't need another lookup
+                if (x > 0 && memcmp(&pixel[y][x * 4], &pixel[y][x * 4 - 4], 4) == 0)
                 {
-                    aflag = 1;
+                    indices[y * png_w + x] = indices[y * png_w + x - 1];
                     continue;
                 }
-                for (j = 0; j < palette_c; j++)
-                {
-                    if (
-                        palette_r[j] == pixel[y][x * 4] &&
-                        palette_g[j] == pixel[y][x * 4 + 1] &&
-                        palette_b[j] == pixel[y][x * 4 + 2] &&
-                        palette_a[j] == pixel[y][x * 4 + 3]
-                    ) {
-                        break;
-                    }
-                }
-                if (j == palette_c)
-                {
-                    if (palette_c == 256)
-                    {
-                        printf("Error: the png file \"%s\" has more than 256 colors\n", pngfile);
-                        free(supdata);
-                        return(1);
-                    }
-                    palette_r[palette_c] = pixel[y][x * 4];
-                    palette_g[palette_c] = pixel[y][x * 4 + 1];
-                    palette_b[palette_c] = pixel[y][x * 4 + 2];
-                    palette_a[palette_c] = pixel[y][x * 4 + 3];
-                    palette_c++;
-                }
+                indices[y * png_w + x] = pixelindex(&colors, &pixel[y][x * 4]);
             }
         }
-
-        if (aflag == 1 && palette_c == 256)
+        free(bmbuff);
+        if (aflag)
         {
-            printf("Error: the png file \"%s\" has more than 256 colors\n", pngfile);
-            free(supdata);
-            return(1);
+            image->transparent = 0xff;
         }
-        printf("Info: the png file \"%s\" has %d color(s); size: %dx%d\n", pngfile, palette_c, (int)png_w, (int)png_h);
-
-        // 0x14 (PDS)
-        supdata[supt] = 0x50;
-        supdata[supt + 1] = 0x47;
+    }
 
-        // start time
-        longtobyte(starttime, &b1, &b2, &b3, &b4);
-        supdata[supt + 2] = b1;
-        supdata[supt + 3] = b2;
-        supdata[supt + 4] = b3;
-        supdata[supt + 5] = b4;
+    // clean up pixel buffers
+    free(pixel);
 
-        // decoding time
-        supdata[supt + 6] = 0x00;
-        supdata[supt + 7] = 0x00;
-        supdata[supt + 8] = 0x00;
-        supdata[supt + 9] = 0x00;
+    image->indices = indices;
+    image->width = (int) png_w;
+    image->height = (int) png_h;
+    image->count = palette_c;
+    for (j = 0; j < 256; j++)
+    {
+        image->palette[j][0] = palette_r[j];
+        image->palette[j][1] = palette_g[j];
+        image->palette[j][2] = palette_b[j];
+        image->palette[j][3] = palette_a[j];
+    }
+    return(1);
+}
 
-        // PDS segment type
-        supdata[supt + 10] = 0x14;
+// adds the colors of the second image to the palette of the first one, all objects on screen share a palette
+// returns 0 when there are more than 256 colors
+int mergepalette(subtitleimage *first, subtitleimage *second)
+{
+    unsigned char remap[256];
+    int limit, transparent;
+    int j, k;
 
-        // segment size (16-bit)
-        inttobyte(palette_c * 5 + 2, &b1, &b2);
-        supdata[supt + 11] = b1;
-        supdata[supt + 12] = b2;
+    // an undefined entry used for transparent pixels can't be taken
+    limit = first->transparent == 0xff ? 255 : 256;
+    transparent = first->transparent;
 
-        // palette id
-        supdata[supt + 13] = 0x00;
+    for (j = 0; j < 256; j++)
+    {
+        remap[j] = j;
+    }
 
-        // palette version number
-        supdata[supt + 14] = 0x00;
+    for (j = 0; j < second->count; j++)
+    {
+        if (second->palette[j][3] == 0)
+        {
+            continue;
+        }
+        for (k = 0; k < first->count; k++)
+        {
+            if (memcmp(first->palette[k], second->palette[j], 4) == 0)
+            {
+                break;
+            }
+        }
+        if (k == first->count)
+        {
+            if (first->count == limit)
+            {
+                return(0);
+            }
+            memcpy(first->palette[k], second->palette[j], 4);
+            first->count++;
+        }
+        remap[j] = k;
+    }
 
-        supt += 15;
-        for (j = 0; j < palette_c; j++)
+    // transparent pixels of the second image
+    if (second->transparent != -1)
+    {
+        if (transparent == -1)
         {
-            // RGB -> YCrCb
-            Y = 0.299 * (double) palette_r[j] + 0.587 * (double) palette_g[j] + 0.114 * (double) palette_b[j];
-            Cr = 0.5 * (double) palette_r[j] - 0.419 * (double) palette_g[j] - 0.081 * (double) palette_b[j];
-            Cb = -0.169 * (double) palette_r[j] - 0.332 * (double) palette_g[j] + 0.5 * (double) palette_b[j];
+            if (first->count == limit)
+            {
+                return(0);
+            }
+            transparent = first->count;
+            memset(first->palette[transparent], 0, 4);
+            first->count++;
+            first->transparent = transparent;
+        }
+        for (j = 0; j < 256; j++)
+        {
+            if (j >= second->count || second->palette[j][3] == 0)
+            {
+                remap[j] = transparent;
+            }
+        }
+    }
+
+    for (j = 0; j < second->width * second->height; j++)
+    {
+        second->indices[j] = remap[second->indices[j]];
+    }
+    return(1);
+}
 
-            // palette entry id
-            supdata[supt] = j;
+// palette entry and the number of its pixels
+typedef struct
+{
+    int index;
+    unsigned long pixels;
+} paletteusage;
 
-            supdata[supt + 1] = Y;             // luminance
-            supdata[supt + 2] = Cr + 128;      // color difference red
-            supdata[supt + 3] = Cb + 128;      // color difference blue
-            supdata[supt + 4] = palette_a[j];  // transparency
+// more pixels first, entries with the same number of pixels keep their order
+int comparepaletteusage(const void *a, const void *b)
+{
+    const paletteusage *x;
+    const paletteusage *y;
+    x = (const paletteusage*) a;
+    y = (const paletteusage*) b;
+    if (x->pixels != y->pixels)
+    {
+        return x->pixels > y->pixels ? -1 : 1;
+    }
+    return x->index - y->index;
+}
 
-            // move to next palette entry
-            supt += 5;
+// renumbers the palette shared by the images for the shortest run-length codes
+// fully transparent pixels get index 0, as runs of color 0 have the shortest codes,
+// the other entries all have codes of the same length and are ordered by their number of pixels
+// unused entries are dropped
+void orderpalette(subtitleimage *images, int count)
+{
+    unsigned long histogram[256];
+    paletteusage usage[256];
+    unsigned char remap[256];
+    unsigned char palette[256][4];
+    size_t pixels, k;
+    int used, transparent;
+    int i, j;
+
+    memset(histogram, 0, sizeof(histogram));
+    for (i = 0; i < count; i++)
+    {
+        pixels = (size_t) images[i].width * images[i].height;
+        for (k = 0; k < pixels; k++)
+        {
+            histogram[images[i].indices[k]]++;
         }
+    }
 
-        // end of segment
+    // transparent entries and the undefined entry for transparent pixels of RGBA images become one entry
+    transparent = 0;
+    used = 0;
+    for (j = 0; j < 256; j++)
+    {
+        if (histogram[j] == 0)
+        {
+            continue;
+        }
+        if (j >= images[0].count || images[0].palette[j][3] == 0)
+        {
+            transparent = 1;
+            continue;
+        }
+        usage[used].index = j;
+        usage[used].pixels = histogram[j];
+        used++;
+    }
+    qsort(usage, used, sizeof(paletteusage), comparepaletteusage);
 
-        // 0x15 (ODS)
-        supdata[supt] = 0x50;
-        supdata[supt + 1] = 0x47;
+    memset(remap, 0, sizeof(remap));
+    memset(palette, 0, sizeof(palette));
+    for (j = 0; j < used; j++)
+    {
+        remap[usage[j].index] = (unsigned char) (j + transparent);
+        memcpy(palette[j + transparent], images[0].palette[usage[j].index], 4);
+    }
+    memcpy(images[0].palette, palette, sizeof(palette));
+    images[0].count = used + transparent;
+    images[0].transparent = transparent ? 0 : -1;
 
-        // start time
-        longtobyte(starttime, &b1, &b2, &b3, &b4);
-        supdata[supt + 2] = b1;
-        supdata[supt + 3] = b2;
-        supdata[supt + 4] = b3;
-        supdata[supt + 5] = b4;
+    for (i = 0; i < count; i++)
+    {
+        pixels = (size_t) images[i].width * images[i].height;
+        for (k = 0; k < pixels; k++)
+        {
+            images[i].indices[k] = remap[images[i].indices[k]];
+        }
+    }
+}
 
-        // decoding time
-        supdata[supt + 6] = 0x00;
-        supdata[supt + 7] = 0x00;
-        supdata[supt + 8] = 0x00;
-        supdata[supt + 9] = 0x00;
+// windows overlap
+int windowsoverlap(const displaywindow *a, const displaywindow *b)
+{
+    return a->x < b->x + b->width && b->x < a->x + a->width &&
+           a->y < b->y + b->height && b->y < a->y + a->height;
+}
 
-        // ODS segment type
-        supdata[supt + 10] = 0x15;
+// encodes the display sets of the subtitles into memory
+// a single subtitle is shown from its start until its end time, two subtitles overlapping in time
+// share an epoch: both objects are sent once and only the composition changes
+// returns 1 on success and 0 on failure, messages are collected in the log of the display set
+int encodedisplayset(displayset *ds, const encoderoptions *options)
+{
+    long starttime[MAX_SUBTITLES] = {0};
+    long endtime[MAX_SUBTITLES] = {0};
+    int onoff[MAX_SUBTITLES];
+    subtitleimage images[MAX_SUBTITLES];
+    compositionobject objects[MAX_SUBTITLES];
+    compositionobject shown[MAX_SUBTITLES];
+    size_t rleoffset[MAX_SUBTITLES];
+    size_t rlelength[MAX_SUBTITLES];
+    size_t rlesize;
+    size_t supsize;
+    subtitle *sub;
+    char *supdata;
+    char q[32];
+    int offsetx, offsety;
+    int supt;
+    unsigned char palette[256][4];
+    int palette_c;
+    long fadein, fadeout;
+    int fadeinsteps, fadeoutsteps;
+    long pts, clearpts;
+    int first, second;
+    int together;
+    int i, j;
+
+    fadeinsteps = 0;
+    fadeoutsteps = 0;
+    fadein = 0;
+    fadeout = 0;
+    first = 0;
+    second = 1;
+
+    for (i = 0; i < ds->count; i++)
+    {
+        sub = &ds->subtitles[i];
+        sscanf(sub->offset, "%d,%d", &offsetx, &offsety);
+        if (sub->offset[0] == 0x00)
+        {
+            offsetx = options->doffsetx;
+            offsety = options->doffsety;
+        }
+        sprintf(q, "forced");
+        if (matchchar(sub->view, q, 0))
+        {
+            onoff[i] = 1;
+            logprintf(ds, "Info: including subtitle %d... (%ld:%02ld:%02ld.%03ld - %ld:%02ld:%02ld.%03ld forced)\n", sub->number,
+                      sub->start / 3600000, sub->start / 60000 % 60, sub->start / 1000 % 60, sub->start % 1000,
+                      sub->end / 3600000, sub->end / 60000 % 60, sub->end / 1000 % 60, sub->end % 1000);
+        }
+        else
+        {
+            onoff[i] = 0;
+            logprintf(ds, "Info: including subtitle %d... (%ld:%02ld:%02ld.%03ld - %ld:%02ld:%02ld.%03ld)\n", sub->number,
+                      sub->start / 3600000, sub->start / 60000 % 60, sub->start / 1000 % 60, sub->start % 1000,
+                      sub->end / 3600000, sub->end / 60000 % 60, sub->end / 1000 % 60, sub->end % 1000);
+        }
 
-        // segment size is set later
-        // supt + 11 and 12
-        bmplengthtarget = supt + 11;
+        // calculate timestamps
+        starttime[i] = sub->start;
+        endtime[i] = sub->end;
+
+        objects[i].id = i;
+        objects[i].window = i;
+        objects[i].forced = onoff[i];
+        objects[i].x = offsetx;
+        objects[i].y = offsety;
+    }
 
-        // object id (16-bit)
-        supdata[supt + 13] = 0x00;
-        supdata[supt + 14] = 0x00;
+    // subtitles with the same times and fades are shown like a single one, e.g. the parts of a frame cut between lines
+    together = 1;
+    if (ds->count == 2)
+    {
+        // the subtitle starting first is the first object
+        first = starttime[1] < starttime[0] ? 1 : 0;
+        second = 1 - first;
+        together = starttime[0] == starttime[1] && endtime[0] == endtime[1] &&
+                   strcmp(ds->subtitles[0].fadein, ds->subtitles[1].fadein) == 0 &&
+                   strcmp(ds->subtitles[0].fadeout, ds->subtitles[1].fadeout) == 0;
+        if (together)
+        {
+            logprintf(ds, "Info: subtitle %d and %d are shown as one subtitle\n", ds->subtitles[0].number, ds->subtitles[1].number);
+        }
+        else
+        {
+            logprintf(ds, "Info: subtitle %d overlaps subtitle %d, both are shown together\n",
+                      ds->subtitles[second].number, ds->subtitles[first].number);
+        }
+
+        // the next subtitle overlaps as well, both end when it starts
+        if (ds->cut >= 0 && ds->cut > starttime[second])
+        {
+            logprintf(ds, "Warning: subtitle %d and %d are cut at the start of the next subtitle, at most %d subtitles can overlap\n",
+                      ds->subtitles[0].number, ds->subtitles[1].number, MAX_SUBTITLES);
+            endtime[0] = endtime[0] > ds->cut ? ds->cut : endtime[0];
+            endtime[1] = endtime[1] > ds->cut ? ds->cut : endtime[1];
+        }
+
+        for (i = 0; !together && i < ds->count; i++)
+        {
+            if (ds->subtitles[i].fadein[0] != 0 || ds->subtitles[i].fadeout[0] != 0)
+            {
+                logprintf(ds, "Warning: the fades of subtitle %d are ignored, it overlaps another subtitle\n", ds->subtitles[i].number);
+            }
+        }
+    }
+    else if (ds->cut >= 0 && ds->cut > starttime[0] && ds->cut < endtime[0])
+    {
+        // the next two subtitles start together while it is shown, it ends when they start
+        logprintf(ds, "Warning: subtitle %d is cut at the start of the next subtitles, at most %d subtitles can overlap\n",
+                  ds->subtitles[0].number, MAX_SUBTITLES);
+        endtime[0] = ds->cut;
+    }
+
+    if (together)
+    {
+        // fades (ms) are limited to the duration of the subtitle
+        sscanf(ds->subtitles[0].fadein, "%ld", &fadein);
+        sscanf(ds->subtitles[0].fadeout, "%ld", &fadeout);
+        fadein = fadein < 0 ? 0 : fadein;
+        fadeout = fadeout < 0 ? 0 : fadeout;
+        if (fadein + fadeout > endtime[0] - starttime[0] && fadein + fadeout > 0)
+        {
+            fadein = endtime[0] > starttime[0] ? (endtime[0] - starttime[0]) * fadein / (fadein + fadeout) : 0;
+            fadeout = endtime[0] > starttime[0] ? endtime[0] - starttime[0] - fadein : 0;
+        }
+        fadeinsteps = fadesteps(fadein);
+        fadeoutsteps = fadesteps(fadeout);
+        if (fadeinsteps || fadeoutsteps)
+        {
+            logprintf(ds, "Info: fading subtitle %d in %ld ms and out %ld ms\n", ds->number, fadein, fadeout);
+        }
+    }
+
+    for (i = 0; i < ds->count; i++)
+    {
+        starttime[i] *= 90;
+        endtime[i] *= 90;
+    }
+    fadein *= 90;
+    fadeout *= 90;
+
+    // load all images, the objects of overlapping subtitles share the palette
+    for (i = 0; i < ds->count; i++)
+    {
+        if (!loadimage(ds, ds->subtitles[i].image, &images[i]))
+        {
+            while (i-- > 0)
+            {
+                free(images[i].indices);
+            }
+            return(0);
+        }
+    }
+    if (ds->count == 2 && !mergepalette(&images[0], &images[1]))
+    {
+        logprintf(ds, "Error: the overlapping subtitles %d and %d have more than 256 colors together\n", ds->subtitles[0].number, ds->subtitles[1].number);
+        free(images[0].indices);
+        free(images[1].indices);
+        return(0);
+    }
+    orderpalette(images, ds->count);
+
+    // object data
+    rlesize = 0;
+    for (i = 0; i < ds->count; i++)
+    {
+        rlesize += pgs_rle_bound(images[i].width, images[i].height);
+    }
+    if (!reservebuffer((void**) &ds->rledata, &ds->rlecapacity, rlesize))
+    {
+        logprintf(ds, "Error: out of memory\n");
+        for (i = 0; i < ds->count; i++)
+        {
+            free(images[i].indices);
+        }
+        return(0);
+    }
+    rlesize = 0;
+    for (i = 0; i < ds->count; i++)
+    {
+        rleoffset[i] = rlesize;
+        rlelength[i] = pgs_rle_encode(images[i].indices, images[i].width, images[i].height, images[i].width, ds->rledata + rlesize);
+        rlesize += rlelength[i];
+    }
+
+    // windows are the image areas, overlapping images share a window
+    for (i = 0; i < ds->count; i++)
+    {
+        ds->windows[i].x = objects[i].x;
+        ds->windows[i].y = objects[i].y;
+        ds->windows[i].width = images[i].width;
+        ds->windows[i].height = images[i].height;
+        free(images[i].indices);
+    }
+    ds->windowcount = ds->count;
+    if (ds->count == 2 && windowsoverlap(&ds->windows[0], &ds->windows[1]))
+    {
+        offsetx = ds->windows[0].x < ds->windows[1].x ? ds->windows[0].x : ds->windows[1].x;
+        offsety = ds->windows[0].y < ds->windows[1].y ? ds->windows[0].y : ds->windows[1].y;
+        ds->windows[0].width = (ds->windows[0].x + ds->windows[0].width > ds->windows[1].x + ds->windows[1].width ?
+                                ds->windows[0].x + ds->windows[0].width : ds->windows[1].x + ds->windows[1].width) - offsetx;
+        ds->windows[0].height = (ds->windows[0].y + ds->windows[0].height > ds->windows[1].y + ds->windows[1].height ?
+                                 ds->windows[0].y + ds->windows[0].height : ds->windows[1].y + ds->windows[1].height) - offsety;
+        ds->windows[0].x = offsetx;
+        ds->windows[0].y = offsety;
+        ds->windowcount = 1;
+        objects[1].window = 0;
+    }
+
+    ds->bitmapsize = 0;
+    for (i = 0; i < ds->count; i++)
+    {
+        // the object data length field includes the image dimensions (4 bytes)
+        if (rlelength[i] + 4 > 0xffffff)
+        {
+            logprintf(ds, "Error: subtitle picture is very complicated. (%d byte)\n", (int) rlelength[i]);
+            logprintf(ds, "       It should be less than 16777212 bytes.\n");
+            return(0);
+        }
+
+        // the coded data buffer of PGS decoders holds 1 MiB of object data
+        if (rlelength[i] + 4 > 0x100000)
+        {
+            logprintf(ds, "Warning: the object data of subtitle %d (%d bytes) exceeds the coded data buffer of 1048576 bytes\n", ds->subtitles[i].number, (int) rlelength[i] + 4);
+        }
+        ds->bitmapsize += (int) rlelength[i] + 4;
+    }
+
+    // RGB -> YCrCb
+    palette_c = images[0].count;
+    for (j = 0; j < palette_c; j++)
+    {
+        pgs_color_convert(&options->colors, images[0].palette[j][0], images[0].palette[j][1], images[0].palette[j][2],
+                          &palette[j][0], &palette[j][2], &palette[j][1]);
+        palette[j][3] = images[0].palette[j][3];
+    }
+
+    // make room for the object data and the headers of all its ODS segments and the palette updates
+    supsize = ds->count * DISPLAYSET_SEGMENTS_SIZE + (fadeinsteps + fadeoutsteps) * PALETTE_UPDATE_SIZE;
+    for (i = 0; i < ds->count; i++)
+    {
+        supsize += rlelength[i] + (rlelength[i] / 65524) * ODS_FRAGMENT_HEADER_SIZE;
+    }
+    if (!reservebuffer((void**) &ds->supdata, &ds->supcapacity, supsize))
+    {
+        logprintf(ds, "Error: out of memory\n");
+        return(0);
+    }
+    supdata = ds->supdata;
+    supt = 0;
+
+    if (ds->count == 1)
+    {
+        // epoch start with the object, a fade in starts fully transparent
+        shown[0] = objects[0];
+        supt += writepcs(supdata + supt, starttime[0], options, 0x80, 0, shown, 1);
+        supt += writewds(supdata + supt, starttime[0], ds->windows, 1);
+        supt += writepds(supdata + supt, starttime[0], palette, palette_c, fadeinsteps ? 0 : 1, 1);
+        supt += writeods(supdata + supt, starttime[0], 0, ds->rledata, rlelength[0], images[0].width, images[0].height);
+        supt += writeend(supdata + supt, starttime[0]);
+
+        ds->startpts = starttime[0];
+        clearpts = endtime[0];
+    }
+    else
+    {
+        // epoch start with the first object and the windows of both
+        // a second object starting at the same time is sent along
+        pts = starttime[first];
+        i = starttime[second] == pts ? 2 : 1;
+        shown[0] = objects[first];
+        shown[1] = objects[second];
+        supt += writepcs(supdata + supt, pts, options, 0x80, 0, shown, i);
+        supt += writewds(supdata + supt, pts, ds->windows, ds->windowcount);
+        supt += writepds(supdata + supt, pts, palette, palette_c, fadeinsteps ? 0 : 1, 1);
+        supt += writeods(supdata + supt, pts, first, ds->rledata + rleoffset[first], rlelength[first], images[first].width, images[first].height);
+        if (i == 2)
+        {
+            supt += writeods(supdata + supt, pts, second, ds->rledata + rleoffset[second], rlelength[second], images[second].width, images[second].height);
+        }
+        supt += writeend(supdata + supt, pts);
+
+        // the second object is added, the first one stays on screen
+        if (i == 1)
+        {
+            pts = starttime[second];
+            supt += writepcs(supdata + supt, pts, options, 0x00, 0, shown, 2);
+            supt += writewds(supdata + supt, pts, ds->windows, ds->windowcount);
+            supt += writeods(supdata + supt, pts, second, ds->rledata + rleoffset[second], rlelength[second], images[second].width, images[second].height);
+            supt += writeend(supdata + supt, pts);
+        }
+
+        // the subtitle ending first is removed, the other one stays on screen
+        if (endtime[first] != endtime[second])
+        {
+            i = endtime[first] < endtime[second] ? 1 : 0;
+            pts = endtime[first] < endtime[second] ? endtime[first] : endtime[second];
+            supt += writepcs(supdata + supt, pts, options, 0x00, 0, &shown[i], 1);
+            supt += writewds(supdata + supt, pts, ds->windows, ds->windowcount);
+            supt += writeend(supdata + supt, pts);
+        }
+
+        ds->startpts = starttime[first];
+        clearpts = endtime[first] > endtime[second] ? endtime[first] : endtime[second];
+    }
+
+    // fades only replace the palette of the objects on screen
+    // the fade in ends fully visible, the fade out ends fully transparent right before the screen is cleared
+    for (j = 1; j <= fadeinsteps; j++)
+    {
+        pts = starttime[0] + fadein * j / fadeinsteps;
+        if (pts >= endtime[0] - fadeout)
+        {
+            break;
+        }
+        supt += paletteupdate(supdata + supt, pts, options, shown, ds->count, palette, palette_c, j, fadeinsteps);
+    }
+    for (j = 1; j <= fadeoutsteps; j++)
+    {
+        pts = endtime[0] - fadeout + fadeout * (j - 1) / fadeoutsteps;
+        supt += paletteupdate(supdata + supt, pts, options, shown, ds->count, palette, palette_c, fadeoutsteps - j, fadeoutsteps);
+    }
+
+    // the writer drops this display set when the next subtitle starts right away
+    ds->cleart = supt;
+
+    // end time (start time, but screen is cleared)
+    supt += writeclear(supdata + supt, clearpts, options, ds->windows, ds->windowcount);
+
+    // the display sets are written by the caller
+    ds->supt = supt;
+    ds->endpts = clearpts;
+    ds->status = 1;
+    return(1);
+}
+
+// an existing sup file, the display sets of the subtitles which didn't change are copied from it (-p)
+typedef struct
+{
+    unsigned char *data;
+    size_t size;
+
+    // start of the next display sets to copy, a PCS with an epoch start or acquisition point
+    size_t pos;
+
+    // changed subtitles as ranges of the first and last number
+    int (*changed)[2];
+    int changedcount;
+
+    // number of copied and encoded display sets
+    int copied;
+    int encoded;
+} patchsource;
+
+// parses the changed subtitles, a comma separated list of numbers and ranges like 12,15-17
+// returns 0 on syntax errors or when out of memory
+int parsechanged(patchsource *patch, const char *list)
+{
+    int (*changed)[2];
+    int first, last, length, capacity;
+
+    capacity = 0;
+    while (*list)
+    {
+        length = 0;
+        if (sscanf(list, "%d%n", &first, &length) != 1 || first < 1)
+        {
+            return(0);
+        }
+        list += length;
+        last = first;
+        if (*list == 0x2d)
+        {
+            list++;
+            if (sscanf(list, "%d%n", &last, &length) != 1 || last < first)
+            {
+                return(0);
+            }
+            list += length;
+        }
+        if (*list == 0x2c)
+        {
+            list++;
+        }
+        else if (*list != 0)
+        {
+            return(0);
+        }
+
+        if (patch->changedcount == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            changed = (int (*)[2]) realloc(patch->changed, capacity * sizeof(*changed));
+            if (changed == NULL)
+            {
+                return(0);
+            }
+            patch->changed = changed;
+        }
+        patch->changed[patch->changedcount][0] = first;
+        patch->changed[patch->changedcount][1] = last;
+        patch->changedcount++;
+    }
+    return(1);
+}
+
+// reads a whole sup file, the data is allocated with malloc()
+// returns 0 when the file couldn't be read
+int readsupfile(const char *path, unsigned char **data, size_t *size)
+{
+    FILE *fp;
+    long length;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        printf("Error: the sup file \"%s\" could not be opened\n", path);
+        return(0);
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        printf("Error: the sup file \"%s\" could not be read\n", path);
+        fclose(fp);
+        return(0);
+    }
+    *size = (size_t) length;
+    *data = (unsigned char*) malloc(*size ? *size : 1);
+    if (*data == NULL || fread(*data, 1, *size, fp) != *size)
+    {
+        printf("Error: the sup file \"%s\" could not be read\n", path);
+        fclose(fp);
+        return(0);
+    }
+    fclose(fp);
+    return(1);
+}
+
+// reads the sup file to patch and the list of changed subtitles
+// returns 0 when the file can't be read or the list is not valid
+int patchopen(patchsource *patch, const char *path, const char *changed)
+{
+    memset(patch, 0, sizeof(patchsource));
+    if (!parsechanged(patch, changed))
+    {
+        printf("Error: invalid list of changed subtitles: %s\n", changed);
+        return(0);
+    }
+    return readsupfile(path, &patch->data, &patch->size);
+}
+
+void patchclose(patchsource *patch)
+{
+    free(patch->data);
+    free(patch->changed);
+    memset(patch, 0, sizeof(patchsource));
+}
+
+// one of the subtitles of the display set is in the list of changed subtitles
+int patchchanged(const patchsource *patch, const displayset *ds)
+{
+    int i, j;
+
+    for (i = 0; i < ds->count; i++)
+    {
+        for (j = 0; j < patch->changedcount; j++)
+        {
+            if (ds->subtitles[i].number >= patch->changed[j][0] && ds->subtitles[i].number <= patch->changed[j][1])
+            {
+                return(1);
+            }
+        }
+    }
+    return(0);
+}
+
+// reads the PCS at pos, returns 0 when there is no complete PCS
+int patchpcs(const patchsource *patch, size_t pos, pgs_segment *pcs)
+{
+    return pgs_segment_parse(patch->data + pos, patch->size - pos, pcs) > 0 && pcs->type == PGS_SEGMENT_PCS && pcs->size >= 11;
+}
+
+// returns the end of the display sets starting at pos, which is the next epoch start or acquisition point
+// returns 0 when the segments are not valid
+size_t patchend(const patchsource *patch, size_t pos)
+{
+    pgs_segment segment;
+    size_t length;
+    size_t start;
+
+    start = pos;
+    while (pos < patch->size)
+    {
+        length = pgs_segment_parse(patch->data + pos, patch->size - pos, &segment);
+        if (length == 0)
+        {
+            return(0);
+        }
+        if (pos > start && segment.type == PGS_SEGMENT_PCS && segment.size >= 11 && (segment.payload[7] & 0xc0) != 0)
+        {
+            break;
+        }
+        pos += length;
+    }
+    return(pos);
+}
+
+// copies the display sets of the subtitles from the patched sup file
+// they are matched by the start time, the display sets of changed or removed subtitles before it are skipped
+// the windows and the clearing display set are set up like encodedisplayset() does, the writer numbers and times them
+// returns 0 when the subtitles are not in the sup file or its display sets show a different number of objects
+int copydisplayset(displayset *ds, patchsource *patch, const encoderoptions *options)
+{
+    pgs_segment segment;
+    size_t t, end, mainend, length;
+    long startpts, clearpts, endtime;
+    int objects, maxobjects, i;
+
+    end = 0;
+
+    // times (ms) of the subtitles, overlapping subtitles are cut at the start of the next one
+    startpts = ds->subtitles[0].start;
+    clearpts = 0;
+    for (i = 0; i < ds->count; i++)
+    {
+        logprintf(ds, "Info: copying subtitle %d... (%s - %s)\n", ds->subtitles[i].number, ds->subtitles[i].starttime, ds->subtitles[i].endtime);
+        startpts = ds->subtitles[i].start < startpts ? ds->subtitles[i].start : startpts;
+    }
+    for (i = 0; i < ds->count; i++)
+    {
+        endtime = ds->subtitles[i].end;
+        if (ds->cut >= 0 && ds->cut > ds->subtitles[i].start && (ds->count == 1 || ds->cut > ds->subtitles[1 - i].start))
+        {
+            endtime = endtime > ds->cut ? ds->cut : endtime;
+        }
+        clearpts = endtime > clearpts ? endtime : clearpts;
+    }
+    startpts *= 90;
+    clearpts *= 90;
+
+    while (patch->pos < patch->size)
+    {
+        if (!patchpcs(patch, patch->pos, &segment) || (end = patchend(patch, patch->pos)) == 0)
+        {
+            logprintf(ds, "Warning: the patched sup file is not valid at byte %lu\n", (unsigned long) patch->pos);
+            return(0);
+        }
+        if ((long) segment.pts >= startpts)
+        {
+            break;
+        }
+        patch->pos = end;
+    }
+
+    // display sets may have been delayed by a few frames to be decoded in time
+    if (patch->pos >= patch->size || (long) segment.pts >= startpts + 90000)
+    {
+        logprintf(ds, "Warning: subtitle %d is not in the patched sup file at %s, it should be listed as changed (-c)\n", ds->number, ds->subtitles[0].starttime);
+        return(0);
+    }
+    if ((int) ((segment.payload[0] << 8) | segment.payload[1]) != options->width ||
+        (int) ((segment.payload[2] << 8) | segment.payload[3]) != options->height)
+    {
+        logprintf(ds, "Warning: the video size of the patched sup file is %dx%d\n",
+                  (segment.payload[0] << 8) | segment.payload[1], (segment.payload[2] << 8) | segment.payload[3]);
+        return(0);
+    }
+
+    // the windows of the epoch and the display sets up to the one clearing the screen
+    objects = 0;
+    maxobjects = 0;
+    mainend = patch->pos;
+    ds->windowcount = 0;
+    ds->bitmapsize = 0;
+    for (t = patch->pos; t < end; t += length)
+    {
+        length = pgs_segment_parse(patch->data + t, end - t, &segment);
+        switch (segment.type)
+        {
+            case PGS_SEGMENT_PCS:
+                objects = segment.size >= 11 ? segment.payload[10] : 0;
+                maxobjects = objects > maxobjects ? objects : maxobjects;
+                break;
+
+            case PGS_SEGMENT_WDS:
+                if (ds->windowcount == 0 && segment.size >= 1 && segment.payload[0] <= MAX_SUBTITLES &&
+                    segment.size >= 1 + (size_t) segment.payload[0] * 9)
+                {
+                    for (i = 0; i < segment.payload[0]; i++)
+                    {
+                        ds->windows[i].x = (segment.payload[2 + i * 9] << 8) | segment.payload[3 + i * 9];
+                        ds->windows[i].y = (segment.payload[4 + i * 9] << 8) | segment.payload[5 + i * 9];
+                        ds->windows[i].width = (segment.payload[6 + i * 9] << 8) | segment.payload[7 + i * 9];
+                        ds->windows[i].height = (segment.payload[8 + i * 9] << 8) | segment.payload[9 + i * 9];
+                    }
+                    ds->windowcount = segment.payload[0];
+                }
+                break;
+
+            case PGS_SEGMENT_ODS:
+                if (segment.size >= 7 && (segment.payload[3] & 0x80))
+                {
+                    ds->bitmapsize += (segment.payload[4] << 16) | (segment.payload[5] << 8) | segment.payload[6];
+                }
+                break;
+
+            case PGS_SEGMENT_END:
+                if (objects > 0)
+                {
+                    mainend = t + length;
+                }
+                break;
+        }
+    }
+    if (ds->windowcount == 0 || mainend == patch->pos)
+    {
+        logprintf(ds, "Warning: the patched sup file has no windows or objects for subtitle %d\n", ds->number);
+        return(0);
+    }
+
+    // every subtitle is an object of its own, two subtitles are shown in one or two windows
+    if (maxobjects != ds->count || ds->windowcount > ds->count)
+    {
+        logprintf(ds, "Warning: the patched sup file shows %d object(s) in %d window(s) at %s, subtitle %d has %d\n",
+                  maxobjects, ds->windowcount, ds->subtitles[0].starttime, ds->number, ds->count);
+        return(0);
+    }
+
+    if (!reservebuffer((void**) &ds->supdata, &ds->supcapacity, mainend - patch->pos + CLEAR_SIZE))
+    {
+        logprintf(ds, "Error: out of memory\n");
+        return(0);
+    }
+    memcpy(ds->supdata, patch->data + patch->pos, mainend - patch->pos);
+    ds->cleart = (int) (mainend - patch->pos);
+
+    // the frame rate of the options applies to the copied display sets as well
+    for (t = 0; t < (size_t) ds->cleart; t += 13 + (((unsigned char) ds->supdata[t + 11] << 8) | (unsigned char) ds->supdata[t + 12]))
+    {
+        if ((unsigned char) ds->supdata[t + 10] == PGS_SEGMENT_PCS)
+        {
+            ds->supdata[t + 17] = (char) options->framerate;
+        }
+    }
+
+    ds->supt = ds->cleart + writeclear(ds->supdata + ds->cleart, clearpts, options, ds->windows, ds->windowcount);
+    ds->startpts = startpts;
+    ds->endpts = clearpts;
+    ds->status = 1;
+    patch->pos = end;
+    return(1);
+}
+
+// copies the display sets when patching and none of the subtitles changed
+// display sets which can't be copied are encoded like changed ones, the result is the same as a full encode
+// returns 0 when the display set must be encoded
+int patchdisplayset(patchsource *patch, displayset *ds, const encoderoptions *options)
+{
+    if (patch == NULL)
+    {
+        return(0);
+    }
+    if (patchchanged(patch, ds) || !copydisplayset(ds, patch, options))
+    {
+        patch->encoded++;
+        return(0);
+    }
+    ds->copied = 1;
+    patch->copied++;
+    return(1);
+}
+
+// state of the PGS stream, subtitles are encoded independently and tied together by the writer
+typedef struct
+{
+    // next composition number (16-bit)
+    int composition;
+
+    // next palette and object version of the current epoch
+    int paletteversion;
+    int objectversion;
+
+    // end time and windows of the last display set
+    long endpts;
+    displaywindow windows[MAX_SUBTITLES];
+    int windowcount;
+
+    // display set clearing the last subtitle, written once it is known
+    // whether the next subtitle starts right away
+    char clear[CLEAR_SIZE];
+    int clearsize;
+    int clearnumber;
+
+    // decoder model: video size, duration of a frame (90 kHz)
+    // and presentation time of the last display set, the decoder is busy with it until then
+    int width;
+    int height;
+    double frameticks;
+    long presented;
+
+    // number of display sets which were delayed to be decoded in time
+    int delayed;
+
+    // bytes written and the seek index of the epoch starts and acquisition points, NULL without index (-x)
+    uint64_t offset;
+    pgs_index *index;
+} pgsstream;
+
+void pgsstreaminit(pgsstream *stream, const encoderoptions *options)
+{
+    memset(stream, 0, sizeof(pgsstream));
+    stream->width = options->width;
+    stream->height = options->height;
+    stream->frameticks = options->frameticks;
+}
+
+// returns the PTS of the segment at p
+uint32_t segmentpts(const char *p)
+{
+    return ((uint32_t) (unsigned char) p[2] << 24) | ((uint32_t) (unsigned char) p[3] << 16) |
+           ((uint32_t) (unsigned char) p[4] << 8) | (unsigned char) p[5];
+}
+
+void settimes(char *p, long pts, long dts)
+{
+    longtobyte(pts, &p[2], &p[3], &p[4], &p[5]);
+    longtobyte(dts, &p[6], &p[7], &p[8], &p[9]);
+}
+
+// sets the decoding and presentation times of the display sets in stream order (see DECODE_TICKS)
+// the decoder handles one display set at a time: the plane is initialized at an epoch start,
+// the objects are decoded one after the other and the windows are drawn until the presentation time
+// display sets which can't be decoded after the last one was presented are delayed to the first frame possible
+void pgsstreamtime(pgsstream *stream, char *supdata, int size, int number)
+{
+    const unsigned char *d;
+    long pts, dts, init, decode, draw, objectdts, objectdecode, delay;
+    int t, start, segmentsize;
+    int frames;
+
+    d = (const unsigned char*) supdata;
+    for (start = 0; start + 13 <= size; start = t)
+    {
+        // timing of the display set from the PCS up to END
+        pts = ((long) d[start + 2] << 24) | ((long) d[start + 3] << 16) | ((long) d[start + 4] << 8) | d[start + 5];
+        init = d[start + 20] == 0x80 ? TRANSFER_TICKS((long) stream->width * stream->height) : 0;
+        decode = 0;
+        draw = 0;
+        for (t = start; t + 13 <= size; t += 13 + segmentsize)
+        {
+            segmentsize = (d[t + 11] << 8) | d[t + 12];
+            if (d[t + 10] == 0x15 && (d[t + 16] & 0x80))
+            {
+                decode += DECODE_TICKS((long) ((d[t + 20] << 8) | d[t + 21]) * ((d[t + 22] << 8) | d[t + 23]));
+            }
+            else if (d[t + 10] == 0x17)
+            {
+                for (frames = 0; frames < d[t + 13]; frames++)
+                {
+                    draw += TRANSFER_TICKS((long) ((d[t + 19 + frames * 9] << 8) | d[t + 20 + frames * 9]) *
+                                           ((d[t + 21 + frames * 9] << 8) | d[t + 22 + frames * 9]));
+                }
+            }
+            else if (d[t + 10] == 0x80)
+            {
+                t += 13 + segmentsize;
+                break;
+            }
+        }
+
+        if (pts - init - decode - draw < stream->presented)
+        {
+            // first frame after the decoder is done
+            delay = (long) ceil(ceil((stream->presented + init + decode + draw) / stream->frameticks) * stream->frameticks) - pts;
+            frames = (int) ceil(delay / stream->frameticks);
+            printf("Warning: a display set of subtitle %d (%ld:%02ld:%02ld.%03ld) can't be decoded in time, it is delayed by %ld ms (%d frames)\n",
+                   number, pts / 324000000, pts / 5400000 % 60, pts / 90000 % 60, pts / 90 % 1000, (delay + 89) / 90, frames);
+            pts += delay;
+            stream->delayed++;
+        }
+
+        dts = pts - init - decode - draw;
+        objectdts = dts + init;
+        objectdecode = 0;
+        for (t = start; t + 13 <= size; t += 13 + segmentsize)
+        {
+            segmentsize = (d[t + 11] << 8) | d[t + 12];
+            switch (d[t + 10])
+            {
+                case 0x16:
+                    settimes(supdata + t, pts, dts);
+                    break;
+
+                case 0x17:
+                    // windows are drawn after all objects are decoded
+                    settimes(supdata + t, dts + init + decode, dts);
+                    break;
+
+                case 0x14:
+                    settimes(supdata + t, dts, dts);
+                    break;
+
+                case 0x15:
+                    // all segments of a split object have the times of the object
+                    if (d[t + 16] & 0x80)
+                    {
+                        objectdecode = DECODE_TICKS((long) ((d[t + 20] << 8) | d[t + 21]) * ((d[t + 22] << 8) | d[t + 23]));
+                    }
+                    settimes(supdata + t, objectdts + objectdecode, objectdts);
+                    if (d[t + 16] & 0x40)
+                    {
+                        objectdts += objectdecode;
+                    }
+                    break;
+
+                case 0x80:
+                    settimes(supdata + t, dts + init + decode, dts + init + decode);
+                    break;
+            }
+            if (d[t + 10] == 0x80)
+            {
+                t += 13 + segmentsize;
+                break;
+            }
+        }
+
+        stream->presented = pts;
+    }
+}
+
+// writes the pending display set which clears the screen
+// returns 0 when the PGS file couldn't be written
+int pgsstreamflush(pgsstream *stream, FILE *fp)
+{
+    char b1, b2;
+
+    if (stream->clearsize == 0)
+    {
+        return(1);
+    }
+
+    // composition number of the PCS
+    inttobyte(stream->composition, &b1, &b2);
+    stream->clear[18] = b1;
+    stream->clear[19] = b2;
+    stream->composition = (stream->composition + 1) & 0xffff;
+    pgsstreamtime(stream, stream->clear, stream->clearsize, stream->clearnumber);
+
+    if (fwrite(stream->clear, sizeof(char), stream->clearsize, fp) != (size_t) stream->clearsize)
+    {
+        printf("Error: the sup file could not be written\n");
+        return(0);
+    }
+    stream->offset += stream->clearsize;
+    stream->clearsize = 0;
+    return(1);
+}
+
+// numbers the segments of the display sets in stream order
+// every subtitle starts with an epoch start, or an acquisition point when it continues the epoch of the last subtitle
+void pgsstreamnumber(pgsstream *stream, char *supdata, int size, int acquisition)
+{
+    char b1, b2;
+    int t, segmentsize, first;
+
+    first = 1;
+    for (t = 0; t + 13 <= size; t += 13 + segmentsize)
+    {
+        segmentsize = ((unsigned char) supdata[t + 11] << 8) | (unsigned char) supdata[t + 12];
+        switch ((unsigned char) supdata[t + 10])
+        {
+            case 0x16:
+                inttobyte(stream->composition, &b1, &b2);
+                supdata[t + 18] = b1;
+                supdata[t + 19] = b2;
+                stream->composition = (stream->composition + 1) & 0xffff;
+                if (first)
+                {
+                    supdata[t + 20] = acquisition ? 0x40 : (char) 0x80;
+                    first = 0;
+                }
+                break;
+
+            case 0x14:
+                supdata[t + 14] = (char) stream->paletteversion;
+                stream->paletteversion++;
+                break;
+
+            case 0x15:
+                // all segments of a split object have the same version
+                supdata[t + 15] = (char) stream->objectversion;
+                break;
+        }
+    }
+    stream->objectversion++;
+}
+
+// counts the palette definitions of the display sets
+int palettecount(const char *supdata, int size)
+{
+    int t, segmentsize, count;
+
+    count = 0;
+    for (t = 0; t + 13 <= size; t += 13 + segmentsize)
+    {
+        segmentsize = ((unsigned char) supdata[t + 11] << 8) | (unsigned char) supdata[t + 12];
+        if ((unsigned char) supdata[t + 10] == 0x14)
+        {
+            count++;
+        }
+    }
+    return(count);
+}
+
+// prints the messages of the display set and appends it to the PGS file
+// returns 0 when the display set couldn't be encoded
+int writedisplayset(displayset *ds, pgsstream *stream, FILE *fp)
+{
+    int writtenbyte;
+    int contiguous, acquisition;
+
+    fwrite(ds->log, sizeof(char), ds->logsize, stdout);
+    if (!ds->status)
+    {
+        return(0);
+    }
+
+    // overlapping subtitles share a display set, a display set starting earlier is out of order
+    if (ds->startpts < stream->endpts)
+    {
+        printf("Error: subtitle %d starts before the previous subtitle ends, the subtitles must be ordered by their start time\n", ds->number);
+        return(0);
+    }
+
+    // a subtitle starting when the last one ends replaces it, the screen doesn't need to be cleared
+    contiguous = stream->clearsize > 0 && ds->startpts == stream->endpts;
+    if (contiguous)
+    {
+        stream->clearsize = 0;
+        printf("Info: subtitle %d replaces the previous subtitle without clearing the screen\n", ds->number);
+    }
+    else if (!pgsstreamflush(stream, fp))
+    {
+        return(0);
+    }
+
+    // the epoch continues when the windows stay the same, the versions must not wrap around
+    acquisition = contiguous &&
+        ds->windowcount == stream->windowcount &&
+        memcmp(ds->windows, stream->windows, ds->windowcount * sizeof(displaywindow)) == 0 &&
+        stream->objectversion < 256 &&
+        stream->paletteversion + palettecount(ds->supdata, ds->cleart) <= 256;
+    if (!acquisition)
+    {
+        stream->paletteversion = 0;
+        stream->objectversion = 0;
+    }
+    pgsstreamnumber(stream, ds->supdata, ds->cleart, acquisition);
+    pgsstreamtime(stream, ds->supdata, ds->cleart, ds->number);
+
+    // every subtitle starts with an epoch start or acquisition point a decoder can start at
+    if (stream->index && !pgs_index_add(stream->index, segmentpts(ds->supdata), stream->offset))
+    {
+        printf("Error: out of memory\n");
+        return(0);
+    }
+
+    // append display set to PGS file
+    writtenbyte = fwrite(ds->supdata, sizeof(char), ds->cleart, fp);
+    if (writtenbyte != ds->cleart)
+    {
+        printf("Error: the sup file could not be written\n");
+        return(0);
+    }
+    stream->offset += ds->cleart;
+
+    // keep the clearing display set until the next subtitle is known
+    memcpy(stream->clear, ds->supdata + ds->cleart, ds->supt - ds->cleart);
+    stream->clearsize = ds->supt - ds->cleart;
+    stream->clearnumber = ds->number;
+    stream->endpts = ds->endpts;
+    memcpy(stream->windows, ds->windows, sizeof(stream->windows));
+    stream->windowcount = ds->windowcount;
+
+    printf("Info: subtitle %d was included (%d bytes, bitmap: %d bytes)...\n", ds->number, ds->supt, ds->bitmapsize);
+    printf("\n");
+    return(1);
+}
+
+// reads the subtitles of the manifest into display sets
+// one subtitle is read ahead, subtitles overlapping in time share a display set
+typedef struct
+{
+    manifest *xml;
+    subtitle next;
+    int hasnext;
+    int number;
+
+    // a subtitle put back behind next, it is read after it
+    subtitle after;
+    int hasafter;
+
+    // only forced subtitles are read, the others are skipped but keep their numbers
+    int forcedonly;
+
+    // message of the last failed read
+    const char *error;
+} subtitlereader;
+
+void subtitlereaderinit(subtitlereader *reader, manifest *xml)
+{
+    memset(reader, 0, sizeof(subtitlereader));
+    reader->xml = xml;
+}
+
+void subtitlereaderfree(subtitlereader *reader)
+{
+    subtitlefree(&reader->next);
+    reader->hasnext = 0;
+    subtitlefree(&reader->after);
+    reader->hasafter = 0;
+}
+
+// reads the next subtitle ahead unless there already is one
+// returns 1 when there is a subtitle, 0 at the end of the manifest, -1 on error
+int subtitlereaderpeek(subtitlereader *reader)
+{
+    manifestentry entry;
+    int status;
+
+    if (reader->hasnext)
+    {
+        return(1);
+    }
+    if (reader->hasafter)
+    {
+        reader->next = reader->after;
+        reader->hasnext = 1;
+        memset(&reader->after, 0, sizeof(subtitle));
+        reader->hasafter = 0;
+        return(1);
+    }
+    do
+    {
+        status = manifestnext(reader->xml, &entry);
+        if (status != 1)
+        {
+            reader->error = reader->xml->error;
+            return(status);
+        }
+        reader->number++;
+    }
+    while (reader->forcedonly && strncmp(entry.view, "forced", 6) != 0);
+    if (!subtitleinit(&reader->next, reader->number, &entry))
+    {
+        subtitlefree(&reader->next);
+        reader->error = "Error: out of memory";
+        return(-1);
+    }
+    if (reader->next.start < 0 || reader->next.end < 0)
+    {
+        manifesterror(reader->xml, reader->next.start < 0 ? "the starttime is not a valid time" : "the endtime is not a valid time");
+        subtitlefree(&reader->next);
+        reader->error = reader->xml->error;
+        return(-1);
+    }
+    reader->hasnext = 1;
+    return(1);
+}
+
+// subtitles are shown at the same time
+int subtitlesoverlap(const subtitle *a, const subtitle *b)
+{
+    return a->start < b->end && b->start < a->end;
+}
+
+// moves the next subtitle into the display set and groups the subtitles overlapping it
+// the display set must be zeroed or cleared by displaysetclear() before
+// returns 1 when a display set was read, 0 at the end of the manifest, -1 on error
+int readdisplayset(subtitlereader *reader, displayset *ds)
+{
+    char message[128];
+    int status;
+
+    status = subtitlereaderpeek(reader);
+    if (status != 1)
+    {
+        return(status);
+    }
+    ds->subtitles[0] = reader->next;
+    ds->number = reader->next.number;
+    ds->count = 1;
+    ds->cut = -1;
+    memset(&reader->next, 0, sizeof(subtitle));
+    reader->hasnext = 0;
+
+    status = subtitlereaderpeek(reader);
+    if (status == -1)
+    {
+        return(-1);
+    }
+    if (status == 1 && subtitlesoverlap(&ds->subtitles[0], &reader->next))
+    {
+        ds->subtitles[1] = reader->next;
+        ds->count = 2;
+        memset(&reader->next, 0, sizeof(subtitle));
+        reader->hasnext = 0;
+
+        // a third subtitle overlapping them cuts them short, it starts a display set of its own
+        status = subtitlereaderpeek(reader);
+        if (status == -1)
+        {
+            return(-1);
+        }
+        if (status == 1 && (subtitlesoverlap(&ds->subtitles[0], &reader->next) || subtitlesoverlap(&ds->subtitles[1], &reader->next)))
+        {
+            if (reader->next.start > ds->subtitles[0].start && reader->next.start > ds->subtitles[1].start)
+            {
+                ds->cut = reader->next.start;
+            }
+            else if (reader->next.start == ds->subtitles[1].start && ds->subtitles[1].start > ds->subtitles[0].start)
+            {
+                // the second and third subtitle start together, they share the next display set
+                // and the first one is cut at their start
+                reader->after = reader->next;
+                reader->hasafter = 1;
+                reader->next = ds->subtitles[1];
+                memset(&ds->subtitles[1], 0, sizeof(subtitle));
+                ds->count = 1;
+                ds->cut = reader->next.start;
+            }
+            else
+            {
+                if (reader->next.start < ds->subtitles[1].start)
+                {
+                    snprintf(message, sizeof(message), "subtitle %d starts before subtitle %d, the subtitles must be ordered by their start time", reader->next.number, ds->subtitles[1].number);
+                }
+                else
+                {
+                    snprintf(message, sizeof(message), "subtitles %d, %d and %d start at the same time, at most %d subtitles can be shown at once", ds->subtitles[0].number, ds->subtitles[1].number, reader->next.number, MAX_SUBTITLES);
+                }
+                manifesterror(reader->xml, message);
+                reader->error = reader->xml->error;
+                return(-1);
+            }
+        }
+    }
+    return(1);
+}
+
+// a second sup file with only the forced subtitles, written in the same pass as the full track
+// it reads the manifest with a cursor of its own, display sets with the same subtitles as
+// in the full track share its encoded data, the others are encoded without the subtitles they overlap
+typedef struct
+{
+    manifest xml;
+    subtitlereader reader;
+
+    // next forced display set, it is written once the full track has passed its subtitles
+    displayset ds;
+    int pending;
+    int eof;
+
+    pgsstream stream;
+    FILE *fp;
+
+    // display sets shared with the full track and encoded for the forced track
+    int shared;
+    int encoded;
+} forcedtrack;
+
+// the display sets have the same subtitles, encoding them gives the same data
+int samedisplayset(const displayset *a, const displayset *b)
+{
+    int i;
+
+    if (a->count != b->count || a->cut != b->cut)
+    {
+        return(0);
+    }
+    for (i = 0; i < a->count; i++)
+    {
+        if (a->subtitles[i].number != b->subtitles[i].number)
+        {
+            return(0);
+        }
+    }
+    return(1);
+}
+
+// copies the encoded display sets, the segments are numbered and timed again by the stream they are written to
+// returns 0 when out of memory
+int sharedisplayset(displayset *ds, const displayset *full)
+{
+    if (!reservebuffer((void**) &ds->supdata, &ds->supcapacity, full->supt))
+    {
+        return(0);
+    }
+    memcpy(ds->supdata, full->supdata, full->supt);
+    ds->status = full->status;
+    ds->supt = full->supt;
+    ds->cleart = full->cleart;
+    ds->bitmapsize = full->bitmapsize;
+    ds->startpts = full->startpts;
+    ds->endpts = full->endpts;
+    memcpy(ds->windows, full->windows, sizeof(ds->windows));
+    ds->windowcount = full->windowcount;
+    return(1);
+}
+
+// writes the forced display sets up to the last subtitle of the full display set,
+// it must be called before the full display set is written, that changes its times
+// full is NULL at the end of the manifest, the remaining forced display sets are written
+// returns 0 on error
+int forcedtrackwrite(forcedtrack *track, const displayset *full, const encoderoptions *options)
+{
+    int status, result;
+
+    if (full != NULL && !full->status)
+    {
+        return(1);
+    }
+
+    while (1)
+    {
+        if (!track->pending)
+        {
+            status = track->eof ? 0 : readdisplayset(&track->reader, &track->ds);
+            if (status == -1)
+            {
+                printf("%s\n", track->reader.error);
+                return(0);
+            }
+            if (status == 0)
+            {
+                track->eof = 1;
+                return(1);
+            }
+            track->pending = 1;
+        }
+
+        if (full != NULL && track->ds.subtitles[track->ds.count - 1].number > full->subtitles[full->count - 1].number)
+        {
+            return(1);
+        }
+
+        if (full != NULL && samedisplayset(&track->ds, full))
+        {
+            if (!sharedisplayset(&track->ds, full))
+            {
+                printf("Error: out of memory\n");
+                return(0);
+            }
+            logprintf(&track->ds, "Info: forced track: subtitle %d shares the display sets of the full track\n", track->ds.number);
+            track->shared++;
+        }
+        else
+        {
+            logprintf(&track->ds, "Info: forced track: subtitle %d is encoded again without the subtitles it overlaps\n", track->ds.number);
+            encodedisplayset(&track->ds, options);
+            track->encoded++;
+        }
+
+        result = writedisplayset(&track->ds, &track->stream, track->fp);
+        displaysetclear(&track->ds);
+        track->pending = 0;
+        if (!result)
+        {
+            return(0);
+        }
+    }
+}
+
+// encodes and writes one display set after another
+int encodesequential(manifest *xml, const encoderoptions *options, patchsource *patch, forcedtrack *forced, pgsstream *stream, FILE *fp)
+{
+    subtitlereader reader;
+    displayset ds;
+    int status, result;
+
+    // a single display set, its buffers are reused for all subtitles
+    memset(&ds, 0, sizeof(displayset));
+    subtitlereaderinit(&reader, xml);
+
+    while ((status = readdisplayset(&reader, &ds)) == 1)
+    {
+        if (!patchdisplayset(patch, &ds, options))
+        {
+            encodedisplayset(&ds, options);
+        }
+        result = (forced == NULL || forcedtrackwrite(forced, &ds, options)) && writedisplayset(&ds, stream, fp);
+        displaysetclear(&ds);
+
+        if (!result)
+        {
+            displaysetfree(&ds);
+            subtitlereaderfree(&reader);
+            return(0);
+        }
+    }
+
+    displaysetfree(&ds);
+    subtitlereaderfree(&reader);
+
+    if (status == -1)
+    {
+        printf("%s\n", reader.error);
+        return(0);
+    }
+
+    return(1);
+}
+
+// display sets encoded by the worker threads
+// the slots are a ring buffer, a slot and its buffers are reused once its display set was written
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t queued;   // a display set was queued or the queue was closed
+    pthread_cond_t finished; // a display set was encoded
+    displayset *slots;
+    long capacity;
+    long added;              // display sets added by the reader
+    long taken;              // display sets taken by the workers
+    int closed;
+    const encoderoptions *options;
+} encoderqueue;
+
+void *encoderworker(void *arg)
+{
+    encoderqueue *queue;
+    displayset *ds;
+    queue = (encoderqueue*) arg;
+
+    while (1)
+    {
+        pthread_mutex_lock(&queue->lock);
+        while (queue->taken == queue->added && !queue->closed)
+        {
+            pthread_cond_wait(&queue->queued, &queue->lock);
+        }
+        if (queue->taken == queue->added)
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return(NULL);
+        }
+        ds = &queue->slots[queue->taken % queue->capacity];
+        queue->taken++;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (!ds->copied)
+        {
+            encodedisplayset(ds, queue->options);
+        }
+
+        pthread_mutex_lock(&queue->lock);
+        ds->finished = 1;
+        pthread_cond_broadcast(&queue->finished);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+// encodes subtitles with several worker threads, the display sets are written in manifest order
+// display sets copied from the patched sup file are passed through the queue without encoding
+// the forced track is written by this thread, its display sets which aren't shared are encoded here too
+int encodeparallel(manifest *xml, const encoderoptions *options, patchsource *patch, forcedtrack *forced, int jobs, pgsstream *stream, FILE *fp)
+{
+    encoderqueue queue;
+    pthread_t *threads;
+    subtitlereader reader;
+    displayset *ds;
+    long written;
+    int started, i;
+    int eof, status, result;
+
+    memset(&queue, 0, sizeof(encoderqueue));
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.queued, NULL);
+    pthread_cond_init(&queue.finished, NULL);
+    queue.capacity = jobs * 2;
+    queue.options = options;
+    queue.slots = (displayset*) calloc(queue.capacity, sizeof(displayset));
+    threads = (pthread_t*) malloc(jobs * sizeof(pthread_t));
+
+    status = 1;
+    result = 1;
+    started = 0;
+    subtitlereaderinit(&reader, xml);
+
+    if (queue.slots == NULL || threads == NULL)
+    {
+        printf("Error: out of memory\n");
+        result = 0;
+    }
+
+    for (i = 0; result && i < jobs; i++)
+    {
+        if (pthread_create(&threads[i], NULL, encoderworker, &queue) != 0)
+        {
+            printf("Error: could not start encoder thread\n");
+            result = 0;
+            break;
+        }
+        started++;
+    }
+
+    written = 0;
+    eof = 0;
+    while (result)
+    {
+        // keep the queue filled, only this thread adds display sets
+        while (!eof && queue.added - written < queue.capacity)
+        {
+            ds = &queue.slots[queue.added % queue.capacity];
+            status = readdisplayset(&reader, ds);
+            if (status != 1)
+            {
+                displaysetclear(ds);
+                eof = 1;
+                break;
+            }
+            patchdisplayset(patch, ds, options);
+
+            pthread_mutex_lock(&queue.lock);
+            queue.added++;
+            pthread_cond_signal(&queue.queued);
+            pthread_mutex_unlock(&queue.lock);
+        }
+
+        if (!result || written == queue.added)
+        {
+            break;
+        }
+
+        // write the oldest display set as soon as it is encoded
+        ds = &queue.slots[written % queue.capacity];
+        pthread_mutex_lock(&queue.lock);
+        while (!ds->finished)
+        {
+            pthread_cond_wait(&queue.finished, &queue.lock);
+        }
+        pthread_mutex_unlock(&queue.lock);
+
+        result = (forced == NULL || forcedtrackwrite(forced, ds, options)) && writedisplayset(ds, stream, fp);
+        displaysetclear(ds);
+        written++;
+    }
+
+    // stop the workers, display sets which weren't written are discarded
+    pthread_mutex_lock(&queue.lock);
+    queue.closed = 1;
+    pthread_cond_broadcast(&queue.queued);
+    pthread_mutex_unlock(&queue.lock);
+
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; queue.slots && i < queue.capacity; i++)
+    {
+        displaysetfree(&queue.slots[i]);
+    }
+
+    free(queue.slots);
+    free(threads);
+    pthread_cond_destroy(&queue.finished);
+    pthread_cond_destroy(&queue.queued);
+    pthread_mutex_destroy(&queue.lock);
+
+    subtitlereaderfree(&reader);
+
+    if (result && status == -1)
+    {
+        printf("%s\n", reader.error);
+        result = 0;
+    }
+
+    return(result);
+}
+
+// muxes the written sup files into a Matroska file, the forced track follows the full track
+// the sup files are read back, they are small compared to the video they are muxed with later
+// returns 0 when the Matroska file couldn't be written
+int writematroska(const char *suppath, const char *forcedpath, const char *language, const char *path)
+{
+    pgs_matroska_track tracks[2];
+    unsigned char *sup[2] = {NULL, NULL};
+    size_t supsize[2] = {0, 0};
+    unsigned char *data;
+    size_t size;
+    FILE *fp;
+    int count, status, i;
+
+    count = forcedpath ? 2 : 1;
+    status = readsupfile(suppath, &sup[0], &supsize[0]) && (forcedpath == NULL || readsupfile(forcedpath, &sup[1], &supsize[1]));
+
+    memset(tracks, 0, sizeof(tracks));
+    for (i = 0; i < count; i++)
+    {
+        tracks[i].data = sup[i];
+        tracks[i].size = supsize[i];
+        tracks[i].language = language;
+    }
+    tracks[0].isdefault = 1;
+    tracks[1].name = "Forced";
+    tracks[1].forced = 1;
 
-        // object version number
-        supdata[supt + 15] = 0x00;
+    data = NULL;
+    if (status && !pgs_matroska_mux(tracks, count, &data, &size))
+    {
+        printf("Error: out of memory\n");
+        status = 0;
+    }
+    if (status)
+    {
+        fp = fopen(path, "wb");
+        status = fp != NULL && fwrite(data, 1, size, fp) == size;
+        if (fp != NULL && fclose(fp) != 0)
+        {
+            status = 0;
+        }
+        if (!status)
+        {
+            printf("Error: the Matroska file \"%s\" could not be written\n", path);
+        }
+    }
 
-        // last in sequence flag
-        // 0x40: last in sequence
-        // 0x80: first in sequence
-        // 0xC0: first and last in sequence (0x40 | 0x80)
-        supdata[supt + 16] = 0xc0;
+    free(data);
+    free(sup[0]);
+    free(sup[1]);
+    return(status);
+}
 
-        // object data length (24-bit)
-        // size is set later
-        // supt + 17, 18 and 19
-        supdata[supt + 17] = 0x00;
+// writes the seek index next to the sup file
+// returns 0 when the index couldn't be written
+int writeindex(pgs_index *index, uint64_t supsize, const char *path)
+{
+    unsigned char *data;
+    size_t size;
+    FILE *fp;
+    int status;
 
-        // image width
-        inttobyte(png_w, &b1, &b2);
-        supdata[supt + 20] = b1;
-        supdata[supt + 21] = b2;
+    index->supsize = supsize;
+    data = (unsigned char*) malloc(pgs_index_bound(index));
+    if (data == NULL)
+    {
+        printf("Error: out of memory\n");
+        return(0);
+    }
+    size = pgs_index_serialize(index, data);
 
-        // image height
-        inttobyte(png_h, &b1, &b2);
-        supdata[supt + 22] = b1;
-        supdata[supt + 23] = b2;
+    fp = fopen(path, "wb");
+    status = fp != NULL && fwrite(data, 1, size, fp) == size;
+    if (fp != NULL && fclose(fp) != 0)
+    {
+        status = 0;
+    }
+    free(data);
 
-        // object data (variable length)
-        supt += 24;
-        bmplength = supt;
+    if (!status)
+    {
+        printf("Error: the index file \"%s\" could not be written\n", path);
+    }
+    return(status);
+}
 
-        for (y = 0; y < png_h; y++)
+void help()
+{
+    printf("Syntax: pgssup [options] <xmlfile> <outputfile>\n");
+    printf("\n");
+    printf("Options\n");
+    printf(" -s <WxH>        Size of Video frame (default: 1920x1080)\n");
+    printf(" -j <N>          Number of encoder threads, 0 uses all processors (default: 1)\n");
+    printf(" -m <matrix>     Color matrix of the palette: bt601, bt709, bt601-limited, bt709-limited (default: bt601)\n");
+    printf(" -r <fps>        Frame rate of the video: 23.976, 24, 25, 29.97, 50, 59.94 (default: 23.976)\n");
+    printf(" -p <supfile>    Patch a sup file encoded from the same manifest: only the changed subtitles are encoded,\n");
+    printf("                 the display sets of the others are copied\n");
+    printf(" -c <list>       Changed subtitles for -p, numbers and ranges like 12,15-17\n");
+    printf(" -x              Write a seek index of the epoch starts and acquisition points to <outputfile>.idx\n");
+    printf(" -f <supfile>    Also write a track of only the forced subtitles, in the same pass as the full track\n");
+    printf(" -k <mksfile>    Also write the tracks to a Matroska file (S_HDMV/PGS), the forced track is the second track\n");
+    printf(" -l <language>   ISO 639-2 language of the Matroska tracks (default: und)\n");
+    printf("\n");
+    printf("XML structure:\n");
+    printf("\n");
+    printf("FOR EXAMPLE\n");
+    printf("<pgssup defaultoffset=\"0,920\">\n");
+    printf("    <subtitle starttime=\"00:00:54.384\" endtime=\"00:00:56.932\" image=\"/home/hoge/sub00000.png\" />\n");
+    printf("    <subtitle starttime=\"00:00:59.837\" endtime=\"00:01:01.411\" offset=\"1000,50\" image=\"/home/hoge/sub00001.png\" />\n");
+    printf("    <subtitle starttime=\"00:01:10.734\" endtime=\"00:01:12.638\" view=\"forced\" image=\"/home/hoge/sub00002.png\" />\n");
+    printf("</pgssup>\n");
+    printf("\n");
+    printf("defaultoffset: Default offset of subtitles. If the offset of subtitles is null, this value will set to the subtitle. (default=0,0)\n");
+    printf("colormatrix:   Color matrix of the palette, the -m option takes precedence. (default=bt601)\n");
+    printf("offset:        the position of subtitle on the display.\n");
+    printf("view:          Subtitles will be forced to display if this property is \"forced\".\n");
+    printf("image:         This image should have less than 256 colors.\n");
+    printf("fadein:        Duration of a fade in from the start time in milliseconds, done by palette updates. (default=0)\n");
+    printf("fadeout:       Duration of a fade out up to the end time in milliseconds, done by palette updates. (default=0)\n");
+    printf("\n");
+    printf("Subtitles overlapping in time are shown together, at most 2 at the same time.\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    printf("==============================================\n");
+    printf("| PGSSUP version 0.1                         |\n");
+    printf("| Koichi Akabe 2009 <mail@vbkaisetsu.com>    |\n");
+    printf("| Last modified: 2009-01-13 (YYYY-MM-DD)     |\n");
+    printf("| License: GNU Lesser General Public License |\n");
+    printf("==============================================\n");
+    printf("\n");
+
+    int i;
+    int width, height;
+    int jobs;
+    const char *colormatrix;
+    const char *framerate;
+    const char *patchpath;
+    const char *changed;
+    const char *forcedpath;
+    const char *matroskapath;
+    const char *language;
+    int writeseekindex;
+    width = 1920;
+    height = 1080;
+    jobs = 1;
+    colormatrix = NULL;
+    framerate = "23.976";
+    patchpath = NULL;
+    changed = "";
+    forcedpath = NULL;
+    matroskapath = NULL;
+    language = "und";
+    writeseekindex = 0;
+    char xmlpath[512];
+    char outpath[512];
+    char patchfile[512];
+    char forcedfile[512];
+    char forcedsup[512];
+    char matroskafile[512];
+    char matroskamks[512];
+
+    // parse command line arguments
+    for (i = 1; i < argc - 2; i++)
+    {
+        if (argv[i][0] == 0x2d)
         {
-            colorseqcount = 1;
-            for (j = 0; j < palette_c; j++)
+            if (strcmp(argv[i], "-s") == 0)
             {
-                if (
-                    palette_r[j] == pixel[y][0] &&
-                    palette_g[j] == pixel[y][1] &&
-                    palette_b[j] == pixel[y][2] &&
-                    palette_a[j] == pixel[y][3]
-                ) {
-                    break;
+                i++;
+                sscanf(argv[i], "%dx%d", &width, &height);
+                if (width == 0 || height == 0)
+                {
+                    printf("Error: video size failed\n");
+                    return(1);
                 }
             }
-            prevpalette = j;
-            if (pixel[y][3] == 0)
-            {
-                prevpalette = 0xff;
-            }
-            for (x = 1; x < png_w; x++)
+            else if (strcmp(argv[i], "-j") == 0)
             {
-                for (j = 0; j < palette_c; j++)
-                {
-                    if (
-                        palette_r[j] == pixel[y][x * 4 + 0] &&
-                        palette_g[j] == pixel[y][x * 4 + 1] &&
-                        palette_b[j] == pixel[y][x * 4 + 2] &&
-                        palette_a[j] == pixel[y][x * 4 + 3]
-                    ) {
-                        break;
-                    }
-                }
-                if (pixel[y][x * 4 + 3] == 0)
-                {
-                    j = 0xff;
-                }
-                if (j == prevpalette)
+                i++;
+                if (sscanf(argv[i], "%d", &jobs) != 1 || jobs < 0)
                 {
-                    colorseqcount++;
-                    continue;
+                    printf("Error: number of threads failed\n");
+                    return(1);
                 }
-                else
+                if (jobs == 0)
                 {
-                    k = (double) colorseqcount / 256;
-                    if (colorseqcount >= 0x40)
+                    jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+                    if (jobs < 1)
                     {
-                        if (prevpalette != 0)
-                        {
-                            supdata[supt] = 0x00;
-                            supdata[supt + 1] = k + 0xC0;
-                            supdata[supt + 2] = colorseqcount - k * 256;
-                            supdata[supt + 3] = prevpalette;
-                            supt += 4;
-                        }
-                        else
-                        {
-                            supdata[supt] = 0x00;
-                            supdata[supt + 1] = k + 0x40;
-                            supdata[supt + 2] = colorseqcount - k * 256;
-                            supt += 3;
-                        }
+                        jobs = 1;
                     }
-                    else
-                    {
-                        if (prevpalette != 0)
-                        {
-                            if (prevpalette <= 0x39 && colorseqcount == 1)
-                            {
-                                supdata[supt] = prevpalette;
-                                supt += 1;
-                            }
-                            else if (prevpalette <= 0x39 && colorseqcount == 2)
-                            {
-                                supdata[supt] = prevpalette;
-                                supdata[supt + 1] = prevpalette;
-                                supt += 2;
-                            }
-                            else
-                            {
-                                supdata[supt] = 0x00;
-                                supdata[supt + 1] = colorseqcount + 0x80;
-                                supdata[supt + 2] = prevpalette;
-                                supt += 3;
-                            }
-                        }
-                        else
-                        {
-                            supdata[supt] = 0x00;
-                            supdata[supt + 1] = colorseqcount;
-                            supt += 2;
-                        }
-                    }
-                    prevpalette = j;
-                    colorseqcount = 1;
                 }
             }
-            j = (double) colorseqcount / 256;
-            if (colorseqcount >= 0x40)
+            else if (strcmp(argv[i], "-m") == 0)
             {
-                if (prevpalette != 0)
-                {
-                    supdata[supt] = 0x00;
-                    supdata[supt + 1] = j + 0xC0;
-                    supdata[supt + 2] = colorseqcount - j * 256;
-                    supdata[supt + 3] = prevpalette;
-                    supt += 4;
-                }
-                else
+                i++;
+                colormatrix = argv[i];
+            }
+            else if (strcmp(argv[i], "-r") == 0)
+            {
+                i++;
+                framerate = argv[i];
+            }
+            else if (strcmp(argv[i], "-p") == 0)
+            {
+                i++;
+                patchpath = argv[i];
+            }
+            else if (strcmp(argv[i], "-c") == 0)
+            {
+                i++;
+                changed = argv[i];
+            }
+            else if (strcmp(argv[i], "-f") == 0)
+            {
+                i++;
+                forcedpath = argv[i];
+            }
+            else if (strcmp(argv[i], "-k") == 0)
+            {
+                i++;
+                matroskapath = argv[i];
+            }
+            else if (strcmp(argv[i], "-l") == 0)
+            {
+                i++;
+                language = argv[i];
+                if (strlen(language) != 3 || strspn(language, "abcdefghijklmnopqrstuvwxyz") != 3)
                 {
-                    supdata[supt] = 0x00;
-                    supdata[supt + 1] = j + 0x40;
-                    supdata[supt + 2] = colorseqcount - j * 256;
-                    supt += 3;
+                    printf("Error: unknown language: %s\n", language);
+                    return(1);
                 }
             }
+            else if (strcmp(argv[i], "-x") == 0)
+            {
+                writeseekindex = 1;
+            }
+            else if (strcmp(argv[i], "-h") == 0)
+            {
+                help();
+                return(0);
+            }
             else
             {
-                if (prevpalette != 0)
-                {
-                    if (prevpalette <= 0x39 && colorseqcount == 1)
-                    {
-                        supdata[supt] = prevpalette;
-                        supt += 1;
-                    }
-                    else if (prevpalette <= 0x39 && colorseqcount == 2)
-                    {
-                        supdata[supt] = prevpalette;
-                        supdata[supt + 1] = prevpalette;
-                        supt += 2;
-                    }
-                    else
-                    {
-                        supdata[supt] = 0x00;
-                        supdata[supt + 1] = colorseqcount + 0x80;
-                        supdata[supt + 2] = prevpalette;
-                        supt += 3;
-                    }
-                }
-                else
-                {
-                    supdata[supt] = 0x00;
-                    supdata[supt + 1] = colorseqcount;
-                    supt += 2;
-                }
+                printf("Error: unknown option: %s\n", argv[i]);
+                return(1);
             }
-            supdata[supt] = 0x00;
-            supdata[supt + 1] = 0x00;
-            supt += 2;
         }
-        bmplength = supt - bmplength + 11;
-
-        if (bmplength > 65535)
+    }
+    if (argc == 1)
+    {
+        help();
+        return(0);
+    }
+    if (argc == 2)
+    {
+        if (strcmp(argv[1], "-h") == 0)
+        {
+            help();
+            return(0);
+        }
+        else
         {
-            printf("Error: subtitle picture is very complicated. (%d byte)\n", bmplength);
-            printf("       It should be less than 65537 bytes.\n");
-            free(supdata);
+            printf("Error: syntax error\n");
             return(1);
         }
+    }
 
-        // set segment size
-        inttobyte(bmplength, &b1, &b2);
-        supdata[bmplengthtarget] = b1;
-        supdata[bmplengthtarget + 1] = b2;
-
-        // set object data length (last 2 bytes)
-        inttobyte(bmplength - 7, &b1, &b2);
-        supdata[bmplengthtarget + 7] = b1; // + 6 is first byte
-        supdata[bmplengthtarget + 8] = b2;
-
-        // end of segment
-
-        // 0x80 (END)
-        supdata[supt] = 0x50;
-        supdata[supt + 1] = 0x47;
-
-        // start time
-        longtobyte(starttime, &b1, &b2, &b3, &b4);
-        supdata[supt + 2] = b1;
-        supdata[supt + 3] = b2;
-        supdata[supt + 4] = b3;
-        supdata[supt + 5] = b4;
-
-        // decoding time
-        supdata[supt + 6] = 0x00;
-        supdata[supt + 7] = 0x00;
-        supdata[supt + 8] = 0x00;
-        supdata[supt + 9] = 0x00;
-
-        // END segment type
-        supdata[supt + 10] = 0x80;
-
-        // segment size of END is always zero
-        supdata[supt + 11] = 0x00;
-        supdata[supt + 12] = 0x00;
-
-        supt += 13;
-
-        // end of segment
-
-        // 0x16 (PCS)
-        supdata[supt] = 0x50;
-        supdata[supt + 1] = 0x47;
-
-        // end time (start time, but screen is cleared)
-        longtobyte(endtime, &b1, &b2, &b3, &b4);
-        supdata[supt + 2] = b1;
-        supdata[supt + 3] = b2;
-        supdata[supt + 4] = b3;
-        supdata[supt + 5] = b4;
-
-        // decoding time
-        supdata[supt + 6] = 0x00;
-        supdata[supt + 7] = 0x00;
-        supdata[supt + 8] = 0x00;
-        supdata[supt + 9] = 0x00;
-
-        // PCS segment type
-        supdata[supt + 10] = 0x16;
-
-        // segment size (16-bit)
-        supdata[supt + 11] = 0x00;
-        supdata[supt + 12] = 0x0b;
-
-        // video dimensions
-        inttobyte(width, &b1, &b2);
-        supdata[supt + 13] = b1;
-        supdata[supt + 14] = b2;
-        inttobyte(height, &b1, &b2);
-        supdata[supt + 15] = b1;
-        supdata[supt + 16] = b2;
-
-        // frame rate (always 0x10, can be ignored)
-        supdata[supt + 17] = 0x10;
-
-        // composition number (16-bit)
-        supdata[supt + 18] = 0x00;
-        supdata[supt + 19] = 0x01;
-
-        // composition state
-        // 0x00: normal
-        // 0x40: acquisition point
-        // 0x80: epoch start
-        supdata[supt + 20] = 0x00;
-
-        // palette update flag
-        // 0x00: false
-        // 0x80: true
-        supdata[supt + 21] = 0x00;
-
-        // palette id
-        supdata[supt + 22] = 0x00;
-
-        // number of composition objects (8-bit)
-        supdata[supt + 23] = 0x00;
+    sprintf(xmlpath, "%s", argv[argc - 2]);
+    sprintf(outpath, "%s", argv[argc - 1]);
 
-        supt += 24;
+    char path[512];
+    FILE *fp;
+    manifest xml;
+    patchsource patch;
+    pgs_index index;
+    pgs_index forcedindex;
+    forcedtrack forced;
+    char indexpath[520];
+    int status;
+
+    // the manifest is streamed, every subtitle is encoded as soon as its entry is read
+    getabsolutepath(xmlpath, path);
+    if (!manifestopen(&xml, path))
+    {
+        printf("%s\n", xml.error);
+        manifestclose(&xml);
+        return(1);
+    }
 
-        // end of segment
-
-        // 0x17 (WDS)
-        supdata[supt] = 0x50;
-        supdata[supt + 1] = 0x47;
-
-        // end time (start time, but screen is cleared)
-        longtobyte(endtime, &b1, &b2, &b3, &b4);
-        supdata[supt + 2] = b1;
-        supdata[supt + 3] = b2;
-        supdata[supt + 4] = b3;
-        supdata[supt + 5] = b4;
-
-        // decoding time
-        supdata[supt + 6] = 0x00;
-        supdata[supt + 7] = 0x00;
-        supdata[supt + 8] = 0x00;
-        supdata[supt + 9] = 0x00;
-
-        // WDS segment type
-        supdata[supt + 10] = 0x17;
-
-        // segment size
-        supdata[supt + 11] = 0x00;
-        supdata[supt + 12] = 0x0a;
-
-        // number of windows
-        supdata[supt + 13] = 0x01;
+    encoderoptions options;
+    pgsstream stream;
+    options.width = width;
+    options.height = height;
+    options.doffsetx = 0;
+    options.doffsety = 0;
+    sscanf(xml.defaultoffset, "%d,%d", &options.doffsetx, &options.doffsety);
+
+    // the command line takes precedence over the manifest
+    pgs_color_matrix matrix;
+    pgs_color_range range;
+    if (colormatrix == NULL)
+    {
+        colormatrix = xml.colormatrix[0] ? xml.colormatrix : "bt601";
+    }
+    if (!pgs_color_parse(colormatrix, &matrix, &range))
+    {
+        printf("Error: unknown color matrix: %s\n", colormatrix);
+        manifestclose(&xml);
+        return(1);
+    }
+    pgs_color_table_init(&options.colors, matrix, range);
 
-        // window id
-        supdata[supt + 14] = 0x00;
+    if (!pgs_framerate_parse(framerate, &options.framerate, &options.frameticks))
+    {
+        printf("Error: unknown frame rate: %s\n", framerate);
+        manifestclose(&xml);
+        return(1);
+    }
 
-        // window position
-        inttobyte(offsetx, &b1, &b2);
-        supdata[supt + 15] = b1;
-        supdata[supt + 16] = b2;
-        inttobyte(offsety, &b1, &b2);
-        supdata[supt + 17] = b1;
-        supdata[supt + 18] = b2;
+    // the sup file to patch is read completely, it may be replaced by the output
+    if (patchpath == NULL && changed[0] != 0)
+    {
+        printf("Error: the changed subtitles need a sup file to patch (-p)\n");
+        manifestclose(&xml);
+        return(1);
+    }
+    if (patchpath)
+    {
+        sprintf(patchfile, "%s", patchpath);
+        getabsolutepath(patchfile, path);
+        if (!patchopen(&patch, path, changed))
+        {
+            patchclose(&patch);
+            manifestclose(&xml);
+            return(1);
+        }
+    }
 
-        // window dimensions
-        inttobyte(png_w, &b1, &b2);
-        supdata[supt + 19] = b1;
-        supdata[supt + 20] = b2;
-        inttobyte(png_h, &b1, &b2);
-        supdata[supt + 21] = b1;
-        supdata[supt + 22] = b2;
+    getabsolutepath(outpath, path);
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        printf("Error: the sup file \"%s\" could not be opened\n", path);
+        if (patchpath)
+        {
+            patchclose(&patch);
+        }
+        manifestclose(&xml);
+        return(1);
+    }
 
-        supt += 23;
+    // display sets are collected and written in large blocks,
+    // display sets larger than the buffer are written directly
+    setvbuf(fp, NULL, _IOFBF, 1048576);
 
-        // end of segment
+    // the forced track reads the manifest a second time, the subtitles are decoded and encoded once
+    memset(&forced, 0, sizeof(forcedtrack));
+    pgs_index_init(&forcedindex);
+    if (forcedpath)
+    {
+        sprintf(forcedfile, "%s", forcedpath);
+        getabsolutepath(forcedfile, forcedsup);
+        getabsolutepath(xmlpath, path);
+        if (!manifestopen(&forced.xml, path))
+        {
+            printf("%s\n", forced.xml.error);
+            manifestclose(&forced.xml);
+            forcedpath = NULL;
+        }
+        else if ((forced.fp = fopen(forcedsup, "wb")) == NULL)
+        {
+            printf("Error: the sup file \"%s\" could not be opened\n", forcedsup);
+            manifestclose(&forced.xml);
+            forcedpath = NULL;
+        }
+        if (forcedpath == NULL)
+        {
+            fclose(fp);
+            if (patchpath)
+            {
+                patchclose(&patch);
+            }
+            manifestclose(&xml);
+            return(1);
+        }
+        setvbuf(forced.fp, NULL, _IOFBF, 1048576);
+        subtitlereaderinit(&forced.reader, &forced.xml);
+        forced.reader.forcedonly = 1;
+        pgsstreaminit(&forced.stream, &options);
+        forced.stream.index = writeseekindex ? &forcedindex : NULL;
+        getabsolutepath(outpath, path);
+    }
 
-        // 0x80 (END)
-        supdata[supt] = 0x50;
-        supdata[supt + 1] = 0x47;
+    // iterate over all subtitles
+    pgsstreaminit(&stream, &options);
+    pgs_index_init(&index);
+    stream.index = writeseekindex ? &index : NULL;
+    if (jobs > 1)
+    {
+        status = encodeparallel(&xml, &options, patchpath ? &patch : NULL, forcedpath ? &forced : NULL, jobs, &stream, fp);
+    }
+    else
+    {
+        status = encodesequential(&xml, &options, patchpath ? &patch : NULL, forcedpath ? &forced : NULL, &stream, fp);
+    }
 
-        // end time (start time, but screen is cleared)
-        longtobyte(endtime, &b1, &b2, &b3, &b4);
-        supdata[supt + 2] = b1;
-        supdata[supt + 3] = b2;
-        supdata[supt + 4] = b3;
-        supdata[supt + 5] = b4;
+    // clear the screen after the last subtitle
+    if (status)
+    {
+        status = pgsstreamflush(&stream, fp);
+    }
 
-        // decoding time
-        supdata[supt + 6] = 0x00;
-        supdata[supt + 7] = 0x00;
-        supdata[supt + 8] = 0x00;
-        supdata[supt + 9] = 0x00;
+    if (fclose(fp) != 0 && status)
+    {
+        printf("Error: the sup file \"%s\" could not be written\n", path);
+        status = 0;
+    }
+    manifestclose(&xml);
 
-        // END segment type
-        supdata[supt + 10] = 0x80;
+    if (status && writeseekindex)
+    {
+        snprintf(indexpath, sizeof(indexpath), "%s.idx", path);
+        status = writeindex(&index, stream.offset, indexpath);
+    }
+    pgs_index_free(&index);
 
-        // segment size
-        supdata[supt + 11] = 0x00;
-        supdata[supt + 12] = 0x00;
+    // the forced subtitles after the last display set of the full track
+    if (forcedpath)
+    {
+        if (status)
+        {
+            status = forcedtrackwrite(&forced, NULL, &options) && pgsstreamflush(&forced.stream, forced.fp);
+        }
+        if (fclose(forced.fp) != 0 && status)
+        {
+            printf("Error: the sup file \"%s\" could not be written\n", forcedsup);
+            status = 0;
+        }
+        displaysetfree(&forced.ds);
+        subtitlereaderfree(&forced.reader);
+        manifestclose(&forced.xml);
 
-        supt += 13;
+        if (status && writeseekindex)
+        {
+            snprintf(indexpath, sizeof(indexpath), "%s.idx", forcedsup);
+            status = writeindex(&forcedindex, forced.stream.offset, indexpath);
+        }
+        if (status)
+        {
+            printf("Info: the forced track shares %d display sets with the full track, %d were encoded again\n", forced.shared, forced.encoded);
+            if (forced.shared + forced.encoded == 0)
+            {
+                printf("Warning: there are no forced subtitles, the forced track is empty\n");
+            }
+        }
+    }
+    pgs_index_free(&forcedindex);
 
-        // end of segment
+    if (status && matroskapath)
+    {
+        sprintf(matroskafile, "%s", matroskapath);
+        getabsolutepath(matroskafile, matroskamks);
+        status = writematroska(path, forcedpath ? forcedsup : NULL, language, matroskamks);
+    }
 
-        // clean up pixel buffers
-        free(pixel);
-        free(bmbuff);
+    if (patchpath)
+    {
+        if (status)
+        {
+            printf("Info: %d display sets were copied from the patched sup file, %d were encoded\n", patch.copied, patch.encoded);
+        }
+        patchclose(&patch);
+    }
 
-        // append display set to PGS file
-        writtenbyte = fwrite(supdata, sizeof(char), supt, fp);
-        free(supdata);
+    if (!status)
+    {
+        return(1);
+    }
 
-        printf("Info: subtitle %d was included (%d bytes, bitmap: %d bytes)...\n", i + 1, writtenbyte, bmplength - 7);
-        printf("\n");
+    if (stream.delayed + forced.stream.delayed > 0)
+    {
+        printf("Warning: %d display sets were delayed to keep within the decoding rate of Blu-ray players\n", stream.delayed + forced.stream.delayed);
     }
 
-    fclose(fp);
     printf("Complete !\n");
     return(0);
 }
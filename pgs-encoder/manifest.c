@@ -0,0 +1,524 @@
+/*
+ * pgssup manifest reader
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "manifest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TAG_ERROR -1
+#define TAG_NONE 0
+#define TAG_START 1
+#define TAG_END 2
+
+// attribute offset of a missing attribute
+#define NO_VALUE ((size_t) -1)
+
+// attributes of interest, the <subtitle> attributes are in the order of manifestentry
+#define ATTRIBUTE_COUNT 9
+#define ATTRIBUTE_DEFAULTOFFSET 7
+#define ATTRIBUTE_COLORMATRIX 8
+static const char *attributes[ATTRIBUTE_COUNT] = {
+    "starttime",
+    "endtime",
+    "offset",
+    "view",
+    "image",
+    "fadein",
+    "fadeout",
+    "defaultoffset",
+    "colormatrix",
+};
+
+static char emptyvalue[1] = {0};
+
+static int seterror(manifest *m, const char *message)
+{
+    snprintf(m->error, sizeof(m->error), "Error: %s (at byte %lu)", message, (unsigned long) m->pos);
+    return(TAG_ERROR);
+}
+
+static int isnamechar(char c)
+{
+    return
+        (c >= 'a' && c <= 'z') ||
+        (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') ||
+        c == '_' || c == '-' || c == ':' || c == '.' ||
+        (unsigned char) c >= 0x80;
+}
+
+static int isspacechar(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int startswith(const manifest *m, size_t p, const char *s)
+{
+    size_t length;
+    length = strlen(s);
+    return m->size - p >= length && memcmp(m->data + p, s, length) == 0;
+}
+
+static int nameis(const char *name, size_t length, const char *s)
+{
+    return strlen(s) == length && memcmp(name, s, length) == 0;
+}
+
+// position after the next occurrence of s, or 0 when not found
+static size_t skippast(const manifest *m, size_t p, const char *s)
+{
+    for (; p < m->size; p++)
+    {
+        if (startswith(m, p, s))
+        {
+            return p + strlen(s);
+        }
+    }
+    return(0);
+}
+
+// appends an attribute value and decodes the predefined XML entities
+// returns the offset of the value or NO_VALUE when out of memory
+static size_t appendvalue(manifest *m, const char *value, size_t length)
+{
+    static const char *entities[5] = {"&amp;", "&lt;", "&gt;", "&quot;", "&apos;"};
+    static const char characters[5] = {'&', '<', '>', '"', '\''};
+    size_t offset, i, e, entitylength;
+    char *values;
+
+    // decoded values are never longer than the original
+    if (m->valuessize + length + 1 > m->valuescapacity)
+    {
+        size_t capacity;
+        capacity = m->valuescapacity ? m->valuescapacity : 256;
+        while (capacity < m->valuessize + length + 1)
+        {
+            capacity *= 2;
+        }
+        values = (char*) realloc(m->values, capacity);
+        if (values == NULL)
+        {
+            return NO_VALUE;
+        }
+        m->values = values;
+        m->valuescapacity = capacity;
+    }
+
+    offset = m->valuessize;
+    for (i = 0; i < length; i++)
+    {
+        if (value[i] == '&')
+        {
+            for (e = 0; e < 5; e++)
+            {
+                entitylength = strlen(entities[e]);
+                if (length - i >= entitylength && memcmp(value + i, entities[e], entitylength) == 0)
+                {
+                    break;
+                }
+            }
+            if (e < 5)
+            {
+                m->values[m->valuessize++] = characters[e];
+                i += entitylength - 1;
+                continue;
+            }
+        }
+        m->values[m->valuessize++] = value[i];
+    }
+    m->values[m->valuessize++] = 0;
+
+    return offset;
+}
+
+// reads the next tag and its attributes of interest
+// text, comments, processing instructions and declarations are skipped
+static int readtag(manifest *m, size_t offsets[ATTRIBUTE_COUNT], const char **name, size_t *namelength, int *selfclosing)
+{
+    const char *d, *lt, *quote;
+    const char *attribute;
+    size_t n, p, start, attributelength;
+    int type, k;
+
+    d = m->data;
+    n = m->size;
+    p = m->pos;
+
+    for (k = 0; k < ATTRIBUTE_COUNT; k++)
+    {
+        offsets[k] = NO_VALUE;
+    }
+    m->valuessize = 0;
+
+    while (1)
+    {
+        lt = p < n ? (const char*) memchr(d + p, '<', n - p) : NULL;
+        if (lt == NULL)
+        {
+            m->pos = n;
+            return(TAG_NONE);
+        }
+        p = lt - d;
+
+        if (startswith(m, p, "<!--"))
+        {
+            p = skippast(m, p + 4, "-->");
+        }
+        else if (startswith(m, p, "<?"))
+        {
+            p = skippast(m, p + 2, "?>");
+        }
+        else if (startswith(m, p, "<!"))
+        {
+            p = skippast(m, p + 2, ">");
+        }
+        else
+        {
+            break;
+        }
+
+        if (p == 0)
+        {
+            return seterror(m, "XML is not valid, unterminated comment or declaration");
+        }
+    }
+
+    m->pos = p;
+    p++;
+
+    type = TAG_START;
+    if (p < n && d[p] == '/')
+    {
+        type = TAG_END;
+        p++;
+    }
+
+    start = p;
+    while (p < n && isnamechar(d[p]))
+    {
+        p++;
+    }
+    if (p == start)
+    {
+        return seterror(m, "XML is not valid, tag without name");
+    }
+    *name = d + start;
+    *namelength = p - start;
+    *selfclosing = 0;
+
+    while (1)
+    {
+        while (p < n && isspacechar(d[p]))
+        {
+            p++;
+        }
+        if (p >= n)
+        {
+            return seterror(m, "XML is not valid, unterminated tag");
+        }
+        if (d[p] == '>')
+        {
+            p++;
+            break;
+        }
+        if (type == TAG_START && d[p] == '/' && p + 1 < n && d[p + 1] == '>')
+        {
+            *selfclosing = 1;
+            p += 2;
+            break;
+        }
+        if (type == TAG_END)
+        {
+            return seterror(m, "XML is not valid, attributes in closing tag");
+        }
+
+        // attribute name
+        start = p;
+        while (p < n && isnamechar(d[p]))
+        {
+            p++;
+        }
+        if (p == start)
+        {
+            return seterror(m, "XML is not valid, unexpected character in tag");
+        }
+        attribute = d + start;
+        attributelength = p - start;
+
+        // ="value" or ='value'
+        while (p < n && isspacechar(d[p]))
+        {
+            p++;
+        }
+        if (p >= n || d[p] != '=')
+        {
+            return seterror(m, "XML is not valid, attribute without value");
+        }
+        p++;
+        while (p < n && isspacechar(d[p]))
+        {
+            p++;
+        }
+        if (p >= n || (d[p] != '"' && d[p] != '\''))
+        {
+            return seterror(m, "XML is not valid, attribute value without quotes");
+        }
+        quote = (const char*) memchr(d + p + 1, d[p], n - p - 1);
+        if (quote == NULL)
+        {
+            return seterror(m, "XML is not valid, unterminated attribute value");
+        }
+
+        for (k = 0; k < ATTRIBUTE_COUNT; k++)
+        {
+            if (offsets[k] == NO_VALUE && nameis(attribute, attributelength, attributes[k]))
+            {
+                offsets[k] = appendvalue(m, d + p + 1, quote - (d + p + 1));
+                if (offsets[k] == NO_VALUE)
+                {
+                    return seterror(m, "out of memory");
+                }
+                break;
+            }
+        }
+
+        p = quote - d + 1;
+    }
+
+    m->pos = p;
+    return(type);
+}
+
+static char *value(manifest *m, size_t offset)
+{
+    return offset == NO_VALUE ? emptyvalue : m->values + offset;
+}
+
+// keeps a copy of an attribute value of the root tag
+static int copyvalue(manifest *m, char **target, size_t offset)
+{
+    char *copy;
+    const char *v;
+
+    v = value(m, offset);
+    copy = (char*) realloc(*target, strlen(v) + 1);
+    if (copy == NULL)
+    {
+        seterror(m, "out of memory");
+        return(0);
+    }
+    strcpy(copy, v);
+    *target = copy;
+    return(1);
+}
+
+// processes <pgssup> and </pgssup>
+static int roottag(manifest *m, int type, int selfclosing, size_t offsets[ATTRIBUTE_COUNT])
+{
+    if (type == TAG_START)
+    {
+        if (m->depth != 0)
+        {
+            seterror(m, "the pgssup tag should be in the root");
+            return(0);
+        }
+
+        if (!copyvalue(m, &m->defaultoffset, offsets[ATTRIBUTE_DEFAULTOFFSET]) ||
+            !copyvalue(m, &m->colormatrix, offsets[ATTRIBUTE_COLORMATRIX]))
+        {
+            return(0);
+        }
+
+        if (!selfclosing)
+        {
+            m->depth = 1;
+        }
+    }
+    else
+    {
+        if (m->depth != 1)
+        {
+            seterror(m, "XML syntax is wrong");
+            return(0);
+        }
+        m->depth = 0;
+    }
+
+    return(1);
+}
+
+int manifestopen(manifest *m, const char *path)
+{
+    struct stat st;
+    int fd;
+    int type, selfclosing;
+    size_t offsets[ATTRIBUTE_COUNT];
+    const char *name;
+    size_t namelength;
+    void *data;
+
+    memset(m, 0, sizeof(manifest));
+
+    m->defaultoffset = (char*) calloc(1, 1);
+    m->colormatrix = (char*) calloc(1, 1);
+    if (m->defaultoffset == NULL || m->colormatrix == NULL)
+    {
+        snprintf(m->error, sizeof(m->error), "Error: out of memory");
+        return(0);
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        snprintf(m->error, sizeof(m->error), "Error: xml file \"%s\" opening failed", path);
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return(0);
+    }
+
+    // empty files can't be mapped, but are a valid manifest without entries
+    if (st.st_size > 0)
+    {
+        data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            snprintf(m->error, sizeof(m->error), "Error: xml file \"%s\" mapping failed", path);
+            close(fd);
+            return(0);
+        }
+        posix_madvise(data, (size_t) st.st_size, POSIX_MADV_SEQUENTIAL);
+        m->data = (const char*) data;
+        m->size = (size_t) st.st_size;
+    }
+    close(fd);
+
+    // read up to the root tag, the default offset and the color matrix must be known before the first entry
+    while (1)
+    {
+        type = readtag(m, offsets, &name, &namelength, &selfclosing);
+        if (type == TAG_ERROR)
+        {
+            return(0);
+        }
+        if (type == TAG_NONE)
+        {
+            return(1);
+        }
+        if (nameis(name, namelength, "pgssup"))
+        {
+            return roottag(m, type, selfclosing, offsets);
+        }
+        if (nameis(name, namelength, "subtitle"))
+        {
+            seterror(m, "the subtitle tag should be in the pgssup tag");
+            return(0);
+        }
+    }
+}
+
+int manifestnext(manifest *m, manifestentry *entry)
+{
+    int type, selfclosing;
+    size_t offsets[ATTRIBUTE_COUNT];
+    char message[64];
+    const char *name;
+    size_t namelength;
+
+    while (1)
+    {
+        type = readtag(m, offsets, &name, &namelength, &selfclosing);
+        if (type == TAG_ERROR)
+        {
+            return(-1);
+        }
+        if (type == TAG_NONE)
+        {
+            if (m->depth != 0)
+            {
+                seterror(m, "XML is not valid, unclosed tag at the end of the file");
+                return(-1);
+            }
+            return(0);
+        }
+
+        if (nameis(name, namelength, "subtitle"))
+        {
+            if (type == TAG_END)
+            {
+                if (m->depth != 2)
+                {
+                    seterror(m, "XML syntax is wrong");
+                    return(-1);
+                }
+                m->depth = 1;
+                continue;
+            }
+
+            if (m->depth != 1)
+            {
+                seterror(m, "the subtitle tag should be in the pgssup tag");
+                return(-1);
+            }
+            if (!selfclosing)
+            {
+                m->depth = 2;
+            }
+
+            // an entry can't be shown without its times and image
+            if (offsets[0] == NO_VALUE || offsets[1] == NO_VALUE || offsets[4] == NO_VALUE)
+            {
+                snprintf(message, sizeof(message), "the subtitle tag has no %s attribute",
+                         attributes[offsets[0] == NO_VALUE ? 0 : offsets[1] == NO_VALUE ? 1 : 4]);
+                seterror(m, message);
+                return(-1);
+            }
+
+            entry->starttime = value(m, offsets[0]);
+            entry->endtime = value(m, offsets[1]);
+            entry->offset = value(m, offsets[2]);
+            entry->view = value(m, offsets[3]);
+            entry->image = value(m, offsets[4]);
+            entry->fadein = value(m, offsets[5]);
+            entry->fadeout = value(m, offsets[6]);
+            return(1);
+        }
+
+        if (nameis(name, namelength, "pgssup"))
+        {
+            if (!roottag(m, type, selfclosing, offsets))
+            {
+                return(-1);
+            }
+        }
+
+        // other tags are ignored
+    }
+}
+
+void manifesterror(manifest *m, const char *message)
+{
+    seterror(m, message);
+}
+
+void manifestclose(manifest *m)
+{
+    if (m->data)
+    {
+        munmap((void*) m->data, m->size);
+    }
+    free(m->values);
+    free(m->defaultoffset);
+    free(m->colormatrix);
+    memset(m, 0, sizeof(manifest));
+}
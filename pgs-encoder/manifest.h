@@ -0,0 +1,66 @@
+/*
+ * pgssup manifest reader
+ *
+ * Streams the <subtitle> entries of the XML manifest from a memory-mapped file.
+ * Entries are handled one at a time, there are no limits on the number of
+ * entries or the length of attribute values.
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stddef.h>
+
+// a single <subtitle> entry
+// the strings are valid until the next entry is read, missing attributes are empty strings
+// starttime, endtime and image are required, an entry without them is an error
+typedef struct
+{
+    char *starttime;
+    char *endtime;
+    char *offset;
+    char *view;
+    char *image;
+    char *fadein;
+    char *fadeout;
+} manifestentry;
+
+typedef struct
+{
+    // memory-mapped manifest file
+    const char *data;
+    size_t size;
+    size_t pos;
+
+    // 0: outside of the root, 1: inside <pgssup>, 2: inside <subtitle>
+    int depth;
+
+    // defaultoffset attribute of the root tag (empty when not present)
+    char *defaultoffset;
+
+    // colormatrix attribute of the root tag (empty when not present)
+    char *colormatrix;
+
+    // decoded attribute values of the current tag
+    char *values;
+    size_t valuessize;
+    size_t valuescapacity;
+
+    // error message of the last failed operation
+    char error[256];
+} manifest;
+
+// maps the manifest file and reads up to the root tag
+// returns 1 on success, 0 on error
+int manifestopen(manifest *m, const char *path);
+
+// reads the next <subtitle> entry
+// returns 1 when an entry was read, 0 at the end of the manifest, -1 on error
+int manifestnext(manifest *m, manifestentry *entry);
+
+// sets the error message for the entry read last, with the byte offset after it
+void manifesterror(manifest *m, const char *message);
+
+void manifestclose(manifest *m);
+
+#endif // MANIFEST_H
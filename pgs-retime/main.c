@@ -0,0 +1,457 @@
+/*
+ * pgsretime
+ *
+ * Rewrites the timestamps of a PGS subtitle stream (.sup) with a constant
+ * offset, a scale and an edit list. The segments are copied untouched
+ * apart from their timestamps and the frame rate of the PCS.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <pgs/decoder.h>
+#include <pgs/timing.h>
+
+typedef struct
+{
+    pgs_timemap map;
+
+    // frame rate code written to every PCS, 0 keeps the frame rate of the stream
+    int framerate;
+    double frameticks;
+} retimeoptions;
+
+typedef struct
+{
+    // segments of the display set from the PCS up to END
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+
+    // presentation time of the last display set, the decoder is busy with it until then
+    int64_t presented;
+
+    int number;
+    int delayed;
+} retimestate;
+
+uint32_t read32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+void write32(unsigned char *p, uint32_t value)
+{
+    p[0] = (unsigned char) (value >> 24);
+    p[1] = (unsigned char) (value >> 16);
+    p[2] = (unsigned char) (value >> 8);
+    p[3] = (unsigned char) value;
+}
+
+void formattime(int64_t ticks, char *text, size_t size)
+{
+    long ms;
+
+    ms = (long) (ticks / 90);
+    snprintf(text, size, "%s%ld:%02ld:%02ld.%03ld", ms < 0 ? "-" : "", labs(ms) / 3600000, labs(ms) / 60000 % 60, labs(ms) / 1000 % 60, labs(ms) % 1000);
+}
+
+// parses a time as H:MM:SS.mmm or in milliseconds, offsets may have a sign
+// returns 0 when the text is not a time
+int parsetime(const char *text, int64_t *ticks)
+{
+    int h, m, s, ms, length;
+    long long value;
+    int negative;
+
+    negative = text[0] == 0x2d;
+    if (text[0] == 0x2b || text[0] == 0x2d)
+    {
+        text++;
+    }
+
+    length = 0;
+    if (strchr(text, ':') != NULL)
+    {
+        ms = 0;
+        if (sscanf(text, "%d:%2d:%2d%n.%3d%n", &h, &m, &s, &length, &ms, &length) < 3 || text[length] != 0)
+        {
+            return(0);
+        }
+        value = h * 3600000LL + m * 60000LL + s * 1000LL + ms;
+    }
+    else if (sscanf(text, "%lld%n", &value, &length) != 1 || text[length] != 0)
+    {
+        return(0);
+    }
+
+    *ticks = (negative ? -value : value) * 90;
+    return(1);
+}
+
+// parses a scale as a decimal number or a ratio like 24000/25025
+// returns 0 when the text is not a positive number
+int parsescale(const char *text, double *scale)
+{
+    double numerator, denominator;
+    int length;
+
+    length = 0;
+    if (sscanf(text, "%lf/%lf%n", &numerator, &denominator, &length) == 2 && text[length] == 0)
+    {
+        *scale = numerator / denominator;
+    }
+    else if (sscanf(text, "%lf%n", scale, &length) != 1 || text[length] != 0)
+    {
+        return(0);
+    }
+    return(*scale > 0.0 && *scale < 1000.0);
+}
+
+// reads an edit list: one "<time> <offset>" per line, ordered by time
+// empty lines and lines starting with # are skipped
+int readedits(const char *path, pgs_timemap *map)
+{
+    FILE *fp;
+    char line[256];
+    char time[64], offset[64];
+    int64_t t, o;
+    int number, extra;
+
+    fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        printf("Error: the edit list \"%s\" could not be opened\n", path);
+        return(0);
+    }
+
+    for (number = 1; fgets(line, sizeof(line), fp) != NULL; number++)
+    {
+        if (line[strspn(line, " \t\r\n")] == 0 || line[strspn(line, " \t")] == 0x23)
+        {
+            continue;
+        }
+        extra = 0;
+        if (sscanf(line, "%63s %63s %n", time, offset, &extra) != 2 || line[extra] != 0 ||
+            !parsetime(time, &t) || !parsetime(offset, &o) || t < 0)
+        {
+            printf("Error: invalid edit in line %d of \"%s\"\n", number, path);
+            fclose(fp);
+            return(0);
+        }
+        if (!pgs_timemap_add(map, t, o))
+        {
+            printf("Error: the edit in line %d of \"%s\" is not after the previous edit\n", number, path);
+            fclose(fp);
+            return(0);
+        }
+    }
+
+    fclose(fp);
+    return(1);
+}
+
+// reads the segments of the next display set
+// returns 1 when a display set was read, 0 at the end of the file, -1 on errors
+int readdisplayset(FILE *in, retimestate *state)
+{
+    unsigned char *data;
+    size_t length, capacity, got;
+
+    state->size = 0;
+    for (;;)
+    {
+        if (state->capacity - state->size < PGS_SEGMENT_HEADER_SIZE + 65535)
+        {
+            capacity = state->capacity * 2 + PGS_SEGMENT_HEADER_SIZE + 65535;
+            data = (unsigned char*) realloc(state->data, capacity);
+            if (data == NULL)
+            {
+                printf("Error: out of memory\n");
+                return(-1);
+            }
+            state->data = data;
+            state->capacity = capacity;
+        }
+
+        data = state->data + state->size;
+        got = fread(data, 1, PGS_SEGMENT_HEADER_SIZE, in);
+        if (got == 0 && state->size == 0 && feof(in))
+        {
+            return(0);
+        }
+        if (got != PGS_SEGMENT_HEADER_SIZE || data[0] != 0x50 || data[1] != 0x47)
+        {
+            printf("Error: no valid segment in display set %d\n", state->number);
+            return(-1);
+        }
+        if (state->size == 0 && data[10] != PGS_SEGMENT_PCS)
+        {
+            printf("Error: display set %d doesn't start with a composition segment\n", state->number);
+            return(-1);
+        }
+
+        length = ((size_t) data[11] << 8) | data[12];
+        if (fread(data + PGS_SEGMENT_HEADER_SIZE, 1, length, in) != length)
+        {
+            printf("Error: the last segment of display set %d is incomplete\n", state->number);
+            return(-1);
+        }
+        state->size += PGS_SEGMENT_HEADER_SIZE + length;
+        if (data[10] == PGS_SEGMENT_END)
+        {
+            return(1);
+        }
+    }
+}
+
+// moves all segments of the display set by the shift of its PCS, the decoding time before the PCS is kept
+// display sets which can't be decoded in time after the previous one are delayed to the first frame possible
+// returns 0 when the display set can't be moved
+int retimedisplayset(retimestate *state, const retimeoptions *options)
+{
+    const unsigned char *pcs;
+    unsigned char *p;
+    int64_t pts, dts, required, shift, delay;
+    double frameticks;
+    char time[32];
+    size_t t, length;
+    int timed;
+
+    pcs = state->data;
+    pts = read32(pcs + 2);
+    dts = read32(pcs + 6);
+
+    // streams of encoders without a decoder model have no decoding times
+    timed = dts != 0;
+    required = timed ? pts - dts : 0;
+
+    shift = pgs_timemap_apply(&options->map, pts) - pts;
+    if (pts + shift < 0 || pts + shift > 0xffffffffLL)
+    {
+        formattime(pts, time, sizeof(time));
+        printf("Error: display set %d (%s) is moved out of the timestamp range\n", state->number, time);
+        return(0);
+    }
+    if (pts + shift < state->presented)
+    {
+        formattime(pts, time, sizeof(time));
+        printf("Error: display set %d (%s) is moved before the previous display set, check the edits\n", state->number, time);
+        return(0);
+    }
+    if (pts + shift - required < state->presented)
+    {
+        frameticks = options->framerate ? options->frameticks : pgs_framerate_ticks(pcs[17]);
+        frameticks = frameticks > 0.0 ? frameticks : PGS_TICKS_PER_SECOND * 1001.0 / 24000.0;
+        delay = (int64_t) ceil(ceil((state->presented + required) / frameticks) * frameticks) - pts - shift;
+        formattime(pts + shift, time, sizeof(time));
+        printf("Warning: display set %d (%s) can't be decoded in time, it is delayed by %ld ms (%d frames)\n",
+               state->number, time, (long) ((delay + 89) / 90), (int) ceil(delay / frameticks));
+        shift += delay;
+        state->delayed++;
+    }
+    if (pts + shift > 0xffffffffLL)
+    {
+        formattime(pts, time, sizeof(time));
+        printf("Error: display set %d (%s) is moved out of the timestamp range\n", state->number, time);
+        return(0);
+    }
+
+    for (t = 0; t < state->size; t += PGS_SEGMENT_HEADER_SIZE + length)
+    {
+        p = state->data + t;
+        length = ((size_t) p[11] << 8) | p[12];
+        write32(p + 2, (uint32_t) (read32(p + 2) + shift));
+        if (timed)
+        {
+            write32(p + 6, (uint32_t) (read32(p + 6) + shift));
+        }
+        if (p[10] == PGS_SEGMENT_PCS && options->framerate)
+        {
+            p[17] = (unsigned char) options->framerate;
+        }
+    }
+
+    state->presented = pts + shift;
+    return(1);
+}
+
+int retime(FILE *in, FILE *out, const retimeoptions *options)
+{
+    retimestate state;
+    int status;
+
+    memset(&state, 0, sizeof(retimestate));
+    while ((status = readdisplayset(in, &state)) == 1)
+    {
+        if (!retimedisplayset(&state, options))
+        {
+            status = -1;
+            break;
+        }
+        if (fwrite(state.data, 1, state.size, out) != state.size)
+        {
+            printf("Error: the sup file could not be written\n");
+            status = -1;
+            break;
+        }
+        state.number++;
+    }
+    free(state.data);
+
+    if (status == 0)
+    {
+        if (state.delayed > 0)
+        {
+            printf("Warning: %d display sets were delayed to keep within the decoding rate of Blu-ray players\n", state.delayed);
+        }
+        printf("%d display sets retimed\n", state.number);
+    }
+    return(status == 0);
+}
+
+void help()
+{
+    printf("Syntax: pgsretime [options] <supfile> <outputfile>\n");
+    printf("\n");
+    printf("Rewrites the timestamps of all display sets, the images are copied untouched.\n");
+    printf("A time is mapped to: time * scale + offset + offset of the last edit at or before the time.\n");
+    printf("\n");
+    printf("Options\n");
+    printf(" -o <offset>     Offset added to all timestamps as [-]H:MM:SS.mmm or in milliseconds\n");
+    printf(" -s <scale>      Scale of all timestamps as a number or a ratio, 24000/25025 converts 23.976 to 25 fps\n");
+    printf(" -e <editlist>   File with one \"<time> <offset>\" per line: the offset applies from the time on (source\n");
+    printf("                 timeline) until the next edit, e.g. \"0:21:30.000 +0:00:05.000\" after an inserted scene\n");
+    printf(" -r <fps>        Frame rate written to the PCS: 23.976, 24, 25, 29.97, 50, 59.94 (default: keep)\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *positional[2];
+    const char *editpath;
+    retimeoptions options;
+    FILE *in, *out;
+    int positionals;
+    int status;
+    int i;
+
+    memset(&options, 0, sizeof(retimeoptions));
+    pgs_timemap_init(&options.map);
+    editpath = NULL;
+    positionals = 0;
+
+    // parse command line arguments
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-h") == 0)
+        {
+            help();
+            return(0);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            if (!parsetime(argv[++i], &options.map.offset))
+            {
+                printf("Error: invalid offset: %s\n", argv[i]);
+                return(1);
+            }
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            if (!parsescale(argv[++i], &options.map.scale))
+            {
+                printf("Error: invalid scale: %s\n", argv[i]);
+                return(1);
+            }
+        }
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+        {
+            editpath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            if (!pgs_framerate_parse(argv[++i], &options.framerate, &options.frameticks))
+            {
+                printf("Error: unknown frame rate: %s\n", argv[i]);
+                return(1);
+            }
+        }
+        else if (argv[i][0] == 0x2d && argv[i][1] != 0)
+        {
+            printf("Error: unknown option: %s\n", argv[i]);
+            return(1);
+        }
+        else if (positionals < 2)
+        {
+            positional[positionals++] = argv[i];
+        }
+        else
+        {
+            printf("Error: syntax error\n");
+            return(1);
+        }
+    }
+    if (positionals == 0)
+    {
+        help();
+        return(0);
+    }
+    if (positionals == 1)
+    {
+        printf("Error: syntax error\n");
+        return(1);
+    }
+    if (strcmp(positional[0], positional[1]) == 0)
+    {
+        printf("Error: the output file must not be the input file\n");
+        return(1);
+    }
+
+    if (editpath && !readedits(editpath, &options.map))
+    {
+        pgs_timemap_free(&options.map);
+        return(1);
+    }
+
+    in = fopen(positional[0], "rb");
+    if (in == NULL)
+    {
+        printf("Error: the sup file \"%s\" could not be opened\n", positional[0]);
+        pgs_timemap_free(&options.map);
+        return(1);
+    }
+    out = fopen(positional[1], "wb");
+    if (out == NULL)
+    {
+        printf("Error: the sup file \"%s\" could not be opened\n", positional[1]);
+        fclose(in);
+        pgs_timemap_free(&options.map);
+        return(1);
+    }
+
+    // the stream is copied in large blocks
+    setvbuf(in, NULL, _IOFBF, 1048576);
+    setvbuf(out, NULL, _IOFBF, 1048576);
+
+    status = retime(in, out, &options);
+
+    fclose(in);
+    if (fclose(out) != 0 && status)
+    {
+        printf("Error: the sup file \"%s\" could not be written\n", positional[1]);
+        status = 0;
+    }
+    pgs_timemap_free(&options.map);
+
+    // don't leave an empty or partial sup file behind
+    if (!status)
+    {
+        remove(positional[1]);
+    }
+
+    return(status ? 0 : 1);
+}
@@ -42,6 +42,16 @@ public:
         BlurRadius,
         BlurSigma,
         ColorLimit,
+        BorderMode,
+        ShadowColor,
+        ShadowOffset,
+        ShadowSoftness,
+        GlowColor,
+        GlowSize,
+        FadeIn,
+        FadeOut,
+        ColorMatrix,
+        Forced,
     };
 
     StyledSubtitleItem()
@@ -109,10 +119,25 @@ public:
     double blurRadius() const;
     double blurSigma() const;
 
+    int shadowOffsetX() const;
+    int shadowOffsetY() const;
+    double shadowSoftness() const;
+    double glowSize() const;
+
+    // fade durations in milliseconds
+    unsigned long fadeIn() const;
+    unsigned long fadeOut() const;
+
     unsigned colorLimit() const;
 
+    // color matrix of the PGS palette: bt601, bt709, bt601-limited or bt709-limited
+    const std::string colorMatrix() const;
+
     bool isVertical() const;
 
+    // shown even when subtitles are turned off, e.g. signs and songs
+    bool isForced() const;
+
 protected:
     const std::string get_property_value(const std::string &property) const;
 
@@ -148,6 +173,16 @@ protected:
             case BlurRadius:            return "blur-radius";
             case BlurSigma:             return "blur-sigma";
             case ColorLimit:            return "color-limit";
+            case BorderMode:            return "border-mode";
+            case ShadowColor:           return "shadow-color";
+            case ShadowOffset:          return "shadow-offset";
+            case ShadowSoftness:        return "shadow-softness";
+            case GlowColor:             return "glow-color";
+            case GlowSize:              return "glow-size";
+            case FadeIn:                return "fade-in";
+            case FadeOut:               return "fade-out";
+            case ColorMatrix:           return "color-matrix";
+            case Forced:                return "forced";
         }
     }
 
@@ -42,6 +42,16 @@ const style_hints_t default_hints = {
     {"blur-radius",                 "10"},
     {"blur-sigma",                  "0.5"},
     {"color-limit",                 "40"},
+    {"border-mode",                 "blur"},
+    {"shadow-color",                "#000000"},
+    {"shadow-offset",               "0"},
+    {"shadow-softness",             "0"},
+    {"glow-color",                  "#ffffff"},
+    {"glow-size",                   "0"},
+    {"fade-in",                     "0"},
+    {"fade-out",                    "0"},
+    {"color-matrix",                "bt601"},
+    {"forced",                      "false"},
 
     // overwrite properties: are setting one of the above during parsing
     // {"margin-overwrite"}
@@ -311,6 +321,64 @@ double StyledSubtitleItem::blurSigma() const
     }
 }
 
+int StyledSubtitleItem::shadowOffsetX() const
+{
+    // "x,y" or a single value for both directions
+    try {
+        return std::stoi(property(ShadowOffset));
+    } catch (...) {
+        return 0;
+    }
+}
+
+int StyledSubtitleItem::shadowOffsetY() const
+{
+    const auto value = property(ShadowOffset);
+    const auto delim = value.find_first_of(',');
+
+    try {
+        return std::stoi(delim == std::string::npos ? value : value.substr(delim + 1));
+    } catch (...) {
+        return 0;
+    }
+}
+
+double StyledSubtitleItem::shadowSoftness() const
+{
+    try {
+        return std::stod(property(ShadowSoftness));
+    } catch (...) {
+        return 0;
+    }
+}
+
+double StyledSubtitleItem::glowSize() const
+{
+    try {
+        return std::stod(property(GlowSize));
+    } catch (...) {
+        return 0;
+    }
+}
+
+unsigned long StyledSubtitleItem::fadeIn() const
+{
+    try {
+        return std::stoul(property(FadeIn));
+    } catch (...) {
+        return 0;
+    }
+}
+
+unsigned long StyledSubtitleItem::fadeOut() const
+{
+    try {
+        return std::stoul(property(FadeOut));
+    } catch (...) {
+        return 0;
+    }
+}
+
 unsigned StyledSubtitleItem::colorLimit() const
 {
     try {
@@ -320,11 +388,26 @@ unsigned StyledSubtitleItem::colorLimit() const
     }
 }
 
+const std::string StyledSubtitleItem::colorMatrix() const
+{
+    const auto matrix = property(ColorMatrix);
+    if (matrix == "bt709" || matrix == "bt601-limited" || matrix == "bt709-limited")
+    {
+        return matrix;
+    }
+    return "bt601";
+}
+
 bool StyledSubtitleItem::isVertical() const
 {
     return property(TextDirection) == "vertical";
 }
 
+bool StyledSubtitleItem::isForced() const
+{
+    return property(Forced) == "true";
+}
+
 const std::string StyledSubtitleItem::get_property_value(const std::string &property) const
 {
     // don't do anything on empty input
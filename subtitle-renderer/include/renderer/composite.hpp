@@ -0,0 +1,15 @@
+#ifndef SUBTITLE_RENDERER_COMPOSITE_HPP
+#define SUBTITLE_RENDERER_COMPOSITE_HPP
+
+// composites premultiplied RGBA8888 pixels from src over dst (source-over)
+// only the region x,y,w,h is touched, fully transparent source spans are skipped
+// both images must have the given width and height without any row padding
+// the result is identical to QPainter::drawImage() on premultiplied images
+void compositeSourceOver(unsigned char *dst, const unsigned char *src, unsigned width, unsigned height,
+                         unsigned x, unsigned y, unsigned w, unsigned h);
+
+// scalar reference implementation of the above
+void compositeSourceOverScalar(unsigned char *dst, const unsigned char *src, unsigned width, unsigned height,
+                               unsigned x, unsigned y, unsigned w, unsigned h);
+
+#endif // SUBTITLE_RENDERER_COMPOSITE_HPP
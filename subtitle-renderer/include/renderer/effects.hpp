@@ -0,0 +1,54 @@
+#ifndef SUBTITLE_RENDERER_EFFECTS_HPP
+#define SUBTITLE_RENDERER_EFFECTS_HPP
+
+#include <vector>
+
+// straight (not premultiplied) 8-bit RGBA color
+struct EffectColor
+{
+    unsigned char r = 0;
+    unsigned char g = 0;
+    unsigned char b = 0;
+    unsigned char a = 0;
+};
+
+// effects rendered from the distance field of the glyph coverage
+// all sizes are in pixel, an effect with a size of zero is disabled
+struct DistanceEffects
+{
+    // text outline, replaces the blurred border
+    float outlineSize = 0;
+    EffectColor outlineColor;
+
+    // drop shadow below the text and its outline
+    bool shadow = false;
+    int shadowOffsetX = 0;
+    int shadowOffsetY = 0;
+    float shadowSoftness = 0;
+    EffectColor shadowColor;
+
+    // glow around the text and its outline
+    float glowSize = 0;
+    EffectColor glowColor;
+};
+
+// reusable memory for the distance transform
+struct DistanceScratch
+{
+    std::vector<float> distance;
+    std::vector<float> f;
+    std::vector<float> d;
+    std::vector<float> z;
+    std::vector<int> v;
+};
+
+// computes the euclidean distance of every pixel to the nearest pixel with at least 50% alpha
+// rgba are 8-bit RGBA pixels, the result has one value per pixel (row major)
+// runs in linear time (Felzenszwalb & Huttenlocher), pixels with no coverage at all get +inf
+void distanceTransform(const unsigned char *rgba, unsigned width, unsigned height, DistanceScratch &scratch);
+
+// renders all enabled effects below the premultiplied RGBA8888 image (in place)
+// the cost only depends on the image size, not on the size of the effects
+void applyDistanceEffects(unsigned char *rgba, unsigned width, unsigned height, const DistanceEffects &effects, DistanceScratch &scratch);
+
+#endif // SUBTITLE_RENDERER_EFFECTS_HPP
@@ -2,6 +2,7 @@
 #define SUBTITLE_RENDERER_HELPERS_HPP
 
 #include <vector>
+#include <cstdint>
 
 namespace Magick
 {
@@ -18,4 +19,23 @@ unsigned cropDetectionCol(Magick::Image *image, bool fromLeft);
 const std::vector<unsigned char> createPalette(const std::vector<unsigned char> &rgba, unsigned long width, unsigned long height);
 const std::vector<unsigned char> createPalette(const unsigned char *rgba, unsigned long width, unsigned long height);
 
+// same as above, but reuses the memory of the given buffers
+// colors is used as temporary storage, the palette is written into palette
+void createPalette(const unsigned char *rgba, unsigned long width, unsigned long height,
+                   std::vector<std::uint32_t> &colors, std::vector<unsigned char> &palette);
+
+// a rectangle inside an image
+struct ImageRect
+{
+    unsigned x = 0;
+    unsigned y = 0;
+    unsigned width = 0;
+    unsigned height = 0;
+};
+
+// splits an 8-bit colormap image into 2 parts cut between rows (or columns), each part tightly covers its visible pixels
+// visible marks the palette entries which aren't fully transparent
+// returns 2 when the parts are at least a quarter smaller than the whole image, otherwise 1 and the whole image as first part
+unsigned splitImage(const unsigned char *indices, unsigned width, unsigned height, const bool visible[256], bool columns, ImageRect parts[2]);
+
 #endif // SUBTITLE_RENDERER_HELPERS_HPP
@@ -32,6 +32,12 @@ public:
         Unchanged,
     };
 
+    enum class BorderMode
+    {
+        Blur,
+        DistanceField,
+    };
+
     // the final image size
     struct size_t
     {
@@ -50,6 +56,15 @@ public:
         unsigned y = 0;
     };
 
+    // a part of the subtitle frame, x,y is the position inside the whole frame
+    struct part_t
+    {
+        unsigned x = 0;
+        unsigned y = 0;
+        size_t size;
+        std::vector<char> image;
+    };
+
     inline void setVertical(bool vertical)
     {
         _vertical = vertical;
@@ -176,14 +191,73 @@ public:
         _gaussianBlurSigma = blurSigma;
     }
 
+    inline void setBorderMode(BorderMode borderMode)
+    {
+        _borderMode = borderMode;
+    }
+
+    inline void setBorderMode(const std::string &borderMode)
+    {
+        if (borderMode == "distance-field")
+        {
+            _borderMode = BorderMode::DistanceField;
+        }
+        else
+        {
+            _borderMode = BorderMode::Blur;
+        }
+    }
+
+    inline void setShadowColor(const std::string &shadowColor)
+    {
+        _shadowColor = shadowColor;
+    }
+
+    inline void setShadowOffset(int x, int y)
+    {
+        _shadowOffsetX = x;
+        _shadowOffsetY = y;
+    }
+
+    inline void setShadowSoftness(double shadowSoftness)
+    {
+        _shadowSoftness = shadowSoftness;
+    }
+
+    inline void setGlowColor(const std::string &glowColor)
+    {
+        _glowColor = glowColor;
+    }
+
+    inline void setGlowSize(double glowSize)
+    {
+        _glowSize = glowSize;
+    }
+
+    // a PGS palette has at most 255 colors, higher limits are clamped
     inline void setColorLimit(unsigned colorLimit)
     {
-        _colorLimit = colorLimit;
+        _colorLimit = colorLimit < 255 ? colorLimit : 255;
     }
 
     const std::vector<char> render(size_t *size = nullptr, pos_t *pos  = nullptr, unsigned long *color_count = nullptr) const;
 
+    // same as render(), but the frame is cut between lines (columns in vertical text) into 2 tight images
+    // when this removes enough of the transparent area, otherwise the whole frame is the only part
+    // all parts share the palette of the whole frame, size is the size of the whole frame
+    const std::vector<part_t> renderParts(size_t *size = nullptr, pos_t *pos  = nullptr, unsigned long *color_count = nullptr) const;
+
 private:
+    // text layout and drawing, specialized for horizontal text without Furigana
+    // the frame is split into parts when parts is given, nothing is returned then
+    template<bool PlainHorizontal>
+    const std::vector<char> renderLayout(size_t *size, pos_t *pos, unsigned long *color_count, std::vector<part_t> *parts) const;
+
+    // same as render(), but always takes the general layout path
+    // the path specialized for plain horizontal text must give the same image, checked by the unit tests
+    const std::vector<char> renderGeneral(size_t *size, pos_t *pos, unsigned long *color_count) const;
+    friend struct PNGRendererTest;
+
     bool _vertical = false;
     std::string _text;
     std::string _fontFamily;
@@ -202,6 +276,13 @@ private:
     unsigned long _furiganaBorderSize = 2;
     double _gaussianBlurRadius = 10;
     double _gaussianBlurSigma = 0.5;
+    BorderMode _borderMode = BorderMode::Blur;
+    std::string _shadowColor = "#000000";
+    int _shadowOffsetX = 0;
+    int _shadowOffsetY = 0;
+    double _shadowSoftness = 0;
+    std::string _glowColor = "#ffffff";
+    double _glowSize = 0;
     unsigned _colorLimit = 40;
 };
 
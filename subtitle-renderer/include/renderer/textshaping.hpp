@@ -0,0 +1,32 @@
+#ifndef SUBTITLE_RENDERER_TEXTSHAPING_HPP
+#define SUBTITLE_RENDERER_TEXTSHAPING_HPP
+
+#include <QList>
+#include <QGlyphRun>
+#include <QRectF>
+
+class QString;
+class QFont;
+class QPainter;
+
+// the shaping result of a single line of text
+// shaped once and drawn for every border ring and the fill
+struct ShapedText
+{
+    QList<QGlyphRun> glyphRuns;
+    qreal width = 0;        // natural width without trailing spaces
+    qreal advance = 0;      // advance including trailing spaces
+    qreal height = 0;
+};
+
+// shapes a single line of text without wrapping
+const ShapedText shapeText(const QString &text, const QFont &font);
+
+// the bounding rect QPainter::drawText reports for the text inside of the given rect
+const QRectF alignedTextRect(const ShapedText &shaped, const QRectF &rect, int alignment);
+
+// draws the glyph runs at the same pixels as QPainter::drawText(rect, alignment, text)
+// the line is placed by its advance and clipped to rect when it doesn't fit
+void drawShapedText(QPainter *painter, const ShapedText &shaped, const QRectF &rect, int alignment);
+
+#endif // SUBTITLE_RENDERER_TEXTSHAPING_HPP
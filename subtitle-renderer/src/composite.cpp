@@ -0,0 +1,190 @@
+#include "composite.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// multiplies all 4 channels with a (0~255) and divides by 255 with rounding
+// same rounding as the BYTE_MUL() macro used by the Qt raster engine
+static inline std::uint32_t byteMul(std::uint32_t x, std::uint32_t a)
+{
+    std::uint32_t t = (x & 0xff00ff) * a;
+    t = (t + ((t >> 8) & 0xff00ff) + 0x800080) >> 8;
+    t &= 0xff00ff;
+
+    x = ((x >> 8) & 0xff00ff) * a;
+    x = (x + ((x >> 8) & 0xff00ff) + 0x800080);
+    x &= 0xff00ff00;
+
+    return x | t;
+}
+
+static inline void blendPixel(std::uint32_t *dst, std::uint32_t s)
+{
+    // pixels are stored as R,G,B,A bytes, alpha is the highest byte on little endian
+    const auto alpha = s >> 24;
+
+    if (alpha == 0xff)
+    {
+        *dst = s;
+    }
+    else if (s != 0)
+    {
+        *dst = s + byteMul(*dst, 0xff - alpha);
+    }
+}
+
+static void blendSpanScalar(std::uint32_t *dst, const std::uint32_t *src, unsigned count)
+{
+    for (auto i = 0U; i < count; ++i)
+    {
+        blendPixel(dst + i, src[i]);
+    }
+}
+
+#if defined(__AVX2__)
+
+static void blendSpan(std::uint32_t *dst, const std::uint32_t *src, unsigned count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i colorMask = _mm256_set1_epi32(0x00ffffff);
+    const __m256i alphaMask = _mm256_set1_epi32(0xff);
+    const __m256i half = _mm256_set1_epi16(0x80);
+
+    auto i = 0U;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+
+        // skip fully transparent spans
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) == -1)
+        {
+            continue;
+        }
+
+        // fully opaque spans replace the destination
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_or_si256(s, colorMask), ones)) == -1)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), s);
+            continue;
+        }
+
+        const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+
+        // inverted source alpha in both 16-bit halves of every pixel
+        __m256i ia = _mm256_xor_si256(_mm256_srli_epi32(s, 24), alphaMask);
+        ia = _mm256_or_si256(ia, _mm256_slli_epi32(ia, 16));
+
+        __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi32(ia, ia));
+        __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi32(ia, ia));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), half), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), half), 8);
+
+        const __m256i result = _mm256_add_epi8(s, _mm256_packus_epi16(lo, hi));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), result);
+    }
+
+    blendSpanScalar(dst + i, src + i, count - i);
+}
+
+#elif defined(__SSE2__)
+
+static void blendSpan(std::uint32_t *dst, const std::uint32_t *src, unsigned count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi32(-1);
+    const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+    const __m128i alphaMask = _mm_set1_epi32(0xff);
+    const __m128i half = _mm_set1_epi16(0x80);
+
+    auto i = 0U;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+
+        // skip fully transparent spans
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff)
+        {
+            continue;
+        }
+
+        // fully opaque spans replace the destination
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_or_si128(s, colorMask), ones)) == 0xffff)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s);
+            continue;
+        }
+
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+
+        // inverted source alpha in both 16-bit halves of every pixel
+        __m128i ia = _mm_xor_si128(_mm_srli_epi32(s, 24), alphaMask);
+        ia = _mm_or_si128(ia, _mm_slli_epi32(ia, 16));
+
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(ia, ia));
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(ia, ia));
+        lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), half), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), half), 8);
+
+        const __m128i result = _mm_add_epi8(s, _mm_packus_epi16(lo, hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), result);
+    }
+
+    blendSpanScalar(dst + i, src + i, count - i);
+}
+
+#else
+
+static void blendSpan(std::uint32_t *dst, const std::uint32_t *src, unsigned count)
+{
+    blendSpanScalar(dst, src, count);
+}
+
+#endif
+
+template<void (*BlendSpan)(std::uint32_t*, const std::uint32_t*, unsigned)>
+static void composite(unsigned char *dst, const unsigned char *src, unsigned width, unsigned height,
+                      unsigned x, unsigned y, unsigned w, unsigned h)
+{
+    // clip region to the image size
+    if (x >= width || y >= height)
+    {
+        return;
+    }
+    if (w > width - x)
+    {
+        w = width - x;
+    }
+    if (h > height - y)
+    {
+        h = height - y;
+    }
+
+    for (auto row = y; row < y + h; ++row)
+    {
+        const auto offset = (std::size_t(row) * width + x) * 4;
+        BlendSpan(reinterpret_cast<std::uint32_t*>(dst + offset), reinterpret_cast<const std::uint32_t*>(src + offset), w);
+    }
+}
+
+} // anonymous namespace
+
+void compositeSourceOver(unsigned char *dst, const unsigned char *src, unsigned width, unsigned height,
+                         unsigned x, unsigned y, unsigned w, unsigned h)
+{
+    composite<blendSpan>(dst, src, width, height, x, y, w, h);
+}
+
+void compositeSourceOverScalar(unsigned char *dst, const unsigned char *src, unsigned width, unsigned height,
+                               unsigned x, unsigned y, unsigned w, unsigned h)
+{
+    composite<blendSpanScalar>(dst, src, width, height, x, y, w, h);
+}
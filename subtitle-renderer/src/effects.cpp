@@ -0,0 +1,217 @@
+#include "effects.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+static constexpr float infinity = std::numeric_limits<float>::infinity();
+
+// 1D squared euclidean distance transform of a sampled function (lower envelope of parabolas)
+// sites with an infinite value are skipped
+static void distanceTransform1D(const float *f, unsigned n, float *d, int *v, float *z)
+{
+    int k = -1;
+
+    for (auto q = 0; q < int(n); ++q)
+    {
+        if (f[q] == infinity)
+        {
+            continue;
+        }
+
+        if (k < 0)
+        {
+            k = 0;
+            v[0] = q;
+            z[0] = -infinity;
+            z[1] = infinity;
+            continue;
+        }
+
+        float s = ((f[q] + float(q * q)) - (f[v[k]] + float(v[k] * v[k]))) / float(2 * (q - v[k]));
+        while (s <= z[k])
+        {
+            --k;
+            s = ((f[q] + float(q * q)) - (f[v[k]] + float(v[k] * v[k]))) / float(2 * (q - v[k]));
+        }
+
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = infinity;
+    }
+
+    // no sites at all
+    if (k < 0)
+    {
+        std::fill(d, d + n, infinity);
+        return;
+    }
+
+    k = 0;
+    for (auto q = 0; q < int(n); ++q)
+    {
+        while (z[k + 1] < float(q))
+        {
+            ++k;
+        }
+
+        d[q] = float((q - v[k]) * (q - v[k])) + f[v[k]];
+    }
+}
+
+static inline float clamp01(float value)
+{
+    return std::min(1.0f, std::max(0.0f, value));
+}
+
+static inline float smoothstep(float edge0, float edge1, float x)
+{
+    const auto t = clamp01((x - edge0) / (edge1 - edge0));
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// distance from the pixel center to the glyph edge, corrected by the coverage of the pixel itself
+static inline float edgeDistance(const float *distance, const unsigned char *rgba, std::size_t i)
+{
+    const auto d = distance[i];
+
+    if (d == 0.0f)
+    {
+        return 0.0f;
+    }
+
+    return std::max(0.0f, d - 0.5f - float(rgba[i * 4 + 3]) / 255.0f);
+}
+
+} // anonymous namespace
+
+void distanceTransform(const unsigned char *rgba, unsigned width, unsigned height, DistanceScratch &scratch)
+{
+    const auto size = std::size_t(width) * height;
+    const auto length = std::max(width, height);
+
+    scratch.distance.resize(size);
+    scratch.f.resize(length);
+    scratch.d.resize(length);
+    scratch.z.resize(length + 1);
+    scratch.v.resize(length);
+
+    auto &distance = scratch.distance;
+
+    // seed with coverage, pixels with at least 50% alpha are inside the glyph
+    for (auto i = 0UL; i < size; ++i)
+    {
+        distance[i] = rgba[i * 4 + 3] >= 128 ? 0.0f : infinity;
+    }
+
+    // transform all columns
+    for (auto x = 0U; x < width; ++x)
+    {
+        for (auto y = 0U; y < height; ++y)
+        {
+            scratch.f[y] = distance[std::size_t(y) * width + x];
+        }
+
+        distanceTransform1D(scratch.f.data(), height, scratch.d.data(), scratch.v.data(), scratch.z.data());
+
+        for (auto y = 0U; y < height; ++y)
+        {
+            distance[std::size_t(y) * width + x] = scratch.d[y];
+        }
+    }
+
+    // transform all rows
+    for (auto y = 0U; y < height; ++y)
+    {
+        auto row = distance.data() + std::size_t(y) * width;
+        std::copy(row, row + width, scratch.f.data());
+
+        distanceTransform1D(scratch.f.data(), width, row, scratch.v.data(), scratch.z.data());
+
+        // squared distance to distance
+        for (auto x = 0U; x < width; ++x)
+        {
+            row[x] = std::sqrt(row[x]);
+        }
+    }
+}
+
+void applyDistanceEffects(unsigned char *rgba, unsigned width, unsigned height, const DistanceEffects &effects, DistanceScratch &scratch)
+{
+    const bool outline = effects.outlineSize > 0;
+    const bool glow = effects.glowSize > 0;
+
+    if (!outline && !glow && !effects.shadow)
+    {
+        return;
+    }
+
+    distanceTransform(rgba, width, height, scratch);
+    const auto distance = scratch.distance.data();
+
+    // shape of the text including its outline
+    const auto shapeDistance = [&](std::size_t i) {
+        return std::max(0.0f, edgeDistance(distance, rgba, i) - effects.outlineSize);
+    };
+
+    for (auto y = 0; y < int(height); ++y)
+    {
+        for (auto x = 0; x < int(width); ++x)
+        {
+            const auto i = std::size_t(y) * width + std::size_t(x);
+
+            // premultiplied effect color, from bottom to top
+            float er = 0, eg = 0, eb = 0, ea = 0;
+
+            const auto over = [&](const EffectColor &color, float coverage) {
+                const auto a = coverage * float(color.a) / 255.0f;
+                er = float(color.r) * a + er * (1.0f - a);
+                eg = float(color.g) * a + eg * (1.0f - a);
+                eb = float(color.b) * a + eb * (1.0f - a);
+                ea = 255.0f * a + ea * (1.0f - a);
+            };
+
+            if (effects.shadow)
+            {
+                const auto sx = x - effects.shadowOffsetX;
+                const auto sy = y - effects.shadowOffsetY;
+
+                if (sx >= 0 && sy >= 0 && sx < int(width) && sy < int(height))
+                {
+                    const auto d = shapeDistance(std::size_t(sy) * width + std::size_t(sx));
+                    const auto coverage = effects.shadowSoftness > 0 ?
+                        1.0f - smoothstep(0.0f, effects.shadowSoftness, d) :
+                        clamp01(1.0f - d);
+                    over(effects.shadowColor, coverage);
+                }
+            }
+
+            if (glow)
+            {
+                const auto falloff = 1.0f - clamp01(shapeDistance(i) / effects.glowSize);
+                over(effects.glowColor, falloff * falloff);
+            }
+
+            if (outline)
+            {
+                over(effects.outlineColor, clamp01(effects.outlineSize + 0.5f - edgeDistance(distance, rgba, i)));
+            }
+
+            if (ea <= 0.0f)
+            {
+                continue;
+            }
+
+            // place effects below the existing pixel (destination over)
+            auto pixel = rgba + i * 4;
+            const auto remaining = 1.0f - float(pixel[3]) / 255.0f;
+            pixel[0] = (unsigned char) std::min(255.0f, float(pixel[0]) + er * remaining + 0.5f);
+            pixel[1] = (unsigned char) std::min(255.0f, float(pixel[1]) + eg * remaining + 0.5f);
+            pixel[2] = (unsigned char) std::min(255.0f, float(pixel[2]) + eb * remaining + 0.5f);
+            pixel[3] = (unsigned char) std::min(255.0f, float(pixel[3]) + ea * remaining + 0.5f);
+        }
+    }
+}
@@ -131,34 +131,45 @@ unsigned cropDetectionCol(Magick::Image *image, bool fromLeft)
 }
 
 const std::vector<unsigned char> createPalette(const std::vector<unsigned char> &rgba, unsigned long width, unsigned long height)
+{
+    return createPalette(rgba.data(), width, height);
+}
+
+const std::vector<unsigned char> createPalette(const unsigned char *rgba, unsigned long width, unsigned long height)
 {
     std::vector<std::uint32_t> colors;
+    std::vector<unsigned char> palette;
+    createPalette(rgba, width, height, colors, palette);
+    return palette;
+}
+
+void createPalette(const unsigned char *rgba, unsigned long width, unsigned long height,
+                   std::vector<std::uint32_t> &colors, std::vector<unsigned char> &palette)
+{
+    colors.clear();
+    palette.clear();
 
     // scan all pixels
-    for (auto i = 0U; i < width * height * 4; i += 4)
+    for (auto i = 0UL; i < width * height * 4; i += 4)
     {
         // push entire pixel into palette
         std::uint32_t pixel = (
-            ((std::uint8_t) rgba[i] << 24) |
-            ((std::uint8_t) rgba[i + 1] << 16) |
-            ((std::uint8_t) rgba[i + 2] << 8) |
-            ((std::uint8_t) rgba[i + 3])
+            ((std::uint32_t) rgba[i] << 24) |
+            ((std::uint32_t) rgba[i + 1] << 16) |
+            ((std::uint32_t) rgba[i + 2] << 8) |
+            ((std::uint32_t) rgba[i + 3])
         );
         colors.emplace_back(pixel);
     }
 
     // sort colors from low to high
-    std::sort(colors.begin(), colors.end(), [](auto&& left, auto&& right) {
-        return left < right;
-    });
+    std::sort(colors.begin(), colors.end());
 
     // remove duplicates
     auto last = std::unique(colors.begin(), colors.end());
     colors.erase(last, colors.end());
 
     // create palette
-    std::vector<unsigned char> palette;
-
     for (auto&& color : colors)
     {
         auto r = ((color >> 24) & 0xff);
@@ -171,12 +182,133 @@ const std::vector<unsigned char> createPalette(const std::vector<unsigned char>
         palette.emplace_back(b);
         palette.emplace_back(a);
     }
-
-    return palette;
 }
 
-const std::vector<unsigned char> createPalette(const unsigned char *rgba, unsigned long width, unsigned long height)
+namespace {
+
+// visible extent of a row (or column), first > last when it is empty
+struct LineExtent
 {
-    const std::vector<unsigned char> data(rgba, rgba + (width * height * 4));
-    return createPalette(data, width, height);
+    unsigned first;
+    unsigned last;
+};
+
+// bounds of the visible pixels of several lines in line and cross coordinates, lines are rows or columns
+struct LineBounds
+{
+    unsigned lineFirst;
+    unsigned lineLast;
+    unsigned crossFirst;
+    unsigned crossLast;
+    bool empty = true;
+
+    void add(unsigned line, const LineExtent &extent)
+    {
+        if (extent.first > extent.last)
+        {
+            return;
+        }
+        if (empty)
+        {
+            lineFirst = lineLast = line;
+            crossFirst = extent.first;
+            crossLast = extent.last;
+            empty = false;
+            return;
+        }
+        lineFirst = std::min(lineFirst, line);
+        lineLast = std::max(lineLast, line);
+        crossFirst = std::min(crossFirst, extent.first);
+        crossLast = std::max(crossLast, extent.last);
+    }
+
+    unsigned long long area() const
+    {
+        return empty ? 0 : (unsigned long long) (lineLast - lineFirst + 1) * (crossLast - crossFirst + 1);
+    }
+
+    ImageRect rect(bool columns) const
+    {
+        ImageRect r;
+        if (empty)
+        {
+            return r;
+        }
+        const auto lines = lineLast - lineFirst + 1;
+        const auto cross = crossLast - crossFirst + 1;
+        r.x = columns ? lineFirst : crossFirst;
+        r.y = columns ? crossFirst : lineFirst;
+        r.width = columns ? lines : cross;
+        r.height = columns ? cross : lines;
+        return r;
+    }
+};
+
+} // anonymous namespace
+
+unsigned splitImage(const unsigned char *indices, unsigned width, unsigned height, const bool visible[256], bool columns, ImageRect parts[2])
+{
+    parts[0] = {0, 0, width, height};
+    parts[1] = {};
+
+    const auto lines = columns ? width : height;
+    if (lines < 2)
+    {
+        return 1;
+    }
+
+    // visible extent of every line
+    std::vector<LineExtent> extents(lines, LineExtent{~0U, 0});
+    for (auto y = 0U; y < height; ++y)
+    {
+        const auto row = indices + std::size_t(y) * width;
+        for (auto x = 0U; x < width; ++x)
+        {
+            if (!visible[row[x]])
+            {
+                continue;
+            }
+            auto &extent = extents[columns ? x : y];
+            const auto cross = columns ? y : x;
+            extent.first = std::min(extent.first, cross);
+            extent.last = std::max(extent.last, cross);
+        }
+    }
+
+    // bounds of all lines after each cut position
+    std::vector<LineBounds> suffix(lines + 1);
+    for (auto line = lines; line-- > 0;)
+    {
+        suffix[line] = suffix[line + 1];
+        suffix[line].add(line, extents[line]);
+    }
+
+    // cut where the two parts cover the smallest area
+    LineBounds prefix, bestFirst, bestSecond;
+    auto bestArea = (unsigned long long) width * height;
+    for (auto cut = 1U; cut < lines; ++cut)
+    {
+        prefix.add(cut - 1, extents[cut - 1]);
+        if (prefix.empty || suffix[cut].empty)
+        {
+            continue;
+        }
+        const auto area = prefix.area() + suffix[cut].area();
+        if (area < bestArea)
+        {
+            bestArea = area;
+            bestFirst = prefix;
+            bestSecond = suffix[cut];
+        }
+    }
+
+    // two objects cost more segments and a window each, only split when it pays off
+    if (bestFirst.empty || bestArea * 4 > (unsigned long long) width * height * 3)
+    {
+        return 1;
+    }
+
+    parts[0] = bestFirst.rect(columns);
+    parts[1] = bestSecond.rect(columns);
+    return 2;
 }
@@ -19,6 +19,9 @@ using SrtParser::StyledSubtitleItem;
 
 namespace {
 
+// size of the decoded object buffer of PGS decoders, every object is decoded to 1 byte per pixel
+static constexpr unsigned long decodedObjectBufferSize = 4 * 1024 * 1024;
+
 static void write(const std::string &filename, const std::vector<char> &data)
 {
     // write data to disk
@@ -112,14 +115,56 @@ PGSFrameCreator::ErrorCode PGSFrameCreator::render(const std::string &_out_path,
 
     QTextStream stream(&definition_file);
 
-    // write command to run as xml comment
-    const std::string pgssup_command = "pgssup -s " + std::to_string(_width) + "x" + std::to_string(_height) + " pgs.xml out.sup";
+    // write command to run as xml comment, the forced subtitles are also written to a track of their own
+    const bool has_forced = std::any_of(_subtitles.begin(), _subtitles.end(), [](const SrtParser::StyledSubtitleItem &sub) { return sub.isForced(); });
+    const std::string pgssup_command = "pgssup -s " + std::to_string(_width) + "x" + std::to_string(_height) +
+        (has_forced ? " -f forced.sup" : "") + " pgs.xml out.sup";
     stream << "<!-- command: " << pgssup_command.c_str() << " -->\n";
 
-    // open xml segment
-    stream << "<pgssup defaultoffset=\"0,0\">\n";
+    // open xml segment, the color matrix applies to the whole stream and is taken from the global hints
+    stream << "<pgssup defaultoffset=\"0,0\"";
+    if (!_subtitles.empty() && _subtitles.front().colorMatrix() != "bt601")
+    {
+        stream << " colormatrix=\"" << _subtitles.front().colorMatrix().c_str() << "\"";
+    }
+    stream << ">\n";
     stream.flush();
 
+    // frames on screen at the start of the current frame, the encoder shows up to 2 frames at the same time
+    struct ShownFrame
+    {
+        unsigned frameNo;
+        SrtParser::timestamp_t endTime;
+        unsigned long colorCount;
+    };
+    std::vector<ShownFrame> shownFrames;
+
+    // frames overlapping other frames are never cut into parts, there is no room for more objects
+    std::vector<bool> overlapping(_subtitles.size(), false);
+    {
+        std::vector<std::size_t> order(_subtitles.size());
+        for (auto i = 0U; i < order.size(); ++i)
+        {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+            return _subtitles[a].startTime() < _subtitles[b].startTime();
+        });
+
+        // an earlier frame ends after the start, or the next frame starts before the end
+        SrtParser::timestamp_t maxEnd = 0;
+        for (auto i = 0U; i < order.size(); ++i)
+        {
+            const auto &sub = _subtitles[order[i]];
+            if ((i > 0 && maxEnd > sub.startTime()) ||
+                (i + 1 < order.size() && _subtitles[order[i + 1]].startTime() < sub.endTime()))
+            {
+                overlapping[order[i]] = true;
+            }
+            maxEnd = std::max(maxEnd, sub.endTime());
+        }
+    }
+
     // start processing all subtitles
     unsigned frameNo = 1;
     for (auto&& sub : _subtitles)
@@ -150,6 +195,14 @@ PGSFrameCreator::ErrorCode PGSFrameCreator::render(const std::string &_out_path,
         renderer.setFuriganaBorderSize(sub.furiganaBorderSize());
         renderer.setBlurRadius(sub.blurRadius());
         renderer.setBlurSigma(sub.blurSigma());
+        renderer.setBorderMode(sub.property(StyledSubtitleItem::BorderMode));
+
+        // effects
+        renderer.setShadowColor(sub.property(StyledSubtitleItem::ShadowColor));
+        renderer.setShadowOffset(sub.shadowOffsetX(), sub.shadowOffsetY());
+        renderer.setShadowSoftness(sub.shadowSoftness());
+        renderer.setGlowColor(sub.property(StyledSubtitleItem::GlowColor));
+        renderer.setGlowSize(sub.glowSize());
 
         if (verbose)
         {
@@ -161,14 +214,29 @@ PGSFrameCreator::ErrorCode PGSFrameCreator::render(const std::string &_out_path,
             }
         }
 
-        // render subtitle image
+        // render subtitle image, cut into 2 parts between lines when this saves enough transparent area
         PNGRenderer::size_t size;
         PNGRenderer::pos_t pos;
         unsigned long color_count;
-        const auto sub_image = renderer.render(&size, &pos, &color_count);
+        std::vector<PNGRenderer::part_t> parts;
+        if (overlapping[frameNo - 1])
+        {
+            PNGRenderer::part_t whole;
+            whole.image = renderer.render(&size, &pos, &color_count);
+            whole.size = size;
+            parts.emplace_back(std::move(whole));
+        }
+        else
+        {
+            parts = renderer.renderParts(&size, &pos, &color_count);
+        }
 
-        // FIXME: not calculated correctly
-        const auto size_as_8bit_pal = size.width * size.height;
+        // size of the decoded objects (1 byte per pixel)
+        unsigned long size_as_8bit_pal = 0;
+        for (auto&& part : parts)
+        {
+            size_as_8bit_pal += (unsigned long) part.size.width * part.size.height;
+        }
 
         // H: left, center (default), right    V: right (default), left
         const auto alignment = sub.property(StyledSubtitleItem::TextAlignment);
@@ -240,15 +308,26 @@ PGSFrameCreator::ErrorCode PGSFrameCreator::render(const std::string &_out_path,
 
         if (verbose)
         {
-            std::cout << " rendered image size = " << size.width << "x" << size.height << " (" << size_as_8bit_pal << " bytes in PGS)" << std::endl;
+            std::cout << " rendered image size = " << size.width << "x" << size.height << " (" << size_as_8bit_pal << " bytes decoded)" << std::endl;
             std::cout << " calculated position offset = " << pos.x << "x" << pos.y << std::endl;
             std::cout << " calculated image position = " << x << "x" << y << std::endl;
+
+            if (parts.size() > 1)
+            {
+                for (auto&& part : parts)
+                {
+                    std::cout << " part at " << part.x << "x" << part.y << " size = " << part.size.width << "x" << part.size.height << std::endl;
+                }
+            }
         }
 
-        // write sub image to disk
-        const auto filename = std::to_string(frameNo) + ".png";
-        const auto full_file_path = full_out_path + "/" + filename;
-        write(full_file_path, sub_image);
+        // write sub images to disk, the second part of a frame is written as <frame>-2.png
+        std::vector<std::string> filenames;
+        for (auto i = 0U; i < parts.size(); ++i)
+        {
+            filenames.emplace_back(std::to_string(frameNo) + (i == 0 ? "" : "-" + std::to_string(i + 1)) + ".png");
+            write(full_out_path + "/" + filenames.back(), parts[i].image);
+        }
 
         // write color count report with optimal warning
         if (color_count <= 255)
@@ -274,28 +353,73 @@ PGSFrameCreator::ErrorCode PGSFrameCreator::render(const std::string &_out_path,
             }
         }
 
-        // print a warning when image size exceeds the maximum length a PGS frame can store
-        if (size_as_8bit_pal > 0xFFFF)
+        // large objects are split into several segments by the encoder,
+        // only print warnings for the limits of the decoder itself
+        if (size.width > _width || size.height > _height)
+        {
+            std::cout << "warning: frame " << frameNo << " is larger than the video (" << size.width << "x" << size.height << ")" << std::endl;
+        }
+        if (size_as_8bit_pal > decodedObjectBufferSize)
+        {
+            std::cout << "warning: frame " << frameNo << " exceeds the decoded object buffer of " << decodedObjectBufferSize << " bytes by " << size_as_8bit_pal - decodedObjectBufferSize << " bytes" << std::endl;
+        }
+
+        // overlapping frames share a display set and a palette of 255 colors
+        shownFrames.erase(std::remove_if(shownFrames.begin(), shownFrames.end(), [&](const ShownFrame &shown) {
+            return shown.endTime <= sub.startTime();
+        }), shownFrames.end());
+        if (shownFrames.size() == 1)
+        {
+            std::cout << "info: frame " << frameNo << " overlaps frame " << shownFrames[0].frameNo << ", both are shown together" << std::endl;
+            if (shownFrames[0].colorCount + color_count > 255)
+            {
+                std::cout << "warning: frames " << shownFrames[0].frameNo << " and " << frameNo << " may have more than 255 colors together" << std::endl;
+            }
+        }
+        else if (shownFrames.size() > 1)
         {
-            std::cout << "warning: frame " << frameNo << " exceeds the maximum allowed " << 0xFFFF << " bytes by " << size_as_8bit_pal - 0xFFFF << " bytes" << std::endl;
+            std::cout << "warning: frame " << frameNo << " overlaps " << shownFrames.size() << " frames, the encoder cuts them at its start time" << std::endl;
+            shownFrames.clear();
         }
+        shownFrames.push_back({frameNo, sub.endTime(), color_count});
 
         // format time and write subtitle frame information to definition file
         auto start = format_duration(sub.startTime());
         auto end = format_duration(sub.endTime());
 
-        stream << "    " <<
-            "<subtitle " <<
-                "starttime=\"" << start.c_str() << "\" " <<
-                "endtime=\"" << end.c_str() << "\" " <<
-                "offset=\"" << x << ',' << y << "\" " <<
-                "image=\"" << frameNo << ".png\" />\n";
+        // the parts of a frame have the same times, the encoder shows them together as separate objects
+        for (auto i = 0U; i < parts.size(); ++i)
+        {
+            stream << "    " <<
+                "<subtitle " <<
+                    "starttime=\"" << start.c_str() << "\" " <<
+                    "endtime=\"" << end.c_str() << "\" " <<
+                    "offset=\"" << x + parts[i].x << ',' << y + parts[i].y << "\" " <<
+                    "image=\"" << filenames[i].c_str() << "\" ";
+
+            if (sub.isForced())
+            {
+                stream << "view=\"forced\" ";
+            }
+
+            // fades are encoded as palette updates of the same image
+            if (sub.fadeIn() > 0)
+            {
+                stream << "fadein=\"" << sub.fadeIn() << "\" ";
+            }
+            if (sub.fadeOut() > 0)
+            {
+                stream << "fadeout=\"" << sub.fadeOut() << "\" ";
+            }
+
+            stream << "/>\n";
+        }
         stream.flush();
 
         // increment frame number
         ++frameNo;
 
-        // execute optimal command on the PNG file
+        // execute optimal command on the PNG files
         if (!_command.empty())
         {
             // check if arguments are present in the template
@@ -305,82 +429,88 @@ PGSFrameCreator::ErrorCode PGSFrameCreator::render(const std::string &_out_path,
                 continue;
             }
 
-            // copy argument template
-            auto args = _args_template;
-
-            // replace %f with full png file path
-            bool got_file_placeholder = false;
-            for (auto i = 0U; i < args.size(); ++i)
+            // the command runs on every part of the frame
+            for (auto&& filename : filenames)
             {
-                if (args.at(i) == "%f")
+                const auto full_file_path = full_out_path + "/" + filename;
+
+                // copy argument template
+                auto args = _args_template;
+
+                // replace %f with full png file path
+                bool got_file_placeholder = false;
+                for (auto i = 0U; i < args.size(); ++i)
                 {
-                    args[i] = full_file_path;
-                    got_file_placeholder = true;
-                    break;
+                    if (args.at(i) == "%f")
+                    {
+                        args[i] = full_file_path;
+                        got_file_placeholder = true;
+                        break;
+                    }
                 }
-            }
-
-            // check if file placeholder was present
-            if (!got_file_placeholder)
-            {
-                // append png file path as last argument
-                args.emplace_back(full_file_path);
-            }
 
-            // create process and options
-            reproc::process process;
-            reproc::options options;
-            options.stop = {
-                { reproc::stop::noop, reproc::milliseconds(0) },
-                { reproc::stop::terminate, reproc::milliseconds(5000) },
-                { reproc::stop::kill, reproc::milliseconds(2000) },
-            };
+                // check if file placeholder was present
+                if (!got_file_placeholder)
+                {
+                    // append png file path as last argument
+                    args.emplace_back(full_file_path);
+                }
 
-            // execute user command
-            std::error_code ec = process.start(args, options);
+                // create process and options
+                reproc::process process;
+                reproc::options options;
+                options.stop = {
+                    { reproc::stop::noop, reproc::milliseconds(0) },
+                    { reproc::stop::terminate, reproc::milliseconds(5000) },
+                    { reproc::stop::kill, reproc::milliseconds(2000) },
+                };
 
-            // check for operating system errors
-            if (ec)
-            {
-                std::cerr << "os error: " << ec.value() << ": " << ec.message() << std::endl;
-                continue; // nothing more to do here, continue to next frame
-            }
+                // execute user command
+                std::error_code ec = process.start(args, options);
 
-            // fetch application output
-            std::string output, error;
-            reproc::sink::string sink_out(output);
-            reproc::sink::string sink_err(error);
-            ec = reproc::drain(process, sink_out, sink_err);
+                // check for operating system errors
+                if (ec)
+                {
+                    std::cerr << "os error: " << ec.value() << ": " << ec.message() << std::endl;
+                    continue; // nothing more to do here, continue to next file
+                }
 
-            // check for operating system errors
-            if (ec)
-            {
-                std::cerr << "os error: " << ec.value() << ": " << ec.message() << std::endl;
-                continue; // nothing more to do here, continue to next frame
-            }
+                // fetch application output
+                std::string output, error;
+                reproc::sink::string sink_out(output);
+                reproc::sink::string sink_err(error);
+                ec = reproc::drain(process, sink_out, sink_err);
 
-            // maximum wait time before killing the process after graceful exit request
-            options.stop.first = { reproc::stop::wait, reproc::milliseconds(10000) };
+                // check for operating system errors
+                if (ec)
+                {
+                    std::cerr << "os error: " << ec.value() << ": " << ec.message() << std::endl;
+                    continue; // nothing more to do here, continue to next file
+                }
 
-            // receive status code
-            int status = 0;
-            std::tie(status, ec) = process.stop(options.stop);
+                // maximum wait time before killing the process after graceful exit request
+                options.stop.first = { reproc::stop::wait, reproc::milliseconds(10000) };
 
-            // check for operating system errors
-            if (ec)
-            {
-                std::cerr << "os error: " << ec.value() << ": " << ec.message() << std::endl;
-                continue; // nothing more to do here, continue to next frame
-            }
+                // receive status code
+                int status = 0;
+                std::tie(status, ec) = process.stop(options.stop);
 
-            if (status != 0)
-            {
-                std::cout << "warning: process did not end normally. got exit status: " << status << std::endl;
+                // check for operating system errors
+                if (ec)
+                {
+                    std::cerr << "os error: " << ec.value() << ": " << ec.message() << std::endl;
+                    continue; // nothing more to do here, continue to next file
+                }
 
-                if (verbose)
+                if (status != 0)
                 {
-                    std::cerr << "output stream:\n" << output << std::endl;
-                    std::cerr << "error stream:\n" << error << std::endl;
+                    std::cout << "warning: process did not end normally. got exit status: " << status << std::endl;
+
+                    if (verbose)
+                    {
+                        std::cerr << "output stream:\n" << output << std::endl;
+                        std::cerr << "error stream:\n" << error << std::endl;
+                    }
                 }
             }
         }
@@ -7,6 +7,9 @@
 #include "libs/lodepng/lodepng.hpp"
 
 #include "helpers.hpp"
+#include "composite.hpp"
+#include "effects.hpp"
+#include "textshaping.hpp"
 
 #include <QGuiApplication>
 #include <QPaintDevice>
@@ -20,6 +23,10 @@
 #include <QRegularExpression>
 
 #include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
 
 // TODO:
 //  -> furigana-spacing
@@ -51,16 +58,20 @@ struct FuriganaPair
     int length = 0;
 };
 
-static const QString getLineWithoutFurigana(const QString &line, QList<FuriganaPair> *furiganaPairs = nullptr)
+static const QRegularExpression &furiganaCapture()
 {
     // matches {漢字|かんじ} non-greedy and creates matching groups
-    static const QRegularExpression furiganaCapture(R"(\{(.*?)\|(.*?)\})");
+    static const QRegularExpression capture(R"(\{(.*?)\|(.*?)\})");
+    return capture;
+}
 
-    QString newLine = line.split(furiganaCapture).join("|");
+static const QString getLineWithoutFurigana(const QString &line, QList<FuriganaPair> *furiganaPairs = nullptr)
+{
+    QString newLine = line.split(furiganaCapture()).join("|");
 
     QList<QRegularExpressionMatch> lastMatchs;
     int lastIndex = 0;
-    auto matches = furiganaCapture.globalMatch(line);
+    auto matches = furiganaCapture().globalMatch(line);
     while (matches.hasNext())
     {
         auto match = matches.next();
@@ -188,7 +199,8 @@ static int getFuriganaDistanceValue(PNGRenderer::FuriganaDistance furiganaDistan
 }
 
 // QPainter can't do this apparently, so we need to brute force it instead :(
-static void drawTextBorder(QPainter *painter, int x, int y, unsigned long borderSize, int width, int height, int alignment, const QString &text)
+template<typename Draw>
+static void drawBorderRings(QPainter *painter, unsigned long borderSize, Draw draw)
 {
     // don't do anything when border size is zero
     if (borderSize == 0)
@@ -208,28 +220,73 @@ static void drawTextBorder(QPainter *painter, int x, int y, unsigned long border
         const auto i = int(b);
 
         // top left
-        painter->drawText(x-i, y-i, width, height, alignment, text);
+        draw(-i, -i);
         // top
-        painter->drawText(x, y-i, width, height, alignment, text);
+        draw(0, -i);
         // top right
-        painter->drawText(x+i, y-i, width, height, alignment, text);
+        draw(i, -i);
         // left
-        painter->drawText(x-i, y, width, height, alignment, text);
+        draw(-i, 0);
         // middle
-        painter->drawText(x, y, width, height, alignment, text);
+        draw(0, 0);
         // right
-        painter->drawText(x+i, y, width, height, alignment, text);
+        draw(i, 0);
         // bottom left
-        painter->drawText(x-i, y+i, width, height, alignment, text);
+        draw(-i, i);
         // bottom
-        painter->drawText(x, y+i, width, height, alignment, text);
+        draw(0, i);
         // bottom right
-        painter->drawText(x+i, y+i, width, height, alignment, text);
+        draw(i, i);
     }
 
     painter->setOpacity(1);
 }
 
+static void drawTextBorder(QPainter *painter, int x, int y, unsigned long borderSize, int width, int height, int alignment, const QString &text)
+{
+    drawBorderRings(painter, borderSize, [&](int dx, int dy) {
+        painter->drawText(x + dx, y + dy, width, height, alignment, text);
+    });
+}
+
+static void drawTextBorder(QPainter *painter, const ShapedText &shaped, const QRect &rect, unsigned long borderSize, int alignment)
+{
+    drawBorderRings(painter, borderSize, [&](int dx, int dy) {
+        drawShapedText(painter, shaped, rect.translated(dx, dy), alignment);
+    });
+}
+
+static void unionInkedRect(QPainter *painter, QRect *inked, const QRect &rect)
+{
+    // glyphs can paint outside of their layout rect (bearings, italic overhang, antialiasing)
+    const auto margin = painter->fontMetrics().height() / 2;
+    *inked |= painter->transform().mapRect(rect).adjusted(-margin, -margin, margin, margin);
+}
+
+static void drawInkedText(QPainter *painter, QRect *inked, int x, int y, int width, int height, int alignment, const QString &text, QRect *drawnPosition = nullptr)
+{
+    QRect rect;
+    painter->drawText(x, y, width, height, alignment, text, &rect);
+    unionInkedRect(painter, inked, rect);
+
+    if (drawnPosition)
+    {
+        *drawnPosition = rect;
+    }
+}
+
+static void drawInkedText(QPainter *painter, QRect *inked, const ShapedText &shaped, const QRect &rect, int alignment, QRect *drawnPosition = nullptr)
+{
+    drawShapedText(painter, shaped, rect, alignment);
+    const auto bounds = alignedTextRect(shaped, rect, alignment).toAlignedRect();
+    unionInkedRect(painter, inked, bounds);
+
+    if (drawnPosition)
+    {
+        *drawnPosition = bounds;
+    }
+}
+
 struct DrawnPosition
 {
     QRect pos;
@@ -282,6 +339,104 @@ static VerticalRenderingSettings verticalConfigurePainter(QPainter *painter, QSt
     return {pos, size, isRotated};
 }
 
+static EffectColor effectColor(const std::string &color)
+{
+    const QColor c(color.c_str());
+    return {
+        (unsigned char) c.red(),
+        (unsigned char) c.green(),
+        (unsigned char) c.blue(),
+        (unsigned char) c.alpha(),
+    };
+}
+
+// per-thread scratch memory for rendering subtitle frames
+// all buffers only grow to fit the largest frame rendered on the current thread
+// and are reused for all following frames to avoid allocator traffic
+struct FrameScratch
+{
+    FrameScratch()
+    {
+        // lodepng frees the palettes in the state destructor, so they must be allocated with malloc
+        // a palette has at most 256 RGBA entries
+        state.info_raw.palette = static_cast<unsigned char*>(std::malloc(1024));
+        state.info_png.color.palette = static_cast<unsigned char*>(std::malloc(1024));
+
+        // input pixel data
+        state.info_raw.bitdepth = 8;
+        state.info_raw.colortype = LCT_PALETTE;
+
+        // output png config
+        state.info_png.color.bitdepth = 8;
+        state.info_png.color.colortype = LCT_PALETTE;
+
+        // disable compression for speed, file size is width * height + palette + png sections
+        state.encoder.zlibsettings.btype = 0;
+        state.encoder.zlibsettings.use_lz77 = 0;
+        state.encoder.zlibsettings.windowsize = 8;
+        state.encoder.zlibsettings.nicematch = 8;
+        state.encoder.zlibsettings.minmatch = 0;
+        state.encoder.zlibsettings.lazymatching = 0;
+    }
+
+    // grows the canvas buffers to fit an image of the given size
+    void reserve(int width, int height)
+    {
+        const auto bytes = std::size_t(width) * std::size_t(height) * 4;
+
+        if (fill.size() < bytes)
+        {
+            fill.resize(bytes);
+            outline.resize(bytes);
+        }
+    }
+
+    // sets the palette used by the png encoder
+    // returns false when the palette has more entries than the preallocated palettes
+    bool setPalette(const std::vector<unsigned char> &pal)
+    {
+        if (pal.size() > 1024)
+        {
+            return false;
+        }
+
+        std::memcpy(state.info_raw.palette, pal.data(), pal.size());
+        std::memcpy(state.info_png.color.palette, pal.data(), pal.size());
+        state.info_raw.palettesize = pal.size() / 4;
+        state.info_png.color.palettesize = pal.size() / 4;
+        return true;
+    }
+
+    // RGBA8888 premultiplied canvases for the main text and the text border
+    std::vector<unsigned char> fill;
+    std::vector<unsigned char> outline;
+
+    // quantized and cropped RGBA8888 pixel data
+    std::vector<unsigned char> reduced;
+
+    // 8-bit colormap pixel data
+    std::vector<unsigned char> indexed;
+
+    // 8-bit colormap pixel data of a part of the frame
+    std::vector<unsigned char> part;
+
+    // palette creation
+    std::vector<std::uint32_t> colors;
+    std::vector<unsigned char> palette;
+
+    // distance field effects
+    DistanceScratch distance;
+
+    // png encoder state with preallocated palettes
+    lodepng::State state;
+};
+
+static FrameScratch &frameScratch()
+{
+    thread_local FrameScratch scratch;
+    return scratch;
+}
+
 } // anonymous namespace
 
 PNGRenderer::PNGRenderer()
@@ -304,7 +459,54 @@ PNGRenderer::PNGRenderer(const std::string &text, const std::string &fontFamily,
     }
 }
 
-const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned long *color_count) const
+const std::vector<char> PNGRenderer::render(size_t *size, pos_t *pos, unsigned long *color_count) const
+{
+    // horizontal text without any Furigana skips all Furigana related layout work,
+    // the regular expression doesn't match across lines, so one check covers all lines
+    const bool plainHorizontal = !_vertical && !furiganaCapture().match(QString::fromUtf8(_text.c_str())).hasMatch();
+
+    if (plainHorizontal)
+    {
+        return renderLayout<true>(size, pos, color_count, nullptr);
+    }
+
+    return renderLayout<false>(size, pos, color_count, nullptr);
+}
+
+const std::vector<char> PNGRenderer::renderGeneral(size_t *size, pos_t *pos, unsigned long *color_count) const
+{
+    return renderLayout<false>(size, pos, color_count, nullptr);
+}
+
+const std::vector<PNGRenderer::part_t> PNGRenderer::renderParts(size_t *size, pos_t *pos, unsigned long *color_count) const
+{
+    const bool plainHorizontal = !_vertical && !furiganaCapture().match(QString::fromUtf8(_text.c_str())).hasMatch();
+
+    // the size is needed for the single part
+    size_t frameSize;
+    std::vector<part_t> parts;
+    auto image = plainHorizontal ?
+        renderLayout<true>(&frameSize, pos, color_count, &parts) :
+        renderLayout<false>(&frameSize, pos, color_count, &parts);
+
+    if (parts.empty())
+    {
+        part_t whole;
+        whole.size = frameSize;
+        whole.image = std::move(image);
+        parts.emplace_back(std::move(whole));
+    }
+
+    if (size)
+    {
+        (*size) = frameSize;
+    }
+
+    return parts;
+}
+
+template<bool PlainHorizontal>
+const std::vector<char> PNGRenderer::renderLayout(size_t *_size, pos_t *_pos, unsigned long *color_count, std::vector<part_t> *_parts) const
 {
     const QString text = QString::fromUtf8(_text.c_str());
     const QFont font = compileFont(_fontFamily, _fontSize, _fontStyle);
@@ -322,10 +524,18 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
     QFontMetrics mainMetrics(font);
     QFontMetrics furiMetrics(fontFurigana);
 
+    // shaping results of all horizontal lines, reused for drawing
+    QVector<ShapedText> shapedLines;
+    shapedLines.reserve(lines.size());
+
     for (auto&& line : lines)
     {
         // take metrics without Furigana
-        auto lineWithoutFurigana = getLineWithoutFurigana(line);
+        QString lineWithoutFurigana = line;
+        if constexpr (!PlainHorizontal)
+        {
+            lineWithoutFurigana = getLineWithoutFurigana(line);
+        }
 
         if (lineWithoutFurigana.size() > longestLineCount)
         {
@@ -333,28 +543,18 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
         }
 
         auto mainRect = mainMetrics.boundingRect(lineWithoutFurigana);
-        auto furiRect = furiMetrics.boundingRect(line);
 
-        for (auto&& c : lineWithoutFurigana)
+        // bounding rect may not have enough width, use another function for this
+        // horizontal lines are shaped once here and drawn from the glyph runs, vertical text is drawn per character
+        if (PlainHorizontal || !_vertical)
         {
-            auto glyphRect = mainMetrics.boundingRect(c);
-            auto furiGlyphRect = furiMetrics.boundingRect(c);
-
-            // maximum glyph width
-            if (glyphRect.size().width() > glyphWidth)
-            {
-                glyphWidth = glyphRect.size().width();
-            }
-
-            // maximum Furigana glyph width
-            if (furiGlyphRect.size().width() > furiGlyphWidth)
-            {
-                furiGlyphWidth = furiGlyphRect.size().width();
-            }
+            shapedLines.append(shapeText(lineWithoutFurigana, font));
+            mainRect.setWidth(qRound(shapedLines.last().advance) + 10);
+        }
+        else
+        {
+            mainRect.setWidth(mainMetrics.horizontalAdvance(lineWithoutFurigana) + 10);
         }
-
-        // bounding rect may not have enough width, use another function for this
-        mainRect.setWidth(mainMetrics.horizontalAdvance(lineWithoutFurigana) + 10);
 
         // maximum total width
         if (mainRect.size().width() > size.width())
@@ -369,10 +569,34 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
             lineHeight = mainRect.height();
         }
 
-        // maximum Furigana height
-        if (furiRect.height() > furiLineHeight)
+        // glyph widths and Furigana heights are only needed for vertical text and Furigana
+        if constexpr (!PlainHorizontal)
         {
-            furiLineHeight = furiRect.height();
+            auto furiRect = furiMetrics.boundingRect(line);
+
+            for (auto&& c : lineWithoutFurigana)
+            {
+                auto glyphRect = mainMetrics.boundingRect(c);
+                auto furiGlyphRect = furiMetrics.boundingRect(c);
+
+                // maximum glyph width
+                if (glyphRect.size().width() > glyphWidth)
+                {
+                    glyphWidth = glyphRect.size().width();
+                }
+
+                // maximum Furigana glyph width
+                if (furiGlyphRect.size().width() > furiGlyphWidth)
+                {
+                    furiGlyphWidth = furiGlyphRect.size().width();
+                }
+            }
+
+            // maximum Furigana height
+            if (furiRect.height() > furiLineHeight)
+            {
+                furiLineHeight = furiRect.height();
+            }
         }
     }
 
@@ -380,17 +604,20 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
     size.setHeight((size.height() * lines.size()) - (_lineSpaceReduction * (lines.size() - 1)) + 10);
 
     // increase height to fit Furigana
-    for (auto&& line : lines)
+    if constexpr (!PlainHorizontal)
     {
-        bool hasFurigana = hasLineFurigana(line);
-        if (hasFurigana)
+        for (auto&& line : lines)
         {
-            size.setHeight(size.height() + furiLineHeight);
+            bool hasFurigana = hasLineFurigana(line);
+            if (hasFurigana)
+            {
+                size.setHeight(size.height() + furiLineHeight);
+            }
         }
     }
 
     // image size for vertical rendering
-    if (_vertical)
+    if (!PlainHorizontal && _vertical)
     {
         // fix image height to fit all Kanji
         size.setHeight((lineHeight * longestLineCount) - (_lineSpaceReduction * (longestLineCount - 1)) + 10);
@@ -409,9 +636,40 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
         }
     }
 
-    // create in-memory image
-    QImage image(size, QImage::Format_RGBA8888_Premultiplied);
-    QImage background(size, QImage::Format_RGBA8888_Premultiplied);
+    // effects rendered from the distance field of the text
+    const bool distanceFieldBorder = _borderMode == BorderMode::DistanceField;
+    DistanceEffects effects;
+    effects.shadow = _shadowOffsetX != 0 || _shadowOffsetY != 0 || _shadowSoftness > 0;
+    effects.shadowOffsetX = _shadowOffsetX;
+    effects.shadowOffsetY = _shadowOffsetY;
+    effects.shadowSoftness = float(_shadowSoftness);
+    effects.shadowColor = effectColor(_shadowColor);
+    effects.glowSize = float(_glowSize);
+    effects.glowColor = effectColor(_glowColor);
+    if (distanceFieldBorder)
+    {
+        effects.outlineSize = float(_borderSize);
+        effects.outlineColor = effectColor(_borderColor);
+    }
+
+    // the canvas must have enough space around the text to fit all effects
+    int effectMargin = int(std::ceil(effects.outlineSize));
+    if (effects.shadow)
+    {
+        effectMargin += std::max(std::abs(_shadowOffsetX), std::abs(_shadowOffsetY)) + int(std::ceil(_shadowSoftness));
+    }
+    effectMargin += int(std::ceil(std::max(0.0, _glowSize)));
+    const QSize canvas = size + QSize(effectMargin * 2, effectMargin * 2);
+
+    // text borders are drawn by the distance field instead
+    const auto borderSize = distanceFieldBorder ? 0 : _borderSize;
+    const auto furiganaBorderSize = distanceFieldBorder ? 0 : _furiganaBorderSize;
+
+    // create in-memory image on top of the scratch memory of this thread
+    auto &scratch = frameScratch();
+    scratch.reserve(canvas.width(), canvas.height());
+    QImage image(scratch.fill.data(), canvas.width(), canvas.height(), QImage::Format_RGBA8888_Premultiplied);
+    QImage background(scratch.outline.data(), canvas.width(), canvas.height(), QImage::Format_RGBA8888_Premultiplied);
     image.fill(Qt::transparent);
     background.fill(Qt::transparent);
 
@@ -428,6 +686,10 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
     bgPainter.setRenderHint(QPainter::Antialiasing, true);
     bgPainter.setRenderHint(QPainter::TextAntialiasing, true);
 
+    // keep the text layout independent of the effect margin
+    painter.translate(effectMargin, effectMargin);
+    bgPainter.translate(effectMargin, effectMargin);
+
     // determine text alignment
     Qt::AlignmentFlag alignment = getQtTextAlignmentFlag(_textJustify);
 
@@ -439,6 +701,9 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
     // get furigana distance value
     int furiganaDistance = getFuriganaDistanceValue(_furiganaDistance);
 
+    // area of the main image where text was drawn
+    QRect inked;
+
     // alignment helper
     int nextXAdjust = alignment == Qt::AlignCenter ? 0 : 5;
     int nextYAdjust = 5;
@@ -446,11 +711,15 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
     for (auto i = 0; i < lines.size(); ++i)
     {
         QList<FuriganaPair> furiganaPairs;
-        auto lineWithoutFurigana = getLineWithoutFurigana(lines.at(i), &furiganaPairs);
-        bool hasFurigana = !furiganaPairs.isEmpty();
+        QString lineWithoutFurigana = lines.at(i);
+        if constexpr (!PlainHorizontal)
+        {
+            lineWithoutFurigana = getLineWithoutFurigana(lines.at(i), &furiganaPairs);
+        }
+        const bool hasFurigana = !PlainHorizontal && !furiganaPairs.isEmpty();
 
         // vertical rendering
-        if (_vertical)
+        if (!PlainHorizontal && _vertical)
         {
             int adjustX = 0;
 
@@ -495,12 +764,12 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
 
                 // draw text outline and shadow
                 bgPainter.setPen(QColor(_borderColor.c_str()));
-                drawTextBorder(&bgPainter, x - bgSettings.pos.x(), y - bgSettings.pos.y(), _borderSize, glyphWidth, bgSettings.size.height(), Qt::AlignCenter, ch);
+                drawTextBorder(&bgPainter, x - bgSettings.pos.x(), y - bgSettings.pos.y(), borderSize, glyphWidth, bgSettings.size.height(), Qt::AlignCenter, ch);
 
                 // draw main text
                 QRect drawnPosition;
                 painter.setPen(QColor(_fontColor.c_str()));
-                painter.drawText(x - mainSettings.pos.x(), y - mainSettings.pos.y(), glyphWidth, mainSettings.size.height(), Qt::AlignCenter, ch, &drawnPosition);
+                drawInkedText(&painter, &inked, x - mainSettings.pos.x(), y - mainSettings.pos.y(), glyphWidth, mainSettings.size.height(), Qt::AlignCenter, ch, &drawnPosition);
                 drawnPositions.append({drawnPosition, halfwidth});
 
                 y += mainSettings.size.height() - _lineSpaceReduction;
@@ -549,11 +818,11 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
                         {
                             // draw text outline and shadow
                             bgPainter.setPen(QColor(_borderColor.c_str()));
-                            drawTextBorder(&bgPainter, startX, startY, _furiganaBorderSize, furiGlyphWidth, furiLineHeight, Qt::AlignCenter, ch);
+                            drawTextBorder(&bgPainter, startX, startY, furiganaBorderSize, furiGlyphWidth, furiLineHeight, Qt::AlignCenter, ch);
 
                             // draw main text
                             painter.setPen(QColor(_furiganaFontColor.c_str()));
-                            painter.drawText(startX, startY, furiGlyphWidth, furiLineHeight, Qt::AlignCenter, ch);
+                            drawInkedText(&painter, &inked, startX, startY, furiGlyphWidth, furiLineHeight, Qt::AlignCenter, ch);
                         }
 
                         // draw on left when multiple lines are present
@@ -564,11 +833,11 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
 
                             // draw text outline and shadow
                             bgPainter.setPen(QColor(_borderColor.c_str()));
-                            drawTextBorder(&bgPainter, startX, startY, _furiganaBorderSize, furiGlyphWidth, furiLineHeight, Qt::AlignCenter, ch);
+                            drawTextBorder(&bgPainter, startX, startY, furiganaBorderSize, furiGlyphWidth, furiLineHeight, Qt::AlignCenter, ch);
 
                             // draw main text
                             painter.setPen(QColor(_furiganaFontColor.c_str()));
-                            painter.drawText(startX, startY, furiGlyphWidth, furiLineHeight, Qt::AlignCenter, ch);
+                            drawInkedText(&painter, &inked, startX, startY, furiGlyphWidth, furiLineHeight, Qt::AlignCenter, ch);
                         }
 
                         // advance Y position
@@ -601,7 +870,9 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
             // Furigana on bottom
             //  no Y adjust from top needed
 
-            // the position where QPainter has drawn the text (required to render Furigana later)
+            // the position where the text is drawn (required to render Furigana later)
+            const auto &shapedLine = shapedLines.at(i);
+            const QRect lineRect(nextXAdjust, y, size.width(), lineHeight);
             QRect drawnPosition;
 
             // set main font
@@ -610,11 +881,11 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
 
             // draw text outline and shadow
             bgPainter.setPen(QColor(_borderColor.c_str()));
-            drawTextBorder(&bgPainter, nextXAdjust, y, _borderSize, size.width(), lineHeight, alignment, lineWithoutFurigana);
+            drawTextBorder(&bgPainter, shapedLine, lineRect, borderSize, alignment);
 
             // draw main text
             painter.setPen(QColor(_fontColor.c_str()));
-            painter.drawText(nextXAdjust, y, size.width(), lineHeight, alignment, lineWithoutFurigana, &drawnPosition);
+            drawInkedText(&painter, &inked, shapedLine, lineRect, alignment, &drawnPosition);
 
             // set position when given
             if (_pos)
@@ -643,15 +914,18 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
 
                 for (auto&& f : furiganaPairs)
                 {
+                    // shaped once for all border rings and both positions
+                    const auto shapedFurigana = shapeText(f.furigana, fontFurigana);
+
                     // get real width of Kanji and Furigana
                     auto kanjiWidth = mainMetrics.horizontalAdvance(f.kanji);
-                    auto furiWidth = furiMetrics.horizontalAdvance(f.furigana);
+                    auto furiWidth = qRound(shapedFurigana.advance);
 
                     // calculate starting position for Furigana
                     auto startX = mainMetrics.horizontalAdvance(lineWithoutFurigana, f.startPos);
                     // center align Furigana
                     startX += (kanjiWidth / 2) - (furiWidth / 2);
-                    // adjust position where text was actually drawn by QPainter
+                    // adjust position where the line is drawn
                     startX += drawnPosition.x();
 
                     auto realDistance = furiganaDistance;
@@ -665,13 +939,15 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
                             realDistance = lineHeight / 2;
                         }
 
+                        const QRect furiRect(startX, y - realDistance, furiWidth, furiLineHeight);
+
                         // draw text outline and shadow
                         bgPainter.setPen(QColor(_borderColor.c_str()));
-                        drawTextBorder(&bgPainter, startX, y - realDistance, _furiganaBorderSize, furiWidth, furiLineHeight, 0, f.furigana);
+                        drawTextBorder(&bgPainter, shapedFurigana, furiRect, furiganaBorderSize, 0);
 
                         // draw main text
                         painter.setPen(QColor(_furiganaFontColor.c_str()));
-                        painter.drawText(startX, y - realDistance, furiWidth, furiLineHeight, 0, f.furigana);
+                        drawInkedText(&painter, &inked, shapedFurigana, furiRect, 0);
                     }
 
                     // draw on bottom when multiple lines are present
@@ -684,14 +960,15 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
                         }
 
                         auto dY = (y + lineHeight) - realDistance;
+                        const QRect furiRect(startX, dY, furiWidth, furiLineHeight);
 
                         // draw text outline and shadow
                         bgPainter.setPen(QColor(_borderColor.c_str()));
-                        drawTextBorder(&bgPainter, startX, dY, _furiganaBorderSize, furiWidth, furiLineHeight, 0, f.furigana);
+                        drawTextBorder(&bgPainter, shapedFurigana, furiRect, furiganaBorderSize, 0);
 
                         // draw main text
                         painter.setPen(QColor(_furiganaFontColor.c_str()));
-                        painter.drawText(startX, dY, furiWidth, furiLineHeight, 0, f.furigana);
+                        drawInkedText(&painter, &inked, shapedFurigana, furiRect, 0);
                     }
                 }
             }
@@ -700,34 +977,54 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
 
     // end painting on background for manipulations
     bgPainter.end();
+    painter.end();
+
+    // positions are relative to the canvas
+    if (_pos)
+    {
+        _pos->x += unsigned(effectMargin);
+        _pos->y += unsigned(effectMargin);
+    }
+
+    // the composited subtitle frame
+    const QImage *frame = &background;
 
-    // apply gaussian blur on background
-    Magick::Image blurred(Magick::Blob(background.constBits(), std::size_t(size.width() * size.height() * 4)),
-                          Magick::Geometry(std::size_t(size.width()), std::size_t(size.height())), 8, "RGBA");
-    blurred.gaussianBlur(_gaussianBlurRadius, _gaussianBlurSigma);
-    //blurred.shadow(); // saved for later
-    Magick::Blob blurredData;
-    blurred.write(&blurredData, "RGBA", 8);
-    QImage bg(reinterpret_cast<const unsigned char*>(blurredData.data()), size.width(), size.height(), QImage::Format_RGBA8888_Premultiplied);
-    background = bg;
+    if (distanceFieldBorder)
+    {
+        // outline, shadow and glow are all rendered from the distance field of the main text
+        applyDistanceEffects(image.bits(), unsigned(canvas.width()), unsigned(canvas.height()), effects, scratch.distance);
+        frame = &image;
+    }
+    else
+    {
+        // apply gaussian blur on background
+        // the blurred pixels are written back into the background canvas
+        Magick::Image blurred(std::size_t(canvas.width()), std::size_t(canvas.height()), "RGBA", Magick::CharPixel, background.constBits());
+        blurred.gaussianBlur(_gaussianBlurRadius, _gaussianBlurSigma);
+        blurred.write(0, 0, std::size_t(canvas.width()), std::size_t(canvas.height()), "RGBA", Magick::CharPixel, background.bits());
+
+        // merge main image into background so that it is in the foreground
+        // only the area where text was drawn needs to be composited
+        inked &= image.rect();
+        if (!inked.isEmpty())
+        {
+            compositeSourceOver(background.bits(), image.constBits(), unsigned(canvas.width()), unsigned(canvas.height()),
+                                unsigned(inked.x()), unsigned(inked.y()), unsigned(inked.width()), unsigned(inked.height()));
+        }
 
-    // merge main image into background so that it is in the foreground
-    bgPainter.begin(&background);
-    bgPainter.drawImage(0, 0, image);
+        // shadow and glow around the text and its blurred border
+        applyDistanceEffects(background.bits(), unsigned(canvas.width()), unsigned(canvas.height()), effects, scratch.distance);
+    }
 
     // reduce color count to be BDSup PGS compliant
     // limited to 255 colors per subtitle frame
-    bgPainter.end();
-    background.setColorCount(255);
-
     // Documentation: https://imagemagick.org/Magick++/Image++.html
-    Magick::Image reduced(Magick::Blob(background.constBits(), std::size_t(size.width() * size.height() * 4)),
-                          Magick::Geometry(std::size_t(size.width()), std::size_t(size.height())), 8, "RGBA");
+    Magick::Image reduced(std::size_t(canvas.width()), std::size_t(canvas.height()), "RGBA", Magick::CharPixel, frame->constBits());
     reduced.magick("RGBA");
     reduced.depth(8);
 
     // trim useless transparent border
-    // allows more text to be stored into the 0xffff bytes limited PGS frame
+    // keeps the objects small, every pixel takes 1 byte of the 4 MiB decoded object buffer of the player
     // needs recalculation of x,y pos for correct image placement
     auto cropFromTop = cropDetectionRow(&reduced, true);
     auto cropFromBottom = cropDetectionRow(&reduced, false);
@@ -773,24 +1070,20 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
     reduced.strip();
 
     // extract raw RGBA data from ImageMagick wrapped image
-    Magick::Blob reducedData;
-    reduced.write(&reducedData, "RGBA", 8);
+    const auto width = reduced.size().width();
+    const auto height = reduced.size().height();
+    scratch.reduced.resize(width * height * 4);
+    reduced.write(0, 0, width, height, "RGBA", Magick::CharPixel, scratch.reduced.data());
 
     // count colors and create palette
-    const auto pal = createPalette(reinterpret_cast<const unsigned char*>(reducedData.data()), reduced.size().width(), reduced.size().height());
-
-    // lodepng is deleting things is should not delete, this is making std::vector<> unhappy :(
-    unsigned char *pal_in = (unsigned char*) std::malloc(pal.size());
-    unsigned char *pal_out = (unsigned char*) std::malloc(pal.size());
-    std::memcpy(pal_in, pal.data(), pal.size());
-    std::memcpy(pal_out, pal.data(), pal.size());
-    // the above mess is deleted by lodepng
+    createPalette(scratch.reduced.data(), width, height, scratch.colors, scratch.palette);
+    const auto &pal = scratch.palette;
 
     // set image size when given
     if (_size)
     {
-        _size->width = unsigned(reduced.size().width());
-        _size->height = unsigned(reduced.size().height());
+        _size->width = unsigned(width);
+        _size->height = unsigned(height);
     }
 
     // set color count when given
@@ -801,27 +1094,27 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
     }
 
     // input color mode
-    LodePNGColorMode input_mode;
-    input_mode.bitdepth = 8;
-    input_mode.colortype = LCT_RGBA;
+    LodePNGColorMode input_mode = lodepng_color_mode_make(LCT_RGBA, 8);
 
     // output color mode
-    LodePNGColorMode output_mode;
-    output_mode.bitdepth = 8;
-    output_mode.colortype = LCT_PALETTE;
+    // note: the palette is owned by the scratch memory, lodepng must not free it
+    LodePNGColorMode output_mode = lodepng_color_mode_make(LCT_PALETTE, 8);
     output_mode.palette = const_cast<unsigned char*>(pal.data());
     output_mode.palettesize = pal.size() / 4;
     auto out_bpp = lodepng_get_bpp(&output_mode);
 
     // allocate output buffer
-    auto lode_out_size = (reduced.size().width() * reduced.size().height() * out_bpp + 7) / 8;
-    unsigned char *lode_out = (unsigned char*) std::malloc(lode_out_size);
+    scratch.indexed.resize((width * height * out_bpp + 7) / 8);
 
     // convert to palette mode
-    auto res = lodepng_convert(lode_out, reinterpret_cast<const unsigned char*>(reducedData.data()),
-                               &output_mode, &input_mode, reduced.size().width(), reduced.size().height());
+    auto res = lodepng_convert(scratch.indexed.data(), scratch.reduced.data(),
+                               &output_mode, &input_mode, unsigned(width), unsigned(height));
 
-    // check for conversion errors
+    // check for conversion errors, the palette of the 8-bit colormap PNG has at most 256 colors
+    if (res == 0 && !scratch.setPalette(pal))
+    {
+        res = 38; // the palette is too small or too big
+    }
     if (res != 0)
     {
         std::fprintf(stderr, "\nLodePNG error: %s\n", lodepng_error_text(res));
@@ -836,37 +1129,61 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
         return std::vector<char>(ptr, ptr + imageMagickPNG.length());
     }
 
-    // encode 8-bit colormap PNG
-    std::vector<unsigned char> png;
+    // cut the frame into tight parts between lines, every part is encoded with the palette of the whole frame
+    if (_parts)
+    {
+        bool visible[256] = {};
+        for (auto i = 0UL; i < pal.size() / 4 && i < 256; ++i)
+        {
+            visible[i] = pal[i * 4 + 3] != 0;
+        }
+
+        ImageRect rects[2];
+        const auto count = splitImage(scratch.indexed.data(), unsigned(width), unsigned(height), visible, _vertical, rects);
+        for (auto i = 0U; count > 1 && i < count; ++i)
+        {
+            const auto &rect = rects[i];
+            scratch.part.resize(std::size_t(rect.width) * rect.height);
+            for (auto y = 0U; y < rect.height; ++y)
+            {
+                std::memcpy(scratch.part.data() + std::size_t(y) * rect.width,
+                            scratch.indexed.data() + (rect.y + y) * width + rect.x, rect.width);
+            }
 
-    // input pixel data
-    lodepng::State state;
-    state.info_raw.palette = pal_in;
-    state.info_raw.palettesize = pal.size() / 4;
-    state.info_raw.bitdepth = 8;
-    state.info_raw.colortype = LCT_PALETTE;
-
-    // output png config
-    state.info_png.color.palette = pal_out;
-    state.info_png.color.palettesize = pal.size() / 4;
-    state.info_png.color.bitdepth = 8;
-    state.info_png.color.colortype = LCT_PALETTE;
-
-    // disable compression for speed, file size is width * height + palette + png sections
-    state.encoder.zlibsettings.btype = 0;
-    state.encoder.zlibsettings.use_lz77 = 0;
-    state.encoder.zlibsettings.windowsize = 8;
-    state.encoder.zlibsettings.nicematch = 8;
-    state.encoder.zlibsettings.minmatch = 0;
-    state.encoder.zlibsettings.lazymatching = 0;
-
-    res = lodepng::encode(png, lode_out, reduced.size().width(), reduced.size().height(), state);
-
-    // free output buffer
-    std::free(lode_out);
+            unsigned char *png = nullptr;
+            std::size_t png_size = 0;
+            res = lodepng_encode(&png, &png_size, scratch.part.data(), rect.width, rect.height, &scratch.state);
+            if (res != 0)
+            {
+                // fall back to the whole frame
+                std::free(png);
+                _parts->clear();
+                break;
+            }
+
+            part_t part;
+            part.x = rect.x;
+            part.y = rect.y;
+            part.size.width = rect.width;
+            part.size.height = rect.height;
+            part.image.assign(png, png + png_size);
+            std::free(png);
+            _parts->emplace_back(std::move(part));
+        }
+
+        if (!_parts->empty())
+        {
+            return {};
+        }
+    }
+
+    unsigned char *png = nullptr;
+    std::size_t png_size = 0;
+    res = lodepng_encode(&png, &png_size, scratch.indexed.data(), unsigned(width), unsigned(height), &scratch.state);
 
     if (res != 0)
     {
+        std::free(png);
         std::fprintf(stderr, "\nLodePNG error: %s\n", lodepng_error_text(res));
 
         // return ImageMagick PNG instead of Indexed PNG on error
@@ -880,5 +1197,7 @@ const std::vector<char> PNGRenderer::render(size_t *_size, pos_t *_pos, unsigned
     }
 
     // return indexed 8-bit colormap PNG data
-    return std::vector<char>(png.data(), png.data() + png.size());
+    const std::vector<char> data(png, png + png_size);
+    std::free(png);
+    return data;
 }
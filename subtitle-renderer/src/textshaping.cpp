@@ -0,0 +1,100 @@
+#include "textshaping.hpp"
+
+#include <QString>
+#include <QFont>
+#include <QPainter>
+#include <QTextLayout>
+
+#include <cmath>
+
+const ShapedText shapeText(const QString &text, const QFont &font)
+{
+    // the default device has the same resolution as the QImage which is drawn on
+    QTextLayout layout(text, font);
+    QTextOption option;
+    option.setWrapMode(QTextOption::NoWrap);
+    layout.setTextOption(option);
+
+    layout.beginLayout();
+    auto line = layout.createLine();
+    if (line.isValid())
+    {
+        line.setNumColumns(text.size());
+        line.setPosition(QPointF(0, 0));
+    }
+    layout.endLayout();
+
+    ShapedText shaped;
+    if (!line.isValid())
+    {
+        return shaped;
+    }
+
+    shaped.glyphRuns = line.glyphRuns();
+    shaped.width = line.naturalTextWidth();
+    shaped.advance = line.horizontalAdvance();
+    shaped.height = line.height();
+
+    return shaped;
+}
+
+const QRectF alignedTextRect(const ShapedText &shaped, const QRectF &rect, int alignment)
+{
+    const auto height = std::ceil(shaped.height);
+    qreal xoff = 0, yoff = 0;
+
+    if (alignment & Qt::AlignRight)
+    {
+        xoff = rect.width() - shaped.width;
+    }
+    else if (alignment & Qt::AlignHCenter)
+    {
+        xoff = (rect.width() - shaped.width) / 2;
+    }
+
+    if (alignment & Qt::AlignBottom)
+    {
+        yoff = rect.height() - height;
+    }
+    else if (alignment & Qt::AlignVCenter)
+    {
+        yoff = (rect.height() - height) / 2;
+    }
+
+    return QRectF(rect.x() + xoff, rect.y() + yoff, shaped.width, height);
+}
+
+void drawShapedText(QPainter *painter, const ShapedText &shaped, const QRectF &rect, int alignment)
+{
+    const auto bounds = alignedTextRect(shaped, rect, alignment);
+
+    // the bounds are aligned by the natural width, the glyphs by the advance of the line
+    qreal xoff = 0;
+    if (alignment & Qt::AlignRight)
+    {
+        xoff = rect.width() - shaped.advance;
+    }
+    else if (alignment & Qt::AlignHCenter)
+    {
+        xoff = (rect.width() - shaped.advance) / 2;
+    }
+
+    // text which doesn't fit is clipped to the rect
+    const bool clip = bounds.width() > rect.width() || bounds.height() > rect.height();
+    if (clip)
+    {
+        painter->save();
+        painter->setClipRect(rect, Qt::IntersectClip);
+    }
+
+    const QPointF origin(rect.x() + xoff, bounds.y());
+    for (auto&& run : shaped.glyphRuns)
+    {
+        painter->drawGlyphRun(origin, run);
+    }
+
+    if (clip)
+    {
+        painter->restore();
+    }
+}
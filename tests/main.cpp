@@ -4,6 +4,7 @@
 
 #include "srtparsertest.hpp"
 #include "renderertest.hpp"
+#include "pgscodectest.hpp"
 
 static bool has_failed_tests = false;
 
@@ -81,10 +82,27 @@ int main(void)
 
     test("PngRenderer::render_simple", renderer_tests::render_simple, "vtest11.png", " （あ）　「あ」　｛か｝\n　（あ） 「あ」＜か＞\nー あぁ──", true);
 
+    test("PngRenderer::render_plain_horizontal", renderer_tests::render_plain_horizontal);
+    test("PngRenderer::render_color_limit", renderer_tests::render_color_limit);
+    test("PngRenderer::shaped_text", renderer_tests::shaped_text);
+
+    // compositing
+    test("Composite::source_over", renderer_tests::composite_source_over);
+    test("Effects::distance_transform", renderer_tests::distance_transform);
+    test("Helpers::split_image", renderer_tests::split_image);
 
     // pgs
     test("PgsFrameCreator::render", renderer_tests::render_pgs_frames);
     test("PgsFrameCreator::render_with_command", renderer_tests::render_pgs_frames_with_command);
 
+    // pgs codec
+    test("PgsCodec::rle_encode", pgscodec_tests::rle_encode);
+    test("PgsCodec::color_convert", pgscodec_tests::color_convert);
+    test("PgsCodec::rle_decode", pgscodec_tests::rle_decode);
+    test("PgsCodec::decode_display_set", pgscodec_tests::decode_display_set);
+    test("PgsCodec::map_timestamps", pgscodec_tests::map_timestamps);
+    test("PgsCodec::seek_index", pgscodec_tests::seek_index);
+    test("PgsCodec::mux_matroska", pgscodec_tests::mux_matroska);
+
     return has_failed_tests ? 1 : 0;
 }
@@ -0,0 +1,404 @@
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <pgs/color.h>
+#include <pgs/decoder.h>
+#include <pgs/index.h>
+#include <pgs/matroska.h>
+#include <pgs/rle.h>
+#include <pgs/timing.h>
+
+namespace pgscodec_tests {
+
+bool rle_encode()
+{
+    // one line of every code: single pixels, short and long runs of color 0 and other colors
+    std::vector<unsigned char> line{0x05, 0x05, 0x00, 0x00, 0x00, 0x40};
+    line.insert(line.end(), 100, 0x00);
+    line.insert(line.end(), 70, 0x07);
+    line.push_back(0x3a);
+    line.insert(line.end(), 3, 0xff);
+
+    const std::vector<unsigned char> expected{
+        0x05, 0x05,             // 2 pixels of color 5
+        0x00, 0x03,             // 3 pixels of color 0
+        0x40,                   // 1 pixel of color 0x40
+        0x00, 0x40, 0x64,       // 100 pixels of color 0
+        0x00, 0xc0, 0x46, 0x07, // 70 pixels of color 7
+        0x3a,                   // 1 pixel of color 0x3a
+        0x00, 0x83, 0xff,       // 3 pixels of color 0xff
+        0x00, 0x00,             // end of line
+    };
+
+    std::vector<unsigned char> out(pgs_rle_bound(unsigned(line.size()), 1));
+    out.resize(pgs_rle_encode(line.data(), unsigned(line.size()), 1, line.size(), out.data()));
+
+    if (out != expected)
+    {
+        return false;
+    }
+
+    // random bitmaps with runs of all lengths, the vectorized runs must match the scalar reference
+    std::mt19937 random(11);
+
+    for (auto iteration = 0; iteration < 200; ++iteration)
+    {
+        const unsigned width = 1 + random() % 300;
+        const unsigned height = 1 + random() % 8;
+        const auto stride = width + random() % 5;
+
+        std::vector<unsigned char> indices(stride * height);
+        for (auto i = 0U; i < indices.size();)
+        {
+            const auto color = (unsigned char) (random() % 4 == 0 ? 0 : random() % 256);
+            const auto run = 1 + random() % (random() % 2 ? 4 : 100);
+            for (auto r = 0U; r < run && i < indices.size(); ++r, ++i)
+            {
+                indices[i] = color;
+            }
+        }
+
+        std::vector<unsigned char> vectorized(pgs_rle_bound(width, height));
+        std::vector<unsigned char> scalar(pgs_rle_bound(width, height));
+        vectorized.resize(pgs_rle_encode(indices.data(), width, height, stride, vectorized.data()));
+        scalar.resize(pgs_rle_encode_scalar(indices.data(), width, height, stride, scalar.data()));
+
+        if (vectorized != scalar)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool color_convert()
+{
+    struct Sample
+    {
+        const char *matrix;
+        unsigned char r, g, b;
+        unsigned char y, cb, cr;
+    };
+
+    // black, white and the primaries with the reference values of each matrix, rounded to the nearest step
+    const Sample samples[] = {
+        {"bt601",         0,   0,   0,     0, 128, 128},
+        {"bt601",         255, 255, 255,   255, 128, 128},
+        {"bt601",         255, 0,   0,     76,  85,  255},
+        {"bt601",         0,   0,   255,   29,  255, 107},
+        {"bt709",         255, 0,   0,     54,  99,  255},
+        {"bt709",         0,   255, 0,     182, 30,  12},
+        {"bt601-limited", 0,   0,   0,     16,  128, 128},
+        {"bt601-limited", 255, 255, 255,   235, 128, 128},
+        {"bt601-limited", 255, 0,   0,     81,  90,  240},
+        {"bt709-limited", 255, 0,   0,     63,  102, 240},
+        {"bt709-limited", 0,   255, 0,     173, 42,  26},
+        {"bt709-limited", 0,   0,   255,   32,  240, 118},
+    };
+
+    for (const auto &sample : samples)
+    {
+        pgs_color_matrix matrix;
+        pgs_color_range range;
+        if (!pgs_color_parse(sample.matrix, &matrix, &range))
+        {
+            return false;
+        }
+
+        pgs_color_table table;
+        pgs_color_table_init(&table, matrix, range);
+
+        unsigned char y, cb, cr;
+        pgs_color_convert(&table, sample.r, sample.g, sample.b, &y, &cb, &cr);
+        if (y != sample.y || cb != sample.cb || cr != sample.cr)
+        {
+            return false;
+        }
+    }
+
+    pgs_color_matrix matrix;
+    pgs_color_range range;
+    return !pgs_color_parse("bt2020", &matrix, &range);
+}
+
+bool rle_decode()
+{
+    // encoded bitmaps decode to the original indices
+    std::mt19937 random(17);
+
+    for (auto iteration = 0; iteration < 100; ++iteration)
+    {
+        const unsigned width = 1 + random() % 300;
+        const unsigned height = 1 + random() % 8;
+
+        std::vector<unsigned char> indices(width * height);
+        for (auto i = 0U; i < indices.size();)
+        {
+            const auto color = (unsigned char) (random() % 4 == 0 ? 0 : random() % 256);
+            const auto run = 1 + random() % (random() % 2 ? 4 : 100);
+            for (auto r = 0U; r < run && i < indices.size(); ++r, ++i)
+            {
+                indices[i] = color;
+            }
+        }
+
+        std::vector<unsigned char> encoded(pgs_rle_bound(width, height));
+        encoded.resize(pgs_rle_encode(indices.data(), width, height, width, encoded.data()));
+
+        std::vector<unsigned char> decoded(indices.size());
+        if (!pgs_rle_decode(encoded.data(), encoded.size(), width, height, decoded.data()) || decoded != indices)
+        {
+            return false;
+        }
+    }
+
+    // lines which are too long or too short and missing data are rejected
+    std::vector<unsigned char> decoded(4);
+    const std::vector<unsigned char> toolong{0x00, 0x83, 0x05, 0x00, 0x00};
+    const std::vector<unsigned char> tooshort{0x05, 0x00, 0x00};
+    const std::vector<unsigned char> truncated{0x05, 0x05, 0x00};
+
+    return
+        !pgs_rle_decode(toolong.data(), toolong.size(), 2, 1, decoded.data()) &&
+        !pgs_rle_decode(tooshort.data(), tooshort.size(), 2, 1, decoded.data()) &&
+        !pgs_rle_decode(truncated.data(), truncated.size(), 2, 1, decoded.data());
+}
+
+bool decode_display_set()
+{
+    // epoch start with a 2x2 object at 10,20 in a single window, 2 palette entries
+    const std::vector<unsigned char> stream{
+        // PCS: 1920x1080, composition 7, epoch start, palette 0, object 0 in window 0, forced
+        0x50, 0x47, 0x00, 0x01, 0x5f, 0x90, 0x00, 0x00, 0x00, 0x00, 0x16, 0x00, 0x13,
+        0x07, 0x80, 0x04, 0x38, 0x10, 0x00, 0x07, 0x80, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x40, 0x00, 0x0a, 0x00, 0x14,
+        // WDS: window 0 at 10,20 with 2x2 pixels
+        0x50, 0x47, 0x00, 0x01, 0x5f, 0x90, 0x00, 0x00, 0x00, 0x00, 0x17, 0x00, 0x0a,
+        0x01, 0x00, 0x00, 0x0a, 0x00, 0x14, 0x00, 0x02, 0x00, 0x02,
+        // PDS: palette 0 version 0, entry 0 transparent, entry 1 white
+        0x50, 0x47, 0x00, 0x01, 0x5f, 0x90, 0x00, 0x00, 0x00, 0x00, 0x14, 0x00, 0x0c,
+        0x00, 0x00, 0x00, 0x10, 0x80, 0x80, 0x00, 0x01, 0xeb, 0x80, 0x80, 0xff,
+        // ODS: object 0 in a single fragment, lines "1 0" and "0 1"
+        0x50, 0x47, 0x00, 0x01, 0x5f, 0x90, 0x00, 0x00, 0x00, 0x00, 0x15, 0x00, 0x15,
+        0x00, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x0e, 0x00, 0x02, 0x00, 0x02,
+        0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x00,
+        // END
+        0x50, 0x47, 0x00, 0x01, 0x5f, 0x90, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00,
+    };
+
+    pgs_decoder decoder;
+    pgs_decoder_init(&decoder);
+
+    auto status = 0;
+    auto segments = 0;
+    for (size_t pos = 0, length = 0; pos < stream.size(); pos += length, ++segments)
+    {
+        pgs_segment segment;
+        length = pgs_segment_parse(stream.data() + pos, stream.size() - pos, &segment);
+        if (length == 0 || (status = pgs_decoder_push(&decoder, &segment)) == -1)
+        {
+            pgs_decoder_free(&decoder);
+            return false;
+        }
+    }
+
+    std::vector<unsigned char> indices(4);
+    const auto decoded = pgs_decoder_object(&decoder, 0, indices.data());
+    const auto &composition = decoder.composition;
+    const auto result =
+        status == 1 && segments == 5 &&
+        decoder.pts == 90000 &&
+        composition.width == 1920 && composition.height == 1080 &&
+        composition.number == 7 && composition.state == PGS_STATE_EPOCH_START &&
+        composition.count == 1 && composition.objects[0].forced &&
+        composition.objects[0].x == 10 && composition.objects[0].y == 20 &&
+        decoder.windowcount == 1 &&
+        decoder.palettes[0].entries[1][0] == 0xeb && decoder.palettes[0].entries[1][3] == 0xff &&
+        decoded && indices == std::vector<unsigned char>{1, 0, 0, 1};
+
+    pgs_decoder_free(&decoder);
+    return result;
+}
+
+bool map_timestamps()
+{
+    int code;
+    double frameticks;
+    if (!pgs_framerate_parse("29.97", &code, &frameticks) || code != 0x40 || frameticks != 3003.0 ||
+        pgs_framerate_parse("30", &code, &frameticks) || pgs_framerate_ticks(0x30) != 3600.0)
+    {
+        return false;
+    }
+
+    // 23.976 to 25 fps, 2 seconds later, an inserted scene of 5 seconds at 1:00 and a cut of 1 second at 2:00
+    pgs_timemap map;
+    pgs_timemap_init(&map);
+    map.scale = 24000.0 / 25025.0;
+    map.offset = 180000;
+    const auto added =
+        pgs_timemap_add(&map, 5400000, 450000) &&
+        pgs_timemap_add(&map, 10800000, 360000) &&
+        !pgs_timemap_add(&map, 10800000, 0);
+
+    const auto result = added && map.count == 2 &&
+        pgs_timemap_apply(&map, 0) == 180000 &&
+        pgs_timemap_apply(&map, 90090) == 266400 &&
+        pgs_timemap_apply(&map, 5399999) == 180000 + 5178820 &&
+        pgs_timemap_apply(&map, 5400000) == 180000 + 5178821 + 450000 &&
+        pgs_timemap_apply(&map, 10800000) == 180000 + 10357642 + 360000;
+
+    pgs_timemap_free(&map);
+    return result && map.edits == nullptr && map.scale == 1.0;
+}
+
+bool seek_index()
+{
+    // display sets without objects at 1s (epoch start), 2s (normal) and 3s (acquisition point)
+    std::vector<unsigned char> stream;
+    for (const auto &[pts, state] : std::vector<std::pair<unsigned, unsigned char>>{{90000, 0x80}, {180000, 0x00}, {270000, 0x40}})
+    {
+        const std::vector<unsigned char> pcs{
+            0x50, 0x47, (unsigned char) (pts >> 24), (unsigned char) (pts >> 16), (unsigned char) (pts >> 8), (unsigned char) pts,
+            0x00, 0x00, 0x00, 0x00, 0x16, 0x00, 0x0b,
+            0x07, 0x80, 0x04, 0x38, 0x10, 0x00, 0x00, state, 0x00, 0x00, 0x00,
+        };
+        stream.insert(stream.end(), pcs.begin(), pcs.end());
+        stream.insert(stream.end(), {0x50, 0x47, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00});
+    }
+
+    pgs_index built;
+    pgs_index_init(&built);
+    if (!pgs_index_build(&built, stream.data(), stream.size()) || built.count != 2 ||
+        built.entries[1].pts != 270000 || built.entries[1].offset != 74 || built.supsize != stream.size())
+    {
+        pgs_index_free(&built);
+        return false;
+    }
+
+    // serialized and read back
+    std::vector<unsigned char> data(pgs_index_bound(&built));
+    data.resize(pgs_index_serialize(&built, data.data()));
+    pgs_index_free(&built);
+
+    pgs_index index;
+    pgs_index_init(&index);
+    const auto parsed = pgs_index_parse(&index, data.data(), data.size()) && index.supsize == stream.size();
+    const auto *before = pgs_index_find(&index, 89999);
+    const auto *first = pgs_index_find(&index, 269999);
+    const auto *last = pgs_index_find(&index, 900000);
+    const auto result = parsed && data.size() == PGS_INDEX_HEADER_SIZE + 2 * PGS_INDEX_ENTRY_SIZE &&
+        before == nullptr &&
+        first && first->offset == 0 &&
+        last && last->pts == 270000 && last->offset == 74 &&
+        !pgs_index_parse(&index, data.data(), data.size() - 1);
+
+    pgs_index_free(&index);
+    return result;
+}
+
+bool mux_matroska()
+{
+    // display sets without objects, PCS and END
+    const auto displaysets = [](const std::vector<std::pair<unsigned, unsigned char>> &sets) {
+        std::vector<unsigned char> stream;
+        for (const auto &[pts, state] : sets)
+        {
+            const std::vector<unsigned char> pcs{
+                0x50, 0x47, (unsigned char) (pts >> 24), (unsigned char) (pts >> 16), (unsigned char) (pts >> 8), (unsigned char) pts,
+                0x00, 0x00, 0x00, 0x00, 0x16, 0x00, 0x0b,
+                0x07, 0x80, 0x04, 0x38, 0x10, 0x00, 0x00, state, 0x00, 0x00, 0x00,
+            };
+            stream.insert(stream.end(), pcs.begin(), pcs.end());
+            stream.insert(stream.end(), {0x50, 0x47, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00});
+        }
+        return stream;
+    };
+
+    // full track at 1s (epoch start) and 2s (normal), forced track at 1.5s (epoch start)
+    const auto full = displaysets({{90000, 0x80}, {180000, 0x00}});
+    const auto forced = displaysets({{135000, 0x80}});
+    const pgs_matroska_track tracks[2] = {
+        {full.data(), full.size(), "jpn", nullptr, 1, 0},
+        {forced.data(), forced.size(), "jpn", "Forced", 0, 1},
+    };
+
+    unsigned char *data = nullptr;
+    size_t size = 0;
+    if (!pgs_matroska_mux(tracks, 2, &data, &size))
+    {
+        return false;
+    }
+    const std::vector<unsigned char> file(data, data + size);
+    std::free(data);
+
+    // walks the elements of the segment, the cluster and the cues
+    std::vector<std::tuple<unsigned, long, unsigned, size_t>> blocks;
+    std::vector<unsigned long> cues;
+    unsigned long clustertime = 0;
+    const auto vint = [&](size_t &pos, bool marker) {
+        unsigned length = 1;
+        while (length < 8 && !(file[pos] & (0x80 >> (length - 1))))
+        {
+            ++length;
+        }
+        unsigned long value = marker ? file[pos] : file[pos] & (0xff >> length);
+        for (unsigned i = 1; i < length; ++i)
+        {
+            value = (value << 8) | file[pos + i];
+        }
+        pos += length;
+        return value;
+    };
+    const auto number = [&](size_t pos, size_t length) {
+        unsigned long value = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            value = (value << 8) | file[pos + i];
+        }
+        return value;
+    };
+    std::function<bool(size_t, size_t)> walk = [&](size_t pos, size_t end) {
+        while (pos < end)
+        {
+            const auto id = vint(pos, true);
+            const auto length = vint(pos, false);
+            if (pos + length > end)
+            {
+                return false;
+            }
+            if ((id == 0x18538067 || id == 0x1f43b675 || id == 0x1c53bb6b || id == 0xbb) && !walk(pos, pos + length))
+            {
+                return false;
+            }
+            if (id == 0xe7)
+            {
+                clustertime = number(pos, length);
+            }
+            else if (id == 0xb3)
+            {
+                cues.push_back(number(pos, length));
+            }
+            else if (id == 0xa3)
+            {
+                blocks.emplace_back(file[pos] & 0x7f, long(clustertime) + (short) number(pos + 1, 2), file[pos + 3], length - 4);
+            }
+            pos += length;
+        }
+        return pos == end;
+    };
+
+    // the display sets are stored without the magic number and timestamps, 14 bytes PCS and 3 bytes END
+    const auto truncated = std::vector<unsigned char>(full.begin(), full.end() - 13);
+    const pgs_matroska_track invalid{truncated.data(), truncated.size(), nullptr, nullptr, 0, 0};
+    return
+        file.size() > 4 && number(0, 4) == 0x1a45dfa3 && walk(0, file.size()) &&
+        blocks == std::vector<std::tuple<unsigned, long, unsigned, size_t>>{{1, 1000, 0x80, 17}, {2, 1500, 0x80, 17}, {1, 2000, 0x00, 17}} &&
+        cues == std::vector<unsigned long>{1000, 1500} &&
+        !pgs_matroska_mux(&invalid, 1, &data, &size);
+}
+
+} // namespace pgscodec_tests
@@ -0,0 +1,10 @@
+namespace pgscodec_tests
+{
+    bool rle_encode();
+    bool color_convert();
+    bool rle_decode();
+    bool decode_display_set();
+    bool map_timestamps();
+    bool seek_index();
+    bool mux_matroska();
+}
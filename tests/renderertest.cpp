@@ -1,8 +1,30 @@
 #include <iostream>
 #include <fstream>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 #include <renderer/pngrenderer.hpp>
 #include <renderer/pgsframecreator.hpp>
+#include <renderer/composite.hpp>
+#include <renderer/effects.hpp>
+#include <renderer/helpers.hpp>
+#include <renderer/textshaping.hpp>
+
+#include <QImage>
+#include <QPainter>
+#include <QFont>
+#include <QFontMetrics>
+
+// access to the layout paths of PNGRenderer which aren't part of its interface
+struct PNGRendererTest
+{
+    static const std::vector<char> renderGeneral(const PNGRenderer &renderer, PNGRenderer::size_t *size, PNGRenderer::pos_t *pos, unsigned long *color_count)
+    {
+        return renderer.renderGeneral(size, pos, color_count);
+    }
+};
 
 namespace renderer_tests {
 
@@ -39,6 +61,116 @@ bool render_simple(const std::string &out_file, const std::string &text, bool ve
     return !png.empty();
 }
 
+bool render_plain_horizontal()
+{
+    // lines without Furigana take the specialized layout path, the encoded PNGs hold the uncompressed pixels
+    for (const auto &text : {"ここがウチの村", "ここがウチの村\nのんびりのどかな所です", "戻ってないから\n行くよ 学校", "あれ ２人ともどうしたの？\nー あぁ──"})
+    {
+        for (const auto justify : {PNGRenderer::TextJustify::Left, PNGRenderer::TextJustify::Center})
+        {
+            PNGRenderer renderer(text, "TakaoPGothic");
+            renderer.setFontSize(42);
+            renderer.setTextJustify(justify);
+
+            PNGRenderer::size_t plainSize, generalSize;
+            PNGRenderer::pos_t plainPos, generalPos;
+            unsigned long plainColors = 0, generalColors = 0;
+
+            const auto plain = renderer.render(&plainSize, &plainPos, &plainColors);
+            const auto general = PNGRendererTest::renderGeneral(renderer, &generalSize, &generalPos, &generalColors);
+
+            if (plain.empty() || plain != general ||
+                plainSize.width != generalSize.width || plainSize.height != generalSize.height ||
+                plainPos.x != generalPos.x || plainPos.y != generalPos.y || plainColors != generalColors)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool render_color_limit()
+{
+    // a blurred border and a glow give far more than 256 colors before quantization
+    PNGRenderer renderer("（{宮内|みやうち}れんげ）おおーっ！\n私の時は 姉ちゃんの", "TakaoPGothic");
+    renderer.setFontSize(42);
+    renderer.setGlowSize(8);
+    renderer.setColorLimit(1000);
+
+    unsigned long color_count = 0;
+    const auto png = renderer.render(nullptr, nullptr, &color_count);
+
+    // the limit is clamped to the 255 colors of a PGS palette
+    return !png.empty() && color_count > 0 && color_count <= 255;
+}
+
+bool shaped_text()
+{
+    // the renderer sets up the Qt context which is required for font rendering
+    PNGRenderer context;
+
+    // horizontal lines are drawn from the shaped glyph runs instead of QPainter::drawText
+    for (const auto &style : {"", "italic", "bold"})
+    {
+        QFont font("TakaoPGothic", 42);
+        font.setItalic(std::string{style} == "italic");
+        font.setBold(std::string{style} == "bold");
+
+        const QFontMetrics metrics(font);
+        const auto lineHeight = metrics.height();
+
+        for (const auto &text : {"ここがウチの村", "のんびりのどかな所です ", "あれ ２人ともどうしたの？", "ー あぁ──", "Hello, World!", "  f"})
+        {
+            const auto line = QString::fromUtf8(text);
+            const auto shaped = shapeText(line, font);
+
+            // the line width is taken from the advance of the shaped line
+            const auto width = metrics.horizontalAdvance(line) + 10;
+            if (qRound(shaped.advance) + 10 != width)
+            {
+                return false;
+            }
+
+            // a rect which is too small clips the text
+            for (const auto rectWidth : {width, 1280, 7})
+            {
+                for (const auto alignment : {0, int(Qt::AlignLeft), int(Qt::AlignCenter), int(Qt::AlignRight | Qt::AlignVCenter)})
+                {
+                    const QRect rect(5, 10, rectWidth, lineHeight);
+
+                    QImage expected(rectWidth + 20, lineHeight + 20, QImage::Format_ARGB32_Premultiplied);
+                    QImage actual(expected.size(), expected.format());
+                    expected.fill(Qt::transparent);
+                    actual.fill(Qt::transparent);
+
+                    QRect expectedBounds;
+                    QPainter painter;
+                    painter.begin(&expected);
+                    painter.setFont(font);
+                    painter.setPen(Qt::white);
+                    painter.drawText(rect, alignment, line, &expectedBounds);
+                    painter.end();
+
+                    painter.begin(&actual);
+                    painter.setFont(font);
+                    painter.setPen(Qt::white);
+                    drawShapedText(&painter, shaped, rect, alignment);
+                    painter.end();
+
+                    if (expected != actual || alignedTextRect(shaped, rect, alignment).toAlignedRect() != expectedBounds)
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
 bool render_pgs_frames()
 {
     const auto srt_file = std::string{UNIT_TEST_CURRENT_DIR} + "/test_custom.ja.srt";
@@ -66,4 +198,180 @@ bool render_pgs_frames_with_command()
     return fc.render(out_path) == PGSFrameCreator::Success;
 }
 
+bool composite_source_over()
+{
+    std::mt19937 random(42);
+
+    for (auto iteration = 0; iteration < 100; ++iteration)
+    {
+        const unsigned width = 1 + random() % 97;
+        const unsigned height = 1 + random() % 13;
+
+        // premultiplied source with transparent, opaque and translucent pixels
+        std::vector<unsigned char> src(width * height * 4), dst(width * height * 4);
+        for (auto i = 0U; i < width * height; ++i)
+        {
+            const auto kind = random() % 3;
+            const unsigned alpha = kind == 0 ? 0 : kind == 1 ? 255 : random() % 256;
+            const unsigned dstAlpha = random() % 256;
+
+            for (auto c = 0U; c < 3; ++c)
+            {
+                src[i * 4 + c] = (unsigned char) (random() % (alpha + 1));
+                dst[i * 4 + c] = (unsigned char) (random() % (dstAlpha + 1));
+            }
+
+            src[i * 4 + 3] = (unsigned char) alpha;
+            dst[i * 4 + 3] = (unsigned char) dstAlpha;
+        }
+
+        const unsigned x = random() % width;
+        const unsigned y = random() % height;
+
+        auto vectorized = dst;
+        auto scalar = dst;
+        compositeSourceOver(vectorized.data(), src.data(), width, height, x, y, width, height);
+        compositeSourceOverScalar(scalar.data(), src.data(), width, height, x, y, width, height);
+
+        if (vectorized != scalar)
+        {
+            return false;
+        }
+
+        // the whole frame must be identical to QPainter::drawImage() on premultiplied images
+        auto composited = dst;
+        auto painted = dst;
+        compositeSourceOver(composited.data(), src.data(), width, height, 0, 0, width, height);
+
+        QImage paintedImage(painted.data(), int(width), int(height), QImage::Format_RGBA8888_Premultiplied);
+        QPainter painter(&paintedImage);
+        painter.drawImage(0, 0, QImage(src.data(), int(width), int(height), QImage::Format_RGBA8888_Premultiplied));
+        painter.end();
+
+        if (composited != painted)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool distance_transform()
+{
+    std::mt19937 random(7);
+
+    for (auto iteration = 0; iteration < 50; ++iteration)
+    {
+        const unsigned width = 1 + random() % 31;
+        const unsigned height = 1 + random() % 31;
+
+        // a few inked pixels, everything else below 50% alpha
+        std::vector<unsigned char> rgba(width * height * 4, 0);
+        for (auto i = 0U; i < width * height; ++i)
+        {
+            rgba[i * 4 + 3] = (unsigned char) (random() % 100 < 3 ? 128 + random() % 128 : random() % 128);
+        }
+
+        DistanceScratch scratch;
+        distanceTransform(rgba.data(), width, height, scratch);
+
+        // compare with brute force distances
+        for (auto y = 0; y < int(height); ++y)
+        {
+            for (auto x = 0; x < int(width); ++x)
+            {
+                auto expected = INFINITY;
+
+                for (auto iy = 0; iy < int(height); ++iy)
+                {
+                    for (auto ix = 0; ix < int(width); ++ix)
+                    {
+                        if (rgba[std::size_t(iy * int(width) + ix) * 4 + 3] >= 128)
+                        {
+                            expected = std::min(expected, std::sqrt(float((x - ix) * (x - ix) + (y - iy) * (y - iy))));
+                        }
+                    }
+                }
+
+                const auto actual = scratch.distance[std::size_t(y * int(width) + x)];
+                if (std::isinf(expected) != std::isinf(actual) || (!std::isinf(expected) && std::fabs(expected - actual) > 0.001f))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool split_image()
+{
+    bool visible[256] = {};
+    visible[1] = true;
+    visible[2] = true;
+
+    // two centered lines of different length
+    const unsigned width = 100, height = 20;
+    std::vector<unsigned char> indices(width * height, 0);
+    for (auto y = 0U; y < height; ++y)
+    {
+        for (auto x = 0U; x < width; ++x)
+        {
+            if (y < 9 || (y > 10 && x >= 30 && x < 70))
+            {
+                indices[y * width + x] = y < 9 ? 1 : 2;
+            }
+        }
+    }
+
+    ImageRect parts[2];
+    if (splitImage(indices.data(), width, height, visible, false, parts) != 2 ||
+        parts[0].x != 0 || parts[0].y != 0 || parts[0].width != 100 || parts[0].height != 9 ||
+        parts[1].x != 30 || parts[1].y != 11 || parts[1].width != 40 || parts[1].height != 9)
+    {
+        return false;
+    }
+
+    // columns of the same image can't be cut
+    if (splitImage(indices.data(), width, height, visible, true, parts) != 1 ||
+        parts[0].width != width || parts[0].height != height)
+    {
+        return false;
+    }
+
+    // the parts cover every visible pixel exactly once
+    std::mt19937 random(3);
+    for (auto iteration = 0; iteration < 200; ++iteration)
+    {
+        const unsigned w = 1 + random() % 40;
+        const unsigned h = 1 + random() % 40;
+        std::vector<unsigned char> image(w * h);
+        for (auto &index : image)
+        {
+            index = (unsigned char) (random() % 10 == 0 ? 1 + random() % 3 : 0);
+        }
+
+        const auto count = splitImage(image.data(), w, h, visible, random() % 2 == 0, parts);
+        for (auto y = 0U; y < h; ++y)
+        {
+            for (auto x = 0U; x < w; ++x)
+            {
+                auto covered = 0U;
+                for (auto i = 0U; i < count; ++i)
+                {
+                    covered += x >= parts[i].x && x < parts[i].x + parts[i].width && y >= parts[i].y && y < parts[i].y + parts[i].height;
+                }
+                if (visible[image[y * w + x]] && covered != 1)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
 } // namespace renderer_tests
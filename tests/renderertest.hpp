@@ -1,6 +1,12 @@
 namespace renderer_tests
 {
     bool render_simple(const std::string &out_file, const std::string &text, bool vertical = false);
+    bool render_plain_horizontal();
+    bool render_color_limit();
+    bool shaped_text();
     bool render_pgs_frames();
     bool render_pgs_frames_with_command();
+    bool composite_source_over();
+    bool distance_transform();
+    bool split_image();
 }
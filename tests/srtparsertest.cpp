@@ -81,6 +81,10 @@ bool parse_styled_external_hints()
 "# text-direction=horizontal\n"
 "# line-space-reduction=2\n"
 "# furigana-line-space-reduction=2\n"
+"# shadow-offset=3,-2\n"
+"# fade-in=200\n"
+"# color-matrix=bt709-limited\n"
+"# forced=true\n"
 "\n";
 
     const auto subs = SrtParser::parseStyledWithExternalHints(srt_file, hints);
@@ -88,6 +92,12 @@ bool parse_styled_external_hints()
     return
         subs.size() == 270 &&
         subs.at(0).furiganaLineSpaceReduction() == 2 &&
+        subs.at(0).shadowOffsetX() == 3 &&
+        subs.at(0).shadowOffsetY() == -2 &&
+        subs.at(0).fadeIn() == 200 &&
+        subs.at(0).fadeOut() == 0 &&
+        subs.at(0).colorMatrix() == "bt709-limited" &&
+        subs.at(0).isForced() &&
         subs.at(0).property(SrtParser::StyledSubtitleItem::TextDirection) == "horizontal";
 }
 